@@ -68,6 +68,22 @@ static Mutex s_lastMutex(false,"CallEndpoint::last");
 static const String s_audioType = "audio";
 static const String s_copyParams = "copyparams";
 
+// Engine wide map of channels by id, does not own the channels
+static HashList s_chanIds(1021);
+static Mutex s_chanIdsMutex(false,"ChannelIds");
+
+static inline void chanIdAdd(Channel* chan)
+{
+    Lock lck(s_chanIdsMutex);
+    s_chanIds.append(chan)->setDelete(false);
+}
+
+static inline void chanIdRemove(Channel* chan)
+{
+    Lock lck(s_chanIdsMutex);
+    s_chanIds.remove(chan,false,true);
+}
+
 // Check if a Lock taken on the common mutex succeeded, wait up to 55s more in congestion
 static bool checkRetry(Lock& lock)
 {
@@ -391,7 +407,7 @@ Mutex Channel::s_chanDataMutex(false,"ChannelData");
 Channel::Channel(Driver* driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_chanParams(0), m_driver(driver), m_outgoing(outgoing),
-      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
+      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_timerDue(0), m_timerSlot(-2), m_dtmfTime(0),
       m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
@@ -400,7 +416,7 @@ Channel::Channel(Driver* driver, const char* id, bool outgoing)
 Channel::Channel(Driver& driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_chanParams(0), m_driver(&driver), m_outgoing(outgoing),
-      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
+      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_timerDue(0), m_timerSlot(-2), m_dtmfTime(0),
       m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
@@ -487,6 +503,10 @@ void Channel::initChan()
     m_driver->m_total++;
     m_driver->m_chanCount++;
     m_driver->channels().append(this);
+    m_driver->m_chanHash.append(this)->setDelete(false);
+    chanIdAdd(this);
+    m_timerSlot = -1;
+    m_driver->timerSchedule(this,timerDue());
     m_driver->changed();
 }
 
@@ -497,11 +517,16 @@ void Channel::dropChan()
     m_driver->lock();
     if (!m_driver)
 	TraceDebug(traceId(),DebugFail,"Driver lost in dropChan! [%p]",this);
+    // some drivers empty their channels list directly, always clear the indexes
+    m_driver->m_chanHash.remove(this,false,true);
+    chanIdRemove(this);
     if (m_driver->channels().remove(this,false)) {
 	if (m_driver->m_chanCount > 0)
 	    m_driver->m_chanCount--;
 	m_driver->changed();
     }
+    m_driver->timerSchedule(this,0);
+    m_timerSlot = -2;
     m_driver->unlock();
 }
 
@@ -564,7 +589,20 @@ void Channel::dispatched(const Message& msg, bool handled)
 void Channel::setId(const char* newId)
 {
     debugName(0);
-    CallEndpoint::setId(newId);
+    if (m_driver) {
+	// the channel must be moved in the maps hashed by id
+	Lock lck(m_driver);
+	bool listed = (0 != m_driver->m_chanHash.remove(this,false,true));
+	if (listed)
+	    chanIdRemove(this);
+	CallEndpoint::setId(newId);
+	if (listed) {
+	    m_driver->m_chanHash.append(this)->setDelete(false);
+	    chanIdAdd(this);
+	}
+    }
+    else
+	CallEndpoint::setId(newId);
     debugName(id());
 }
 
@@ -880,6 +918,27 @@ void Channel::checkTimers(Message& msg, const Time& tmr)
 	msgDrop(msg,"postdialdelay");
 }
 
+u_int64_t Channel::timerDue() const
+{
+    u_int64_t due = m_timeout;
+    if (m_maxcall && (!due || (m_maxcall < due)))
+	due = m_maxcall;
+    if (m_maxPDD && (!due || (m_maxPDD < due)))
+	due = m_maxPDD;
+    return due;
+}
+
+void Channel::updateTimer()
+{
+    Driver* drv = m_driver;
+    // channels get scheduled only while they are in the driver's list
+    if (!drv || (m_timerSlot < -1))
+	return;
+    Lock mylock(drv);
+    if (m_timerSlot >= -1)
+	drv->timerSchedule(this,timerDue());
+}
+
 bool Channel::callPrerouted(Message& msg, bool handled)
 {
     status("prerouted");
@@ -1083,6 +1142,143 @@ TokenDict Module::s_messages[] = {
 
 unsigned int Module::s_delay = 5;
 
+// Number of one second slots in the driver's channel timer wheel
+#define DRIVER_TIMER_SLOTS 128
+
+namespace TelEngine {
+
+// Handler delivering a channel message straight to the driver owning the
+//  target channel instead of letting each driver relay check it
+class ChanDispatcher : public MessageHandler
+{
+public:
+    inline ChanDispatcher(const char* name, int id, unsigned int priority)
+	: MessageHandler(name,priority,"direct"), m_id(id)
+	{ m_drivers.setDelete(false); }
+    virtual bool received(Message& msg);
+    inline int id() const
+	{ return m_id; }
+    static bool valid(int id, const char* name);
+    static void attach(Driver* drv, int id, unsigned int priority);
+    static void detach(MessageReceiver* recv, int ids);
+private:
+    // Relays carrying a channel id that can be delivered by a dispatcher
+    static const int s_directIds = Driver::Drop | Driver::Locate | Driver::Masquerade |
+	Driver::Ringing | Driver::Answered | Driver::Tone | Driver::Text |
+	Driver::Progress | Driver::Update | Driver::Transfer | Driver::Control;
+    Driver* owner(const String& chanId) const;
+    bool deliver(Message& msg, const String& chanId, Driver*& drv, bool& handled);
+    ObjList m_drivers;
+    int m_id;
+};
+
+}; // namespace TelEngine
+
+
+// Dispatchers are installed once and kept until the engine exits
+static ObjList s_dispatchers;
+static RWLock s_dispatchLock("ChanDispatch");
+
+// Find the driver owning a channel if it uses direct delivery
+Driver* ChanDispatcher::owner(const String& chanId) const
+{
+    RefPointer<Channel> chan;
+    if (!(chanId && Driver::findChannel(chanId,chan)))
+	return 0;
+    Driver* drv = chan->driver();
+    return (drv && (drv->m_directIds & m_id)) ? drv : 0;
+}
+
+// Deliver to the driver owning a channel if it uses direct delivery
+bool ChanDispatcher::deliver(Message& msg, const String& chanId, Driver*& drv, bool& handled)
+{
+    Driver* own = owner(chanId);
+    if (!own)
+	return false;
+    drv = own;
+    handled = static_cast<MessageReceiver*>(own)->received(msg,m_id);
+    return true;
+}
+
+bool ChanDispatcher::received(Message& msg)
+{
+    RLock lck(s_dispatchLock);
+    Driver* drv = 0;
+    bool handled = false;
+    if (m_id & (Driver::Drop | Driver::Locate | Driver::Masquerade)) {
+	if (deliver(msg,msg[YSTRING("id")],drv,handled))
+	    return handled;
+    }
+    else {
+	const String& peer = msg[YSTRING("peerid")];
+	if (!peer) {
+	    if (deliver(msg,msg[YSTRING("targetid")],drv,handled))
+		return handled;
+	}
+	else if (deliver(msg,peer,drv,handled)) {
+	    if (handled)
+		return true;
+	    // drivers that don't own the peer would try to match the target
+	    // but the peer's driver must not see the message twice
+	    Driver* peerDrv = drv;
+	    Driver* target = owner(msg[YSTRING("targetid")]);
+	    if (target == peerDrv)
+		return false;
+	    if (target)
+		return static_cast<MessageReceiver*>(target)->received(msg,m_id);
+	}
+    }
+    // unknown channel, let each driver check the message like its relay would
+    for (ObjList* l = m_drivers.skipNull(); l; l = l->skipNext()) {
+	MessageReceiver* recv = static_cast<MessageReceiver*>(l->get());
+	if ((recv != static_cast<MessageReceiver*>(drv)) && recv->received(msg,m_id))
+	    return true;
+    }
+    return false;
+}
+
+// Check if a relay can be replaced by a dispatcher
+bool ChanDispatcher::valid(int id, const char* name)
+{
+    const char* msgName = Driver::messageName(id);
+    return (id & s_directIds) && msgName && name && !::strcmp(name,msgName);
+}
+
+// Register a driver with the dispatcher of a message, create it if needed
+void ChanDispatcher::attach(Driver* drv, int id, unsigned int priority)
+{
+    WLock lck(s_dispatchLock);
+    ChanDispatcher* disp = 0;
+    for (ObjList* l = s_dispatchers.skipNull(); l; l = l->skipNext()) {
+	disp = static_cast<ChanDispatcher*>(l->get());
+	if ((disp->id() == id) && (disp->priority() == priority))
+	    break;
+	disp = 0;
+    }
+    if (!disp) {
+	disp = new ChanDispatcher(Driver::messageName(id),id,priority);
+	s_dispatchers.append(disp)->setDelete(false);
+	Engine::install(disp);
+    }
+    MessageReceiver* recv = drv;
+    if (!disp->m_drivers.find(recv))
+	disp->m_drivers.append(recv);
+    drv->m_directIds |= id;
+}
+
+// Remove a receiver from the dispatchers of a set of messages
+void ChanDispatcher::detach(MessageReceiver* recv, int ids)
+{
+    if (!(ids & s_directIds))
+	return;
+    WLock lck(s_dispatchLock);
+    for (ObjList* l = s_dispatchers.skipNull(); l; l = l->skipNext()) {
+	ChanDispatcher* disp = static_cast<ChanDispatcher*>(l->get());
+	if (ids & disp->id())
+	    disp->m_drivers.remove(recv,false);
+    }
+}
+
 const char* Module::messageName(int id)
 {
     if ((id <= 0) || (id >PubLast))
@@ -1098,6 +1294,7 @@ Module::Module(const char* name, const char* type, bool earlyInit)
 
 Module::~Module()
 {
+    ChanDispatcher::detach(this,m_relays);
 }
 
 void* Module::getObject(const String& name) const
@@ -1122,6 +1319,17 @@ bool Module::installRelay(int id, const char* name, unsigned priority, NamedStri
     }
     m_relays |= id;
 
+    if (!filter) {
+	// drivers may have channel messages delivered directly
+	Driver* drv = static_cast<Driver*>(getObject(YATOM("Driver")));
+	if (drv && drv->m_direct && ChanDispatcher::valid(id,name)) {
+	    // dispatchers call drivers with their lock held, don't hold ours
+	    lock.drop();
+	    ChanDispatcher::attach(drv,id,priority);
+	    return true;
+	}
+    }
+
     MessageRelay* relay = new MessageRelay(name,this,id,priority,Module::name());
     if (filter)
 	relay->setFilter(filter);
@@ -1174,6 +1382,14 @@ bool Module::uninstallRelay(int id, bool delRelay)
 	l->remove(delRelay);
 	break;
     }
+    if (m_relays & id) {
+	// delivered by a channel dispatcher, not by a relay of our own
+	Driver* drv = static_cast<Driver*>(getObject(YATOM("Driver")));
+	if (drv)
+	    drv->m_directIds &= ~id;
+	ChanDispatcher::detach(this,id);
+	m_relays &= ~id;
+    }
     return false;
 }
 
@@ -1185,6 +1401,13 @@ bool Module::uninstallRelays()
 	m_relays &= ~relay->id();
 	relay->destruct();
     }
+    if (m_relays) {
+	Driver* drv = static_cast<Driver*>(getObject(YATOM("Driver")));
+	if (drv)
+	    drv->m_directIds = 0;
+	ChanDispatcher::detach(this,m_relays);
+	m_relays = 0;
+    }
     return (0 == m_relays) && (0 == m_relayList.count());
 }
 
@@ -1373,15 +1596,21 @@ bool Module::filterDebug(const String& item) const
 
 Driver::Driver(const char* name, const char* type)
     : Module(name,type),
-      m_init(false), m_varchan(true),
+      m_init(false), m_varchan(true), m_chanHash(1021),
       m_routing(0), m_routed(0), m_total(0),
       m_nextid(0), m_timeout(0),
       m_maxroute(0), m_maxchans(0), m_chanCount(0),
-      m_dtmfDups(false), m_doExpire(true)
+      m_dtmfDups(false), m_direct(false), m_directIds(0),
+      m_timerWheel(0), m_timerSec(Time::secNow()), m_doExpire(true)
 {
     m_prefix << name << "/";
 }
 
+Driver::~Driver()
+{
+    delete[] m_timerWheel;
+}
+
 void* Driver::getObject(const String& name) const
 {
     if (name == YATOM("Driver"))
@@ -1402,6 +1631,7 @@ void Driver::setup(const char* prefix, bool minimal)
     if (m_init)
 	return;
     m_init = true;
+    m_direct = Engine::config().getBoolValue(YSTRING("telephony"),YSTRING("directchans"));
     m_prefix = prefix ? prefix : name().c_str();
     if (m_prefix && !m_prefix.endsWith("/"))
 	m_prefix += "/";
@@ -1419,6 +1649,59 @@ void Driver::setup(const char* prefix, bool minimal)
     installRelay(Answered);
 }
 
+// Place a channel in the timer wheel slot of the second its timer is due
+void Driver::timerSchedule(Channel* chan, u_int64_t due)
+{
+    if (chan->m_timerSlot >= 0) {
+	if (chan->m_timerDue == due)
+	    return;
+	m_timerWheel[chan->m_timerSlot].remove(chan,false);
+	chan->m_timerSlot = -1;
+    }
+    chan->m_timerDue = due;
+    if (!due)
+	return;
+    if (!m_timerWheel)
+	m_timerWheel = new ObjList[DRIVER_TIMER_SLOTS];
+    u_int64_t sec = (due + 999999) / 1000000;
+    if (sec <= m_timerSec)
+	sec = m_timerSec + 1;
+    chan->m_timerSlot = (int)(sec % DRIVER_TIMER_SLOTS);
+    m_timerWheel[chan->m_timerSlot].append(chan)->setDelete(false);
+}
+
+// Collect referenced channels from the slots of the seconds passed since last run
+void Driver::timerExpire(ObjList& expired, const Time& tmr)
+{
+    u_int32_t now = (u_int32_t)(tmr.usec() / 1000000);
+    if (now <= m_timerSec)
+	return;
+    unsigned int n = now - m_timerSec;
+    if (n > DRIVER_TIMER_SLOTS)
+	n = DRIVER_TIMER_SLOTS;
+    u_int32_t sec = m_timerSec;
+    m_timerSec = now;
+    if (!m_timerWheel)
+	return;
+    while (n--) {
+	ObjList* l = m_timerWheel + (++sec % DRIVER_TIMER_SLOTS);
+	for (l = l->skipNull(); l; ) {
+	    Channel* c = static_cast<Channel*>(l->get());
+	    // slots also hold channels due in later turns of the wheel
+	    if (c->m_timerDue > tmr) {
+		l = l->skipNext();
+		continue;
+	    }
+	    l->remove(false);
+	    l = l->skipNull();
+	    c->m_timerSlot = -1;
+	    c->m_timerDue = 0;
+	    if (c->ref())
+		expired.append(c);
+	}
+    }
+}
+
 bool Driver::isBusy() const
 {
     return (m_routing || m_chanCount);
@@ -1426,8 +1709,14 @@ bool Driver::isBusy() const
 
 Channel* Driver::find(const String& id) const
 {
-    const ObjList* pos = m_chans.find(id);
-    return pos ? static_cast<Channel*>(pos->get()) : 0;
+    return static_cast<Channel*>(m_chanHash[id]);
+}
+
+bool Driver::findChannel(const String& id, RefPointer<Channel>& chan)
+{
+    Lock lck(s_chanIdsMutex);
+    chan = static_cast<Channel*>(s_chanIds[id]);
+    return chan != 0;
 }
 
 bool Driver::received(Message &msg, int id)
@@ -1441,22 +1730,21 @@ bool Driver::received(Message &msg, int id)
 	    if (m_doExpire && lock(950000)) {
 		if (m_doExpire) {
 		    m_doExpire = false;
-		    // check each channel for timeouts
-		    ListIterator iter(m_chans);
+		    // check only the channels whose timers have expired
 		    Time t;
-		    for (;;) {
-			RefPointer<Channel> c = static_cast<Channel*>(iter.get());
-			unlock();
-			if (!c)
-			    break;
+		    ObjList expired;
+		    timerExpire(expired,t);
+		    unlock();
+		    for (ObjList* l = expired.skipNull(); l; l = l->skipNext()) {
+			Channel* c = static_cast<Channel*>(l->get());
 			c->checkTimers(msg,t);
-			c = 0;
-			lock();
+			c->updateTimer();
 		    }
+		    expired.clear();
+		    lock();
 		    m_doExpire = true;
 		}
-		else
-		    unlock();
+		unlock();
 	    }
 	    return Module::received(msg,id);
 	case Status:
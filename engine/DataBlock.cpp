@@ -22,6 +22,17 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef _WINDOWS
+#include <pthread.h>
+#endif
+
+// AVX2 gather kernels are built with a function target, selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define G711_AVX2
+#include <immintrin.h>
+#endif
+
 using namespace TelEngine;
 
 namespace { // anonymous
@@ -32,10 +43,177 @@ extern "C" {
 #include "u2a.h"
 #include "u2s.h"
 
-static unsigned char s2a[65536];
-static unsigned char s2u[65536];
+// 3 extra octets allow 32 bit gather loads at the last index
+static unsigned char s2a[65536 + 3];
+static unsigned char s2u[65536 + 3];
+}
+
+// Convert a number of samples into a caller provided buffer
+typedef void (*G711Func)(void* dest, const void* src, unsigned int samples);
+
+static void scalarA2U(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    while (n--)
+	*d++ = a2u[*s++];
+}
+
+static void scalarU2A(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    while (n--)
+	*d++ = u2a[*s++];
+}
+
+static void scalarA2S(void* dest, const void* src, unsigned int n)
+{
+    unsigned short* d = (unsigned short*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    while (n--)
+	*d++ = a2s[*s++];
+}
+
+static void scalarU2S(void* dest, const void* src, unsigned int n)
+{
+    unsigned short* d = (unsigned short*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    while (n--)
+	*d++ = u2s[*s++];
+}
+
+static void scalarS2A(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned short* s = (const unsigned short*)src;
+    while (n--)
+	*d++ = s2a[*s++];
+}
+
+static void scalarS2U(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned short* s = (const unsigned short*)src;
+    while (n--)
+	*d++ = s2u[*s++];
+}
+
+#ifdef G711_AVX2
+
+// 32 bit copies of the 256 entry tables for gather loads
+static int s_a2u32[256];
+static int s_u2a32[256];
+static int s_a2s32[256];
+static int s_u2s32[256];
+
+// Pack 16 values of 0-65535 from two vectors of 32 bit, keeping their order
+__attribute__((target("avx2")))
+static inline __m256i avx2Pack16(__m256i lo, __m256i hi)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo,hi),_MM_SHUFFLE(3,1,2,0));
+}
+
+// Store 16 values of 0-255 held in 16 bit lanes as octets
+__attribute__((target("avx2")))
+static inline void avx2Store8(unsigned char* d, __m256i v)
+{
+    _mm_storeu_si128((__m128i*)d,_mm_packus_epi16(_mm256_castsi256_si128(v),
+	_mm256_extracti128_si256(v,1)));
+}
+
+// Look up 16 octets in a table of 256 entries of 32 bit
+__attribute__((target("avx2")))
+static inline __m256i avx2Lookup8(const unsigned char* s, const int* table)
+{
+    __m128i in = _mm_loadu_si128((const __m128i*)s);
+    __m256i lo = _mm256_i32gather_epi32(table,_mm256_cvtepu8_epi32(in),4);
+    __m256i hi = _mm256_i32gather_epi32(table,_mm256_cvtepu8_epi32(_mm_srli_si128(in,8)),4);
+    return avx2Pack16(lo,hi);
+}
+
+// Look up 16 samples of 16 bit in a table of 65536 octets
+__attribute__((target("avx2")))
+static inline __m256i avx2Lookup16(const unsigned short* s, const unsigned char* table)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i in = _mm256_loadu_si256((const __m256i*)s);
+    __m256i lo = _mm256_i32gather_epi32((const int*)table,
+	_mm256_cvtepu16_epi32(_mm256_castsi256_si128(in)),1);
+    __m256i hi = _mm256_i32gather_epi32((const int*)table,
+	_mm256_cvtepu16_epi32(_mm256_extracti128_si256(in,1)),1);
+    return avx2Pack16(_mm256_and_si256(lo,mask),_mm256_and_si256(hi,mask));
+}
+
+__attribute__((target("avx2")))
+static void avx2A2U(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+	avx2Store8(d,avx2Lookup8(s,s_a2u32));
+    scalarA2U(d,s,n);
+}
+
+__attribute__((target("avx2")))
+static void avx2U2A(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+	avx2Store8(d,avx2Lookup8(s,s_u2a32));
+    scalarU2A(d,s,n);
+}
+
+__attribute__((target("avx2")))
+static void avx2A2S(void* dest, const void* src, unsigned int n)
+{
+    unsigned short* d = (unsigned short*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+	_mm256_storeu_si256((__m256i*)d,avx2Lookup8(s,s_a2s32));
+    scalarA2S(d,s,n);
+}
+
+__attribute__((target("avx2")))
+static void avx2U2S(void* dest, const void* src, unsigned int n)
+{
+    unsigned short* d = (unsigned short*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+	_mm256_storeu_si256((__m256i*)d,avx2Lookup8(s,s_u2s32));
+    scalarU2S(d,s,n);
+}
+
+__attribute__((target("avx2")))
+static void avx2S2A(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned short* s = (const unsigned short*)src;
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+	avx2Store8(d,avx2Lookup16(s,s2a));
+    scalarS2A(d,s,n);
+}
+
+__attribute__((target("avx2")))
+static void avx2S2U(void* dest, const void* src, unsigned int n)
+{
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned short* s = (const unsigned short*)src;
+    for (; n >= 16; n -= 16, s += 16, d += 16)
+	avx2Store8(d,avx2Lookup16(s,s2u));
+    scalarS2U(d,s,n);
 }
 
+#endif // G711_AVX2
+
+static G711Func s_a2uFunc = scalarA2U;
+static G711Func s_u2aFunc = scalarU2A;
+static G711Func s_a2sFunc = scalarA2S;
+static G711Func s_u2sFunc = scalarU2S;
+static G711Func s_s2aFunc = scalarS2A;
+static G711Func s_s2uFunc = scalarS2U;
+
 class InitG711
 {
 public:
@@ -68,23 +246,270 @@ public:
 		val = (--v) ^ 0xd5;
 	    s2a[i] = val;
 	}
+#ifdef G711_AVX2
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2"))
+	    return;
+	for (i = 0; i < 256; i++) {
+	    s_a2u32[i] = a2u[i];
+	    s_u2a32[i] = u2a[i];
+	    s_a2s32[i] = a2s[i];
+	    s_u2s32[i] = u2s[i];
+	}
+	s_a2uFunc = avx2A2U;
+	s_u2aFunc = avx2U2A;
+	s_a2sFunc = avx2A2S;
+	s_u2sFunc = avx2U2S;
+	s_s2aFunc = avx2S2A;
+	s_s2uFunc = avx2S2U;
+#endif
     }
 };
 
+// Find the conversion function and sample sizes between two formats
+static G711Func g711Func(const String& sFormat, const String& dFormat,
+    unsigned int& sl, unsigned int& dl)
+{
+    if (sFormat == YSTRING("slin")) {
+	sl = 2;
+	dl = 1;
+	if (dFormat == YSTRING("alaw"))
+	    return s_s2aFunc;
+	if (dFormat == YSTRING("mulaw"))
+	    return s_s2uFunc;
+    }
+    else if (sFormat == YSTRING("alaw")) {
+	sl = 1;
+	if (dFormat == YSTRING("mulaw")) {
+	    dl = 1;
+	    return s_a2uFunc;
+	}
+	if (dFormat == YSTRING("slin")) {
+	    dl = 2;
+	    return s_a2sFunc;
+	}
+    }
+    else if (sFormat == YSTRING("mulaw")) {
+	sl = 1;
+	if (dFormat == YSTRING("alaw")) {
+	    dl = 1;
+	    return s_u2aFunc;
+	}
+	if (dFormat == YSTRING("slin")) {
+	    dl = 2;
+	    return s_u2sFunc;
+	}
+    }
+    return 0;
+}
+
 static InitG711 s_initG711;
 
 }; // anonymous namespace
 
 static const DataBlock s_empty;
 
-static inline void* dbAlloc(unsigned int n, void* oldBuf = 0)
+// Buffer sizes kept in the per thread pools, fitting common media frames
+#define POOL_CLASSES 6
+#define POOL_MIN_SIZE 64
+#define POOL_MAX_SIZE (POOL_MIN_SIZE << (POOL_CLASSES - 1))
+
+#ifndef _WINDOWS
+
+// Per thread cache of released buffers. Cached buffers are plain malloc()
+//  blocks so they can be reallocated or freed by anyone owning them
+class DataPool
+{
+public:
+    DataPool();
+    ~DataPool();
+    void* get(unsigned int cls);
+    bool put(unsigned int cls, void* buf);
+    void flush();
+    // singly linked lists threaded through the first octets of each buffer
+    void* m_free[POOL_CLASSES];
+    unsigned int m_count[POOL_CLASSES];
+    u_int64_t m_hits;
+    u_int64_t m_misses;
+    DataPool* m_prev;
+    DataPool* m_next;
+};
+
+static volatile bool s_poolEnabled = false;
+static unsigned int s_poolMax = 64;
+static u_int64_t s_poolHits = 0;
+static u_int64_t s_poolMisses = 0;
+static DataPool* s_pools = 0;
+static pthread_key_t s_poolKey;
+static bool s_poolKeyOk = false;
+static Mutex s_poolMutex(false,"DataPool");
+
+DataPool::DataPool()
+    : m_hits(0), m_misses(0), m_prev(0), m_next(0)
+{
+    for (unsigned int i = 0; i < POOL_CLASSES; i++) {
+	m_free[i] = 0;
+	m_count[i] = 0;
+    }
+    Lock mylock(s_poolMutex);
+    m_next = s_pools;
+    if (m_next)
+	m_next->m_prev = this;
+    s_pools = this;
+}
+
+DataPool::~DataPool()
+{
+    flush();
+    Lock mylock(s_poolMutex);
+    s_poolHits += m_hits;
+    s_poolMisses += m_misses;
+    if (m_prev)
+	m_prev->m_next = m_next;
+    else
+	s_pools = m_next;
+    if (m_next)
+	m_next->m_prev = m_prev;
+}
+
+void* DataPool::get(unsigned int cls)
+{
+    void* buf = m_free[cls];
+    if (buf) {
+	m_free[cls] = *(void**)buf;
+	m_count[cls]--;
+	m_hits++;
+    }
+    else
+	m_misses++;
+    return buf;
+}
+
+bool DataPool::put(unsigned int cls, void* buf)
+{
+    if (m_count[cls] >= s_poolMax)
+	return false;
+    *(void**)buf = m_free[cls];
+    m_free[cls] = buf;
+    m_count[cls]++;
+    return true;
+}
+
+void DataPool::flush()
+{
+    for (unsigned int i = 0; i < POOL_CLASSES; i++) {
+	while (m_free[i]) {
+	    void* buf = m_free[i];
+	    m_free[i] = *(void**)buf;
+	    ::free(buf);
+	}
+	m_count[i] = 0;
+    }
+}
+
+static void poolDestroy(void* pool)
+{
+    delete static_cast<DataPool*>(pool);
+}
+
+// Retrieve the pool of the current thread, create it if needed
+static inline DataPool* threadPool()
+{
+    DataPool* pool = static_cast<DataPool*>(::pthread_getspecific(s_poolKey));
+    if (!pool) {
+	pool = new DataPool;
+	::pthread_setspecific(s_poolKey,pool);
+    }
+    return pool;
+}
+
+// Size class of a buffer size, -1 if not pooled
+static inline int poolClass(unsigned int n)
+{
+    if (n > POOL_MAX_SIZE)
+	return -1;
+    int cls = 0;
+    for (unsigned int sz = POOL_MIN_SIZE; sz < n; sz <<= 1)
+	cls++;
+    return cls;
+}
+
+#endif // !_WINDOWS
+
+// Allocate a new buffer, size may be increased to the size of a pool class
+static inline void* dbMalloc(unsigned int& n)
+{
+#ifndef _WINDOWS
+    if (s_poolEnabled) {
+	int cls = poolClass(n);
+	if (cls >= 0) {
+	    n = POOL_MIN_SIZE << cls;
+	    void* data = threadPool()->get(cls);
+	    if (data)
+		return data;
+	}
+    }
+#endif
+    return ::malloc(n);
+}
+
+// Release a buffer, keep it in the pool if allocated with the size of a class
+static inline void dbFree(void* data, unsigned int n)
+{
+#ifndef _WINDOWS
+    if (s_poolEnabled && n >= POOL_MIN_SIZE) {
+	int cls = poolClass(n);
+	if ((cls >= 0) && (n == (unsigned int)(POOL_MIN_SIZE << cls))
+	    && threadPool()->put(cls,data))
+	    return;
+    }
+#endif
+    ::free(data);
+}
+
+static inline void* dbAlloc(unsigned int& n, void* oldBuf = 0)
 {
-    void* data = ::realloc(oldBuf,n);
+    void* data = oldBuf ? ::realloc(oldBuf,n) : dbMalloc(n);
     if (!data)
 	Debug("DataBlock",DebugFail,"realloc(%u) returned NULL!",n);
     return data;
 }
 
+void DataBlock::setPool(bool enable, unsigned int maxCached)
+{
+#ifndef _WINDOWS
+    Lock mylock(s_poolMutex);
+    if (enable && !s_poolKeyOk)
+	s_poolKeyOk = (0 == ::pthread_key_create(&s_poolKey,poolDestroy));
+    if (maxCached < 1)
+	maxCached = 1;
+    s_poolMax = maxCached;
+    s_poolEnabled = enable && s_poolKeyOk;
+#endif
+}
+
+bool DataBlock::poolStats(u_int64_t& hits, u_int64_t& misses, unsigned int& cached)
+{
+    hits = 0;
+    misses = 0;
+    cached = 0;
+#ifndef _WINDOWS
+    Lock mylock(s_poolMutex);
+    hits = s_poolHits;
+    misses = s_poolMisses;
+    // counters of other threads are read without locking them
+    for (DataPool* p = s_pools; p; p = p->m_next) {
+	hits += p->m_hits;
+	misses += p->m_misses;
+	for (unsigned int i = 0; i < POOL_CLASSES; i++)
+	    cached += p->m_count[i];
+    }
+    return s_poolEnabled;
+#else
+    return false;
+#endif
+}
+
 const DataBlock& DataBlock::empty()
 {
     return s_empty;
@@ -129,13 +554,14 @@ void* DataBlock::getObject(const String& name) const
 
 void DataBlock::clear(bool deleteData)
 {
+    unsigned int allocated = m_allocated;
     m_length = 0;
     m_allocated = 0;
     if (m_data) {
 	void *data = m_data;
 	m_data = 0;
 	if (deleteData)
-	    ::free(data);
+	    dbFree(data,allocated);
     }
 }
 
@@ -228,13 +654,14 @@ DataBlock& DataBlock::assign(void* value, unsigned int len, bool copyData, unsig
 {
     if ((value != m_data) || (len != m_length)) {
 	void *odata = m_data;
+	unsigned int oalloc = m_allocated;
 	m_length = 0;
 	m_allocated = 0;
 	m_data = 0;
 	if (len) {
 	    if (copyData) {
 		allocated = allocLen(len);
-		void *data = ::malloc(allocated);
+		void *data = dbMalloc(allocated);
 		if (data) {
 		    if (value)
 			::memcpy(data,value,len);
@@ -256,7 +683,7 @@ DataBlock& DataBlock::assign(void* value, unsigned int len, bool copyData, unsig
 	    }
 	}
 	if (odata && (odata != m_data))
-	    ::free(odata);
+	    dbFree(odata,oalloc);
     }
     return *this;
 }
@@ -309,39 +736,9 @@ bool DataBlock::convert(const DataBlock& src, const String& sFormat,
 	operator=(src);
 	return true;
     }
-    unsigned sl = 0, dl = 0;
-    void *ctable = 0;
-    if (sFormat == YSTRING("slin")) {
-	sl = 2;
-	dl = 1;
-	if (dFormat == YSTRING("alaw"))
-	    ctable = s2a;
-	else if (dFormat == YSTRING("mulaw"))
-	    ctable = s2u;
-    }
-    else if (sFormat == YSTRING("alaw")) {
-	sl = 1;
-	if (dFormat == YSTRING("mulaw")) {
-	    dl = 1;
-	    ctable = a2u;
-	}
-	else if (dFormat == YSTRING("slin")) {
-	    dl = 2;
-	    ctable = a2s;
-	}
-    }
-    else if (sFormat == YSTRING("mulaw")) {
-	sl = 1;
-	if (dFormat == YSTRING("alaw")) {
-	    dl = 1;
-	    ctable = u2a;
-	}
-	else if (dFormat == YSTRING("slin")) {
-	    dl = 2;
-	    ctable = u2s;
-	}
-    }
-    if (!ctable) {
+    unsigned int sl = 0, dl = 0;
+    G711Func func = g711Func(sFormat,dFormat,sl,dl);
+    if (!func) {
 	clear();
 	return false;
     }
@@ -354,30 +751,37 @@ bool DataBlock::convert(const DataBlock& src, const String& sFormat,
 	return true;
     }
     resize(len * dl);
-    if ((sl == 1) && (dl == 1)) {
-	unsigned char *s = (unsigned char *) src.data();
-	unsigned char *d = (unsigned char *) data();
-	unsigned char *c = (unsigned char *) ctable;
-	while (len--)
-	    *d++ = c[*s++];
-    }
-    else if ((sl == 1) && (dl == 2)) {
-	unsigned char *s = (unsigned char *) src.data();
-	unsigned short *d = (unsigned short *) data();
-	unsigned short *c = (unsigned short *) ctable;
-	while (len--)
-	    *d++ = c[*s++];
-    }
-    else if ((sl == 2) && (dl == 1)) {
-	unsigned short *s = (unsigned short *) src.data();
-	unsigned char *d = (unsigned char *) data();
-	unsigned char *c = (unsigned char *) ctable;
-	while (len--)
-	    *d++ = c[*s++];
+    func(data(),src.data(),len);
+    return true;
+}
+
+bool DataBlock::convert(void* dest, const void* src, unsigned int samples,
+    const String& sFormat, const String& dFormat)
+{
+    if (sFormat == dFormat) {
+	unsigned int sl = sampleSize(sFormat);
+	if (sl && samples)
+	    ::memcpy(dest,src,samples * sl);
+	return (sl != 0);
     }
+    unsigned int sl = 0, dl = 0;
+    G711Func func = g711Func(sFormat,dFormat,sl,dl);
+    if (!func)
+	return false;
+    if (samples)
+	func(dest,src,samples);
     return true;
 }
 
+unsigned int DataBlock::sampleSize(const String& format)
+{
+    if (format == YSTRING("slin"))
+	return 2;
+    if (format == YSTRING("alaw") || format == YSTRING("mulaw"))
+	return 1;
+    return 0;
+}
+
 // Decode a single nibble, return -1 on error
 inline signed char hexDecode(char c)
 {
@@ -462,7 +866,7 @@ bool DataBlock::changeHex(unsigned int pos, const char* data, unsigned int len,
 	buf[iBuf++] = (c1 << 4) | c2;
     }
     if (iBuf < n) {
-	::free(newData);
+	dbFree(newData,aLen);
 	return retResult(false,-2,res);
     }
     copyData(newData,m_data,m_length,pos,n);
@@ -21,6 +21,11 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace TelEngine {
 
@@ -39,6 +44,8 @@ static const FormatInfo s_formats[] = {
     FormatInfo("2*slin/32000", 1280, 10000, "audio", 32000, 2),
     FormatInfo("2*alaw", 160, 10000, "audio", 8000, 2),
     FormatInfo("2*mulaw", 160, 10000, "audio", 8000, 2),
+    FormatInfo("slin/44100", 882, 10000, "audio", 44100, 1, true),
+    FormatInfo("slin/48000", 960, 10000, "audio", 48000, 1, true),
     FormatInfo("gsm", 33, 20000),
     FormatInfo("ilbc20", 38, 20000),
     FormatInfo("ilbc30", 50, 30000),
@@ -90,10 +97,24 @@ static TranslatorCaps s_simpleCaps32k[] = {
 static TranslatorCaps s_resampCaps[] = {
     { s_formats+0, s_formats+3, 2 },
     { s_formats+0, s_formats+6, 2 },
+    { s_formats+0, s_formats+14, 2 },
+    { s_formats+0, s_formats+15, 2 },
     { s_formats+3, s_formats+0, 2 },
     { s_formats+3, s_formats+6, 2 },
+    { s_formats+3, s_formats+14, 2 },
+    { s_formats+3, s_formats+15, 2 },
     { s_formats+6, s_formats+0, 2 },
     { s_formats+6, s_formats+3, 2 },
+    { s_formats+6, s_formats+14, 2 },
+    { s_formats+6, s_formats+15, 2 },
+    { s_formats+14, s_formats+0, 2 },
+    { s_formats+14, s_formats+3, 2 },
+    { s_formats+14, s_formats+6, 2 },
+    { s_formats+14, s_formats+15, 2 },
+    { s_formats+15, s_formats+0, 2 },
+    { s_formats+15, s_formats+3, 2 },
+    { s_formats+15, s_formats+6, 2 },
+    { s_formats+15, s_formats+14, 2 },
     { 0, 0, 0 }
 };
 
@@ -137,6 +158,52 @@ private:
     RefPointer<ThreadedSource> m_source;
 };
 
+#define MEDIA_CLOCK_MAX 64
+#define MEDIA_CLOCK_SLOTS 128
+#define MEDIA_CLOCK_TICK 1000
+
+// Registration of a ThreadedSource on the shared media clock
+class ThreadedSourceClock : public GenObject
+{
+    friend class MediaClockThread;
+public:
+    inline ThreadedSourceClock(ThreadedSource* source, u_int64_t due)
+	: m_source(source), m_due(due)
+	{ }
+    static bool attach(ThreadedSource* source, u_int64_t due);
+    bool step();
+    void finish();
+
+private:
+    RefPointer<ThreadedSource> m_source;
+    u_int64_t m_due;
+};
+
+// Clock thread serving sources from a timing wheel of 1 msec slots
+class MediaClockThread : public Thread, public Mutex
+{
+public:
+    MediaClockThread(unsigned int index);
+    void add(ThreadedSourceClock* entry);
+    inline unsigned int count() const
+	{ return m_count; }
+
+protected:
+    virtual void run();
+    virtual void cleanup();
+
+private:
+    void schedule(ThreadedSourceClock* entry);
+    ObjList m_wheel[MEDIA_CLOCK_SLOTS];
+    u_int64_t m_tick;
+    unsigned int m_count;
+    unsigned int m_index;
+};
+
+static Mutex s_clockMutex(false,"MediaClock");
+static MediaClockThread* s_clocks[MEDIA_CLOCK_MAX];
+static unsigned int s_clockCount = 0;
+
 // slin/alaw/mulaw converter
 class SimpleTranslator : public DataTranslator
 {
@@ -156,6 +223,13 @@ public:
 		m_sFmt >> "*";
 		m_dFmt >> "*";
 	    }
+	    // and of the sample rate suffix, conversion is done sample by sample
+	    int pos = m_sFmt.find('/');
+	    if (pos > 0)
+		m_sFmt = m_sFmt.substr(0,pos);
+	    pos = m_dFmt.find('/');
+	    if (pos > 0)
+		m_dFmt = m_dFmt.substr(0,pos);
 	}
     virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
 	{
@@ -182,65 +256,229 @@ private:
     DataBlock m_buffer;
 };
 
-// slin basic mono resampler
+// Minimum number of filter taps for each output sample
+#define RESAMP_TAPS 16
+// Fractional bits of the filter coefficients
+#define RESAMP_SHIFT 14
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Polyphase filter shared by all resamplers between the same two rates
+class ResampFilter : public GenObject
+{
+public:
+    ResampFilter(int sRate, int dRate);
+    virtual ~ResampFilter()
+	{ delete[] m_coefs; }
+    inline int sRate() const
+	{ return m_sRate; }
+    inline int dRate() const
+	{ return m_dRate; }
+    // Upsampling factor
+    inline unsigned int up() const
+	{ return m_up; }
+    // Downsampling factor
+    inline unsigned int down() const
+	{ return m_down; }
+    // Number of taps in each phase, multiple of 8
+    inline unsigned int taps() const
+	{ return m_taps; }
+    // Coefficients of a phase, in reverse order so they match the input samples
+    inline const short* phase(unsigned int p) const
+	{ return m_coefs + p * m_taps; }
+    static ResampFilter* get(int sRate, int dRate);
+private:
+    int m_sRate, m_dRate;
+    unsigned int m_up, m_down, m_taps;
+    short* m_coefs;
+};
+
+static ObjList s_resampFilters;
+static Mutex s_resampMutex(false,"ResampFilters");
+
+// Zero order modified Bessel function of the first kind for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    x = x * x / 4.0;
+    for (int k = 1; k < 50; k++) {
+	term *= x / ((double)k * k);
+	sum += term;
+	if (term < sum * 1e-12)
+	    break;
+    }
+    return sum;
+}
+
+ResampFilter::ResampFilter(int sRate, int dRate)
+    : m_sRate(sRate), m_dRate(dRate)
+{
+    int a = sRate;
+    int b = dRate;
+    while (b) {
+	int t = a % b;
+	a = b;
+	b = t;
+    }
+    m_up = dRate / a;
+    m_down = sRate / a;
+    unsigned int maxUD = (m_up > m_down) ? m_up : m_down;
+    // keep the transition band constant relative to the lower rate
+    m_taps = (RESAMP_TAPS * maxUD + m_up - 1) / m_up;
+    m_taps = (m_taps + 7) & ~7;
+    unsigned int len = m_taps * m_up;
+    double* h = new double[len];
+    // windowed sinc lowpass at the upsampled rate
+    double fc = 0.45 / maxUD;
+    double center = (len - 1) / 2.0;
+    double beta = 7.0;
+    double i0b = besselI0(beta);
+    for (unsigned int i = 0; i < len; i++) {
+	double t = i - center;
+	double v = 2.0 * fc;
+	if (t != 0.0)
+	    v = ::sin(2.0 * M_PI * fc * t) / (M_PI * t);
+	double r = t / (center + 0.5);
+	h[i] = v * besselI0(beta * ::sqrt(1.0 - r * r)) / i0b;
+    }
+    // split in phases, normalizing each to unity gain
+    m_coefs = new short[len];
+    for (unsigned int p = 0; p < m_up; p++) {
+	double sum = 0;
+	for (unsigned int j = 0; j < m_taps; j++)
+	    sum += h[p + j * m_up];
+	if (sum == 0.0)
+	    sum = 1.0;
+	short* c = m_coefs + p * m_taps;
+	for (unsigned int j = 0; j < m_taps; j++)
+	    c[m_taps - 1 - j] = (short)::floor(h[p + j * m_up] * (1 << RESAMP_SHIFT) / sum + 0.5);
+    }
+    delete[] h;
+    DDebug(DebugInfo,"ResampFilter %d -> %d up=%u down=%u taps=%u [%p]",
+	sRate,dRate,m_up,m_down,m_taps,this);
+}
+
+// Retrieve the filter between two rates, build it if not already done
+ResampFilter* ResampFilter::get(int sRate, int dRate)
+{
+    Lock mylock(s_resampMutex);
+    for (ObjList* l = s_resampFilters.skipNull(); l; l = l->skipNext()) {
+	ResampFilter* f = static_cast<ResampFilter*>(l->get());
+	if (f->sRate() == sRate && f->dRate() == dRate)
+	    return f;
+    }
+    ResampFilter* f = new ResampFilter(sRate,dRate);
+    s_resampFilters.append(f);
+    return f;
+}
+
+// Compute one output sample from taps input samples ending with the last one
+static inline short resampDot(const short* s, const short* c, unsigned int taps)
+{
+    int v = 0;
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+    for (unsigned int i = 0; i < taps; i += 8)
+	acc = _mm_add_epi32(acc,_mm_madd_epi16(
+	    _mm_loadu_si128((const __m128i*)(s + i)),
+	    _mm_loadu_si128((const __m128i*)(c + i))));
+    acc = _mm_add_epi32(acc,_mm_shuffle_epi32(acc,_MM_SHUFFLE(1,0,3,2)));
+    acc = _mm_add_epi32(acc,_mm_shuffle_epi32(acc,_MM_SHUFFLE(2,3,0,1)));
+    v = _mm_cvtsi128_si32(acc);
+#else
+    for (unsigned int i = 0; i < taps; i++)
+	v += (int)s[i] * c[i];
+#endif
+    v = (v + (1 << (RESAMP_SHIFT - 1))) >> RESAMP_SHIFT;
+    // saturate filter result
+    if (v > 32767)
+	v = 32767;
+    if (v < -32767)
+	v = -32767;
+    return (short)v;
+}
+
+// slin polyphase sample rate converter
 class ResampTranslator : public DataTranslator
 {
 private:
     int m_sRate, m_dRate;
-    short m_last;
+    ResampFilter* m_filter;
+    // next output sample: input index relative to the history start and phase
+    unsigned int m_index;
+    unsigned int m_phase;
+    // input history followed by the current block
+    short* m_in;
+    unsigned int m_inSize;
+    short* m_out;
+    unsigned int m_outSize;
 public:
     ResampTranslator(const DataFormat& sFormat, const DataFormat& dFormat)
 	: DataTranslator(sFormat,dFormat),
-	m_sRate(sFormat.sampleRate()), m_dRate(dFormat.sampleRate()), m_last(0)
-	{ }
+	m_sRate(sFormat.sampleRate()), m_dRate(dFormat.sampleRate()),
+	m_filter(0), m_index(0), m_phase(0),
+	m_in(0), m_inSize(0), m_out(0), m_outSize(0)
+	{
+	    if (m_sRate > 0 && m_dRate > 0) {
+		m_filter = ResampFilter::get(m_sRate,m_dRate);
+		m_index = m_filter->taps() - 1;
+	    }
+	}
+    virtual ~ResampTranslator()
+	{
+	    delete[] m_in;
+	    delete[] m_out;
+	}
     virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
 	{
 	    unsigned int n = data.length();
-	    if (!n || (n & 1) || !m_sRate || !m_dRate || !ref())
+	    if (!n || (n & 1) || !m_filter || !ref())
 		return 0;
 	    unsigned long len = 0;
 	    n /= 2;
 	    DataSource* src = getTransSource();
 	    if (src) {
-		long delta = tStamp - m_timestamp;
-		short* s = (short*) data.data();
-		DataBlock oblock;
-		if (m_dRate > m_sRate) {
-		    int mul = m_dRate / m_sRate;
-		    // linear interpolation between existing samples
-		    delta *= mul;
-		    oblock.assign(0,2*n*mul);
-		    short* d = (short*) oblock.data();
-		    while (n--) {
-			short v = *s++;
-			for (int i = 1; i <= mul; i++)
-			    *d++ = ((m_last * (mul - i)) + (v * i)) / mul;
-			m_last = v;
-		    }
+		long delta = (long)(((int64_t)(tStamp - m_timestamp)) * m_dRate / m_sRate);
+		unsigned int hist = m_filter->taps() - 1;
+		unsigned int up = m_filter->up();
+		unsigned int down = m_filter->down();
+		if (hist + n > m_inSize) {
+		    short* in = new short[hist + n];
+		    if (m_in)
+			::memcpy(in,m_in,hist * sizeof(short));
+		    else
+			::memset(in,0,hist * sizeof(short));
+		    delete[] m_in;
+		    m_in = in;
+		    m_inSize = hist + n;
 		}
-		else {
-		    int div = m_sRate / m_dRate;
-		    // average an integer number of samples
-		    delta /= div;
-		    n /= div;
-		    oblock.assign(0,2*n);
-		    short* d = (short*) oblock.data();
-		    while (n--) {
-			int v = 0;
-			for (int i = 0; i < div; i++)
-			    v += *s++;
-			v /= div;
-			// saturate average result
-			if (v > 32767)
-			    v = 32767;
-			if (v < -32767)
-			    v = -32767;
-			*d++ = v;
-		    }
+		::memcpy(m_in + hist,data.data(),n * sizeof(short));
+		unsigned int total = hist + n;
+		unsigned int oLen = (unsigned int)(((uint64_t)n * up) / down + 2);
+		if (oLen > m_outSize) {
+		    delete[] m_out;
+		    m_out = new short[oLen];
+		    m_outSize = oLen;
+		}
+		short* d = m_out;
+		while (m_index < total) {
+		    *d++ = resampDot(m_in + m_index - hist,m_filter->phase(m_phase),m_filter->taps());
+		    m_phase += down;
+		    m_index += m_phase / up;
+		    m_phase %= up;
 		}
+		// keep the last input samples as history for the next block
+		::memmove(m_in,m_in + n,hist * sizeof(short));
+		m_index -= n;
+		oLen = d - m_out;
 		if (src->timeStamp() != invalidStamp())
 		    delta += src->timeStamp();
+		DataBlock oblock(m_out,oLen * sizeof(short),false);
 		len = src->Forward(oblock, delta, flags);
+		oblock.clear(false);
 	    }
 	    deref();
 	    return len;
@@ -1077,16 +1315,203 @@ bool DataEndpoint::control(NamedList& params)
 }
 
 
+// Schedule a source on the least loaded clock thread
+bool ThreadedSourceClock::attach(ThreadedSource* source, u_int64_t due)
+{
+    Lock lck(s_clockMutex);
+    MediaClockThread* clk = 0;
+    for (unsigned int i = 0; i < s_clockCount; i++) {
+	if (s_clocks[i] && (!clk || (s_clocks[i]->count() < clk->count())))
+	    clk = s_clocks[i];
+    }
+    if (!clk)
+	return false;
+    Lock mylock(source);
+    if (source->m_clock || source->m_thread)
+	return true;
+    ThreadedSourceClock* entry = new ThreadedSourceClock(source,due);
+    source->m_clock = entry;
+    mylock.drop();
+    clk->add(entry);
+    return true;
+}
+
+// Produce one frame, return false if the source stopped
+bool ThreadedSourceClock::step()
+{
+    ThreadedSource* source = m_source;
+    if (!source)
+	return false;
+    source->lock();
+    bool ok = (source->m_clock == this);
+    source->unlock();
+    if (ok) {
+	u_int64_t next = source->frame(m_due);
+	if (next) {
+	    m_due = next;
+	    return true;
+	}
+    }
+    finish();
+    return false;
+}
+
+// Release the source, run its cleanup unless it was restarted meanwhile
+void ThreadedSourceClock::finish()
+{
+    RefPointer<ThreadedSource> source = m_source;
+    m_source = 0;
+    if (!source)
+	return;
+    source->lock();
+    bool cleanup = !source->m_clock || (source->m_clock == this);
+    source->unlock();
+    if (cleanup)
+	source->cleanup();
+}
+
+
+MediaClockThread::MediaClockThread(unsigned int index)
+    : Thread("Media Clock"), Mutex(false,"MediaClockThread"),
+      m_tick(Time::now() / MEDIA_CLOCK_TICK), m_count(0), m_index(index)
+{
+}
+
+void MediaClockThread::add(ThreadedSourceClock* entry)
+{
+    Lock mylock(this);
+    m_count++;
+    schedule(entry);
+}
+
+// Put an entry in the slot of its due time, must be called with the lock held
+void MediaClockThread::schedule(ThreadedSourceClock* entry)
+{
+    u_int64_t tick = entry->m_due / MEDIA_CLOCK_TICK;
+    if (tick < m_tick)
+	tick = m_tick;
+    m_wheel[tick % MEDIA_CLOCK_SLOTS].insert(entry);
+}
+
+void MediaClockThread::run()
+{
+    DDebug(DebugAll,"MediaClockThread %u started [%p]",m_index,this);
+    ObjList due;
+    while (!Thread::check(false)) {
+	u_int64_t now = Time::now();
+	u_int64_t tick = now / MEDIA_CLOCK_TICK;
+	lock();
+	// visit the slots elapsed since last pass, the whole wheel at most once
+	u_int64_t t = m_tick;
+	if (tick >= t + MEDIA_CLOCK_SLOTS)
+	    t = tick + 1 - MEDIA_CLOCK_SLOTS;
+	ObjList* tail = &due;
+	for (; t <= tick; t++) {
+	    ObjList* l = m_wheel[t % MEDIA_CLOCK_SLOTS].skipNull();
+	    while (l) {
+		ThreadedSourceClock* entry = static_cast<ThreadedSourceClock*>(l->get());
+		if (entry->m_due <= now) {
+		    l->remove(false);
+		    tail = tail->append(entry);
+		    l = l->skipNull();
+		}
+		else
+		    l = l->skipNext();
+	    }
+	}
+	m_tick = tick + 1;
+	unlock();
+	while (ThreadedSourceClock* entry = static_cast<ThreadedSourceClock*>(due.remove(false))) {
+	    bool keep = entry->step();
+	    lock();
+	    if (keep)
+		schedule(entry);
+	    else
+		m_count--;
+	    unlock();
+	    if (!keep)
+		TelEngine::destruct(entry);
+	}
+	now = Time::now();
+	Thread::usleep(MEDIA_CLOCK_TICK - (unsigned long)(now % MEDIA_CLOCK_TICK));
+    }
+}
+
+void MediaClockThread::cleanup()
+{
+    s_clockMutex.lock();
+    if (s_clocks[m_index] == this)
+	s_clocks[m_index] = 0;
+    s_clockMutex.unlock();
+    ObjList entries;
+    lock();
+    for (unsigned int i = 0; i < MEDIA_CLOCK_SLOTS; i++) {
+	while (GenObject* entry = m_wheel[i].remove(false))
+	    entries.append(entry);
+    }
+    m_count = 0;
+    unlock();
+    DDebug(DebugAll,"MediaClockThread %u stopping with %u sources [%p]",
+	m_index,entries.count(),this);
+    for (ObjList* l = entries.skipNull(); l; l = l->skipNext())
+	static_cast<ThreadedSourceClock*>(l->get())->finish();
+}
+
+
 void ThreadedSource::destroyed()
 {
     if (m_thread)
 	Debug(DebugFail,"ThreadedSource destroyed holding thread %p [%p]",m_thread,this);
+    if (m_clock)
+	Debug(DebugFail,"ThreadedSource destroyed holding clock %p [%p]",m_clock,this);
     DataSource::destroyed();
 }
 
+void ThreadedSource::setClock(unsigned int count)
+{
+    if (count > MEDIA_CLOCK_MAX)
+	count = MEDIA_CLOCK_MAX;
+    Lock mylock(s_clockMutex);
+    for (unsigned int i = 0; i < count; i++) {
+	if (s_clocks[i])
+	    continue;
+	MediaClockThread* clk = new MediaClockThread(i);
+	if (clk->startup()) {
+	    s_clocks[i] = clk;
+	    continue;
+	}
+	delete clk;
+	Debug(DebugWarn,"Failed to start media clock thread %u",i);
+	count = i;
+	break;
+    }
+    if (count != s_clockCount)
+	Debug(DebugInfo,"Media clock using %u threads",count);
+    s_clockCount = count;
+}
+
+unsigned int ThreadedSource::clocked()
+{
+    unsigned int n = 0;
+    Lock mylock(s_clockMutex);
+    for (unsigned int i = 0; i < MEDIA_CLOCK_MAX; i++) {
+	if (s_clocks[i])
+	    n += s_clocks[i]->count();
+    }
+    return n;
+}
+
 bool ThreadedSource::start(const char* name, Thread::Priority prio)
 {
+    if (s_clockCount && !running()) {
+	// sources that implement frame() may run on the shared media clock
+	u_int64_t due = frame(0);
+	if (due && ThreadedSourceClock::attach(this,due))
+	    return true;
+    }
     Lock mylock(this);
+    if (m_clock)
+	return true;
     if (!m_thread) {
 	ThreadedSourcePrivate* thread = new ThreadedSourcePrivate(this,name,prio);
 	if (thread->startup()) {
@@ -1102,6 +1527,8 @@ bool ThreadedSource::start(const char* name, Thread::Priority prio)
 void ThreadedSource::stop()
 {
     Lock mylock(this);
+    // a clocked source is released by its clock thread on the next frame
+    m_clock = 0;
     ThreadedSourcePrivate* tmp = m_thread;
     m_thread = 0;
     if (!tmp || tmp->running())
@@ -1115,6 +1542,7 @@ void ThreadedSource::cleanup()
 {
     lock();
     m_thread = 0;
+    m_clock = 0;
     unlock();
 }
 
@@ -1126,7 +1554,12 @@ Thread* ThreadedSource::thread() const
 bool ThreadedSource::running() const
 {
     Lock mylock(const_cast<ThreadedSource*>(this));
-    return m_thread && m_thread->running();
+    return m_clock || (m_thread && m_thread->running());
+}
+
+u_int64_t ThreadedSource::frame(u_int64_t when)
+{
+    return 0;
 }
 
 bool ThreadedSource::looping(bool runConsumers) const
@@ -1134,6 +1567,8 @@ bool ThreadedSource::looping(bool runConsumers) const
     Lock mylock(const_cast<ThreadedSource*>(this));
     if ((refcount() <= 1) && !(runConsumers && alive() && m_consumers.count()))
 	return false;
+    if (m_clock)
+	return !Engine::exiting();
     return m_thread && !m_thread->check(false) &&
 	m_thread->isCurrent() && !Engine::exiting();
 }
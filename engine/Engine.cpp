@@ -18,6 +18,7 @@
  */
 
 #include "yatengine.h"
+#include "yatephone.h"
 #include "yateversn.h"
 
 #ifdef _WINDOWS
@@ -91,12 +92,15 @@ class EnginePrivate : public Thread
 {
 public:
     EnginePrivate()
-	: Thread("Engine Worker")
+	: Thread("Engine Worker"), m_queue(index++)
 	{ count++; }
     ~EnginePrivate()
 	{ count--; }
     virtual void run();
     static int count;
+private:
+    unsigned int m_queue;
+    static unsigned int index;
 };
 
 class EngineCommand : public MessageHandler
@@ -288,6 +292,7 @@ Engine* Engine::s_self = 0;
 bool Engine::s_started = false;
 int Engine::s_haltcode = -1;
 int EnginePrivate::count = 0;
+unsigned int EnginePrivate::index = 0;
 static String s_cfgpath(CFG_PATH);
 static String s_usrpath;
 static String s_affinity;
@@ -581,6 +586,7 @@ bool EngineStatusHandler::received(Message &msg)
     uint64_t enq,deq,disp,qmax;
     Engine::self()->getStats(enq,deq,disp,qmax);
     msg.retValue() << ",messages=" << (enq - deq) << ",maxqueue=" << qmax;
+    msg.retValue() << ",msgqueues=" << Engine::self()->messageQueues();
     msg.retValue() << ",messageage=" << Engine::self()->messageAge();
     msg.retValue() << ",messagerate=" << Engine::self()->messageRate();
     msg.retValue() << ",maxmsgrate=" << Engine::self()->messageMaxRate();
@@ -602,6 +608,13 @@ bool EngineStatusHandler::received(Message &msg)
 	msg.retValue() << ",waiting=" << locks;
     msg.retValue() << ",acceptcalls=" << lookup(Engine::accept(),Engine::getCallAcceptStates());
     msg.retValue() << ",congestion=" << Engine::getCongestion();
+    u_int64_t hits, misses;
+    unsigned int cached;
+    if (DataBlock::poolStats(hits,misses,cached))
+	msg.retValue() << ",poolhits=" << hits << ",poolmisses=" << misses << ",poolcached=" << cached;
+    cached = ThreadedSource::clocked();
+    if (cached)
+	msg.retValue() << ",clocked=" << cached;
     if (msg.getBoolValue("reset",false))
 	Engine::self()->resetMax();
     if (details) {
@@ -1023,7 +1036,7 @@ void EnginePrivate::run()
 	Semaphore* s = s_semWorkers;
 	if (s && Engine::self()->m_dispatcher.hasMessages())
 	    s->unlock();
-	Engine::self()->m_dispatcher.dequeue();
+	Engine::self()->m_dispatcher.dequeue(m_queue);
 	s = s_semWorkers;
 	if (s) {
 	    s->lock(WORKER_SLEEP);
@@ -1671,10 +1684,15 @@ int Engine::engineInit()
     s_minworkers = s_cfg.getIntValue("general","minworkers",s_minworkers,1,500);
     s_maxworkers = s_cfg.getIntValue("general","maxworkers",s_maxworkers,s_minworkers,1000);
     s_addworkers = s_cfg.getIntValue("general","addworkers",s_addworkers,1,10);
+    m_dispatcher.setQueues(s_cfg.getIntValue("general","msgqueues",1,1,64),
+	s_cfg.getValue("general","queueaffinity"));
     s_maxmsgrate = s_cfg.getIntValue("general","maxmsgrate",s_maxmsgrate,0,50000);
     s_maxmsgage = s_cfg.getIntValue("general","maxmsgage",s_maxmsgage,0,5000);
     s_maxqueued = s_cfg.getIntValue("general","maxqueued",s_maxqueued,0,10000);
     s_maxevents = s_cfg.getIntValue("general","maxevents",s_maxevents,0,1000);
+    if (s_cfg.getBoolValue("general","datapool"))
+	DataBlock::setPool(true,s_cfg.getIntValue("general","datapoolmax",64,1,4096));
+    ThreadedSource::setClock(s_cfg.getIntValue("general","mediaclock",0,0,64));
     s_restarts = s_cfg.getIntValue("general","restarts");
     s_timejump = s_cfg.getIntValue("general","timejump",0,0,MAX_TIME_JUMP);
     if (s_timejump && (s_timejump < MIN_TIME_JUMP))
@@ -1713,6 +1731,7 @@ int Engine::engineInit()
     s_params.addParam("minworkers",String(s_minworkers));
     s_params.addParam("maxworkers",String(s_maxworkers));
     s_params.addParam("addworkers",String(s_addworkers));
+    s_params.addParam("msgqueues",String(messageQueues()));
     s_params.addParam("maxmsgrate",String(s_maxmsgrate));
     s_params.addParam("maxmsgage",String(s_maxmsgage));
     s_params.addParam("maxqueued",String(s_maxqueued));
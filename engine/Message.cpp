@@ -35,6 +35,77 @@ private:
     RefPointer<MessageQueue> m_queue;
 };
 
+namespace TelEngine {
+
+// One of the waiting message queues of a dispatcher
+class DispatcherQueue
+{
+public:
+    inline DispatcherQueue()
+	: m_lock(false,"DispatcherMsgs"), m_append(&m_messages),
+	  m_enqueued(0), m_dequeued(0), m_avgAge(0)
+	{ }
+    Mutex m_lock;
+    ObjList m_messages;
+    ObjList* m_append;
+    u_int64_t m_enqueued;
+    u_int64_t m_dequeued;
+    u_int64_t m_avgAge;
+};
+
+};
+
+// Priority sorted list of handlers installed for the same message name
+// The list does not own the handlers, they belong to the dispatcher
+class HandlerChain : public String
+{
+public:
+    inline HandlerChain(const String& name)
+	: String(name)
+	{ m_handlers.setDelete(false); }
+    inline ObjList& handlers()
+	{ return m_handlers; }
+private:
+    ObjList m_handlers;
+};
+
+// Insert a handler in a list sorted by priority then by address
+static ObjList* insertHandler(ObjList& list, MessageHandler* handler)
+{
+    unsigned p = handler->priority();
+    int pos = 0;
+    ObjList* l = &list;
+    for (; l; l=l->next(),pos++) {
+	MessageHandler *h = static_cast<MessageHandler *>(l->get());
+	if (!h)
+	    continue;
+	if (h->priority() < p)
+	    continue;
+	if (h->priority() > p)
+	    break;
+	// at the same priority we sort them in pointer address order
+	if (h > handler)
+	    break;
+    }
+    if (l) {
+	XDebug(DebugAll,"Inserting handler [%p] on place #%d",handler,pos);
+	return l->insert(handler);
+    }
+    XDebug(DebugAll,"Appending handler [%p] on place #%d",handler,pos);
+    return list.append(handler);
+}
+
+// Skip handlers in a sorted list up to and including a given one
+static inline ObjList* skipHandlers(ObjList* l, unsigned int p, const MessageHandler* h)
+{
+    for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	const MessageHandler* mh = static_cast<const MessageHandler*>(l->get());
+	if ((mh->priority() > p) || ((mh->priority() == p) && (mh > h)))
+	    break;
+    }
+    return l;
+}
+
 Message::Message(const char* name, const char* retval, bool broadcast)
     : NamedList(name),
       m_return(retval), m_timeEnqueue((uint64_t)0), m_timeDispatch((uint64_t)0),
@@ -318,12 +389,12 @@ bool MessageRelay::receivedInternal(Message& msg)
 
 
 MessageDispatcher::MessageDispatcher(const char* trackParam)
-    : m_handlersLock("DispatcherHandlers"), m_messagesLock("DispatcherMsgs"), 
-      m_hooksLock("DispatcherHooks"),
-      m_msgAppend(&m_messages), m_hookAppend(&m_hooks),
+    : m_handlersByName(127),
+      m_queues(new DispatcherQueue[1]), m_queueCount(1), m_queueAffinity(0),
+      m_handlersLock("DispatcherHandlers"), m_hooksLock("DispatcherHooks"),
+      m_hookAppend(&m_hooks),
       m_trackParam(trackParam), m_changes(0), m_warnTime(0),
-      m_enqueueCount(0), m_dequeueCount(0), m_dispatchCount(0),
-      m_queuedMax(0), m_msgAvgAge(0),
+      m_dispatchCount(0), m_queuedMax(0),
       m_traceTime(false), m_traceHandlerTime(false),
       m_hookCount(0), m_hookHole(false)
 {
@@ -334,11 +405,15 @@ MessageDispatcher::~MessageDispatcher()
 {
     XDebug(DebugInfo,"MessageDispatcher::~MessageDispatcher() [%p]",this);
     clear();
+    delete[] m_queues;
+    TelEngine::destruct(m_queueAffinity);
 }
 
 void MessageDispatcher::clear()
 {
     WLock lck(m_handlersLock);
+    m_handlersByName.clear();
+    m_handlersAny.clear();
     m_handlers.clear();
     lck.acquire(m_hooksLock);
     m_hookAppend = &m_hooks;
@@ -351,32 +426,20 @@ bool MessageDispatcher::install(MessageHandler* handler)
     if (!handler)
 	return false;
     WLock lck(m_handlersLock);
-    ObjList *l = m_handlers.find(handler);
-    if (l)
+    if (m_handlers.find(handler))
 	return false;
-    unsigned p = handler->priority();
-    int pos = 0;
-    for (l=&m_handlers; l; l=l->next(),pos++) {
-	MessageHandler *h = static_cast<MessageHandler *>(l->get());
-	if (!h)
-	    continue;
-	if (h->priority() < p)
-	    continue;
-	if (h->priority() > p)
-	    break;
-	// at the same priority we sort them in pointer address order
-	if (h > handler)
-	    break;
-    }
     m_changes++;
-    if (l) {
-	XDebug(DebugAll,"Inserting handler [%p] on place #%d",handler,pos);
-	l->insert(handler);
-    }
-    else {
-	XDebug(DebugAll,"Appending handler [%p] on place #%d",handler,pos);
-	m_handlers.append(handler);
+    insertHandler(m_handlers,handler);
+    ObjList* chain = &m_handlersAny;
+    if (!handler->null()) {
+	HandlerChain* hc = static_cast<HandlerChain*>(m_handlersByName[*handler]);
+	if (!hc) {
+	    hc = new HandlerChain(*handler);
+	    m_handlersByName.append(hc);
+	}
+	chain = &hc->handlers();
     }
+    insertHandler(*chain,handler)->setDelete(false);
     handler->m_dispatcher = this;
     if (handler->null())
 	Debug(DebugInfo,"Registered broadcast message handler %p",handler);
@@ -390,6 +453,16 @@ bool MessageDispatcher::uninstall(MessageHandler* handler)
     handler = static_cast<MessageHandler *>(m_handlers.remove(handler,false));
     if (handler) {
 	m_changes++;
+	if (handler->null())
+	    m_handlersAny.remove(handler,false);
+	else {
+	    HandlerChain* hc = static_cast<HandlerChain*>(m_handlersByName[*handler]);
+	    if (hc) {
+		hc->handlers().remove(handler,false);
+		if (!hc->handlers().skipNull())
+		    m_handlersByName.remove(hc);
+	    }
+	}
 	if (handler->m_unsafe > 0) {
 	    DDebug(DebugNote,"Waiting for unsafe MessageHandler %p '%s'",
 		handler,handler->c_str());
@@ -428,95 +501,89 @@ bool MessageDispatcher::dispatch(Message& msg)
     String hTrackName;
     unsigned int hTrackPos = 0;
     bool hTrackTime = m_traceHandlerTime;
-    ObjList *l = &m_handlers;
     RLock lck(m_handlersLock);
     m_dispatchCount++;
-    for (; l; l=l->next()) {
-	MessageHandler *h = static_cast<MessageHandler*>(l->get());
-	if (h && (h->null() || *h == msg)) {
-	    if (h->filter() && !h->filter()->matchListParam(msg))
-		continue;
-	    if (counting)
-		Thread::setCurrentObjCounter(h->objectsCounter());
-
-	    unsigned int c = m_changes;
-	    unsigned int p = h->priority();
-	    if (trackParam() && h->trackName()) {
-		NamedString* tracked = msg.getParam(trackParam());
-		if (tracked)
-		    tracked->append(h->trackName(),",");
-		else
-		    msg.addParam(trackParam(),h->trackName());
-		if (hTrackTime) {
-		    hTrackName = h->trackName();
-		    hTrackPos = tracked ? tracked->length() : hTrackName.length();
-		}
+    // merge the handlers installed for this message name with the broadcast ones
+    HandlerChain* hc = static_cast<HandlerChain*>(m_handlersByName[msg]);
+    ObjList* ln = hc ? hc->handlers().skipNull() : 0;
+    ObjList* la = m_handlersAny.skipNull();
+    while (ln || la) {
+	MessageHandler* h = 0;
+	MessageHandler* hn = ln ? static_cast<MessageHandler*>(ln->get()) : 0;
+	MessageHandler* ha = la ? static_cast<MessageHandler*>(la->get()) : 0;
+	if (hn && (!ha || (hn->priority() < ha->priority())
+		|| ((hn->priority() == ha->priority()) && (hn < ha)))) {
+	    h = hn;
+	    ln = ln->skipNext();
+	}
+	else {
+	    h = ha;
+	    la = la->skipNext();
+	}
+	if (h->filter() && !h->filter()->matchListParam(msg))
+	    continue;
+	if (counting)
+	    Thread::setCurrentObjCounter(h->objectsCounter());
+
+	unsigned int c = m_changes;
+	unsigned int p = h->priority();
+	if (trackParam() && h->trackName()) {
+	    NamedString* tracked = msg.getParam(trackParam());
+	    if (tracked)
+		tracked->append(h->trackName(),",");
+	    else
+		msg.addParam(trackParam(),h->trackName());
+	    if (hTrackTime) {
+		hTrackName = h->trackName();
+		hTrackPos = tracked ? tracked->length() : hTrackName.length();
 	    }
-	    // mark handler as unsafe to destroy / uninstall
-	    h->m_unsafe++;
-	    lck.drop();
+	}
+	// mark handler as unsafe to destroy / uninstall
+	h->m_unsafe++;
+	lck.drop();
 
-	    u_int64_t tm = (m_warnTime || hTrackTime) ? Time::now() : 0;
+	u_int64_t tm = (m_warnTime || hTrackTime) ? Time::now() : 0;
 
-	    retv = h->receivedInternal(msg) || retv;
+	retv = h->receivedInternal(msg) || retv;
 
-	    if (tm) {
-		tm = Time::now() - tm;
-		if (m_warnTime && tm > m_warnTime) {
-		    lck.acquire(m_handlersLock);
-		    const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
-		    Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
-			msg.c_str(),&msg,h,
-			(name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
-		}
-		if (hTrackTime && hTrackName) {
-		    NamedString* tracked = msg.getParam(trackParam());
-		    unsigned int start = hTrackPos - hTrackName.length();
-		    if (tracked && start < tracked->length()) {
-			if (0 == ::strncmp(tracked->c_str() + start,hTrackName.c_str(),hTrackName.length())) {
-			    String buf;
-			    buf.printf("#%u.%03u",(unsigned int)(tm / 1000),
-				(unsigned int)(tm % 1000));
-			    char c = (*tracked)[hTrackPos];
-			    if (!c)
-				*tracked << buf;
-			    else if (',' == c) // Message re-dispatched. New handler name added
-				tracked->insert(hTrackPos,buf,buf.length());
-			}
-		    }
-		}
+	if (tm) {
+	    tm = Time::now() - tm;
+	    if (m_warnTime && tm > m_warnTime) {
+		lck.acquire(m_handlersLock);
+		const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
+		Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
+		    msg.c_str(),&msg,h,
+		    (name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
 	    }
-
-	    if (retv && !msg.broadcast())
-		break;
-	    lck.acquire(m_handlersLock);
-	    if (c == m_changes)
-		continue;
-	    // the handler list has changed - find again
-	    NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
-		msg.c_str(),&msg,p);
-	    ObjList* l2 = &m_handlers;
-	    for (l = l2; l; l=l->next()) {
-		MessageHandler *mh = static_cast<MessageHandler*>(l->get());
-		if (!mh)
-		    continue;
-		if (mh == h)
-		    // exact match - silently continue where we left
-		    break;
-
-		// gone past last handler priority - exit with last handler
-		if ((mh->priority() > p) || ((mh->priority() == p) && (mh > h))) {
-		    Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
-			msg.c_str(),&msg,h,p,mh,mh->priority());
-		    // l will advance in the outer for loop so use previous
-		    l = l2;
-		    break;
+	    if (hTrackTime && hTrackName) {
+		NamedString* tracked = msg.getParam(trackParam());
+		unsigned int start = hTrackPos - hTrackName.length();
+		if (tracked && start < tracked->length()) {
+		    if (0 == ::strncmp(tracked->c_str() + start,hTrackName.c_str(),hTrackName.length())) {
+			String buf;
+			buf.printf("#%u.%03u",(unsigned int)(tm / 1000),
+			    (unsigned int)(tm % 1000));
+			char c = (*tracked)[hTrackPos];
+			if (!c)
+			    *tracked << buf;
+			else if (',' == c) // Message re-dispatched. New handler name added
+			    tracked->insert(hTrackPos,buf,buf.length());
+		    }
 		}
-		l2 = l;
 	    }
-	    if (!l)
-		break;
 	}
+
+	if (retv && !msg.broadcast())
+	    break;
+	lck.acquire(m_handlersLock);
+	if (c == m_changes)
+	    continue;
+	// the handler list has changed - find again
+	NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
+	    msg.c_str(),&msg,p);
+	hc = static_cast<HandlerChain*>(m_handlersByName[msg]);
+	ln = skipHandlers(hc ? &hc->handlers() : 0,p,h);
+	la = skipHandlers(&m_handlersAny,p,h);
     }
     lck.drop();
     if (counting)
@@ -544,7 +611,7 @@ bool MessageDispatcher::dispatch(Message& msg)
     lck.acquire(m_hooksLock);
     if (m_hookHole && !m_hookCount) {
 	// compact the list, remove the holes
-	for (l = &m_hooks; l; l = l->next()) {
+	for (ObjList* l = &m_hooks; l; l = l->next()) {
 	    while (!l->get()) {
 		if (!l->next())
 		    break;
@@ -556,7 +623,7 @@ bool MessageDispatcher::dispatch(Message& msg)
 	m_hookHole = false;
     }
     m_hookCount++;
-    for (l = m_hooks.skipNull(); l; l = l->skipNext()) {
+    for (ObjList* l = m_hooks.skipNull(); l; l = l->skipNext()) {
 	RefPointer<MessagePostHook> ph = static_cast<MessagePostHook*>(l->get());
 	if (ph) {
 	    lck.drop();
@@ -575,48 +642,162 @@ bool MessageDispatcher::dispatch(Message& msg)
     return retv;
 }
 
+// Select the waiting queue of a message
+static unsigned int queueIndex(const Message* msg, unsigned int count, const ObjList* affinity)
+{
+    if (count < 2)
+	return 0;
+    for (const ObjList* o = affinity ? affinity->skipNull() : 0; o; o = o->skipNext()) {
+	const String* val = msg->getParam(o->get()->toString());
+	if (!TelEngine::null(val))
+	    return val->hash() % count;
+    }
+    // unrelated messages are spread by address, this also keeps the
+    //  duplicate check in enqueue() valid as a message always maps to one queue
+    return (unsigned int)(((unsigned long)msg) >> 4) % count;
+}
+
 bool MessageDispatcher::enqueue(Message* msg)
 {
-    WLock lck(m_messagesLock);
-    if (!msg || m_messages.find(msg))
+    if (!msg)
+	return false;
+    DispatcherQueue& q = m_queues[queueIndex(msg,m_queueCount,m_queueAffinity)];
+    Lock lck(q.m_lock);
+    if (q.m_messages.find(msg))
 	return false;
     if (m_traceTime)
 	msg->m_timeEnqueue = Time::now();
-    m_msgAppend = m_msgAppend->append(msg);
-    u_int64_t count = (++m_enqueueCount) - m_dequeueCount;
+    q.m_append = q.m_append->append(msg);
+    q.m_enqueued++;
+    lck.drop();
+    // the high watermark is not exact when using multiple queues
+    u_int64_t count = 0;
+    for (unsigned int i = 0; i < m_queueCount; i++)
+	count += m_queues[i].m_enqueued - m_queues[i].m_dequeued;
     if (m_queuedMax < count)
 	m_queuedMax = count;
     return true;
 }
 
-bool MessageDispatcher::dequeueOne()
+bool MessageDispatcher::dequeueOne(unsigned int queue)
 {
-    WLock lck(m_messagesLock);
-    if (m_messages.next() == m_msgAppend)
-	m_msgAppend = &m_messages;
-    Message* msg = static_cast<Message *>(m_messages.remove(false));
-    if (!msg)
-	return false;
-    m_dequeueCount++;
-    uint64_t age = Time::now() - msg->msgTime();
-    if (age < 60000000)
-	m_msgAvgAge = (3 * m_msgAvgAge + age) >> 2;
-    lck.drop();
-    dispatch(*msg);
-    msg->destruct();
-    return true;
+    for (unsigned int i = 0; i < m_queueCount; i++) {
+	DispatcherQueue& q = m_queues[(queue + i) % m_queueCount];
+	if (!(q.m_messages.get() || q.m_messages.next()))
+	    continue;
+	Lock lck(q.m_lock);
+	if (q.m_messages.next() == q.m_append)
+	    q.m_append = &q.m_messages;
+	Message* msg = static_cast<Message *>(q.m_messages.remove(false));
+	if (!msg)
+	    continue;
+	q.m_dequeued++;
+	uint64_t age = Time::now() - msg->msgTime();
+	if (age < 60000000)
+	    q.m_avgAge = (3 * q.m_avgAge + age) >> 2;
+	lck.drop();
+	dispatch(*msg);
+	msg->destruct();
+	return true;
+    }
+    return false;
 }
 
-void MessageDispatcher::dequeue()
+void MessageDispatcher::dequeue(unsigned int queue)
 {
-    while (dequeueOne())
+    while (dequeueOne(queue))
 	;
 }
 
+void MessageDispatcher::setQueues(unsigned int count, const String& affinity)
+{
+    if (count < 1)
+	count = 1;
+    ObjList* aff = affinity.split(',',false);
+    for (ObjList* o = aff->skipNull(); o; o = o->skipNext())
+	static_cast<String*>(o->get())->trimBlanks();
+    if (!aff->skipNull())
+	TelEngine::destruct(aff);
+    DispatcherQueue* queues = m_queues;
+    if (count != m_queueCount) {
+	// move waiting messages, keep the total counters
+	queues = new DispatcherQueue[count];
+	for (unsigned int i = 0; i < m_queueCount; i++) {
+	    DispatcherQueue& q = m_queues[i];
+	    Lock lck(q.m_lock);
+	    u_int64_t moved = 0;
+	    for (;;) {
+		Message* msg = static_cast<Message*>(q.m_messages.remove(false));
+		if (!msg)
+		    break;
+		DispatcherQueue& n = queues[queueIndex(msg,count,aff)];
+		n.m_append = n.m_append->append(msg);
+		n.m_enqueued++;
+		moved++;
+	    }
+	    q.m_append = &q.m_messages;
+	    queues[0].m_enqueued += q.m_enqueued - moved;
+	    queues[0].m_dequeued += q.m_dequeued;
+	}
+    }
+    ObjList* tmp = m_queueAffinity;
+    m_queueAffinity = aff;
+    TelEngine::destruct(tmp);
+    if (queues != m_queues) {
+	DispatcherQueue* old = m_queues;
+	m_queues = queues;
+	m_queueCount = count;
+	delete[] old;
+    }
+    Debug(DebugInfo,"Dispatcher using %u message queue(s)%s%s [%p]",
+	m_queueCount,(m_queueAffinity ? " with affinity " : ""),
+	(m_queueAffinity ? affinity.c_str() : ""),this);
+}
+
+bool MessageDispatcher::hasMessages() const
+{
+    for (unsigned int i = 0; i < m_queueCount; i++) {
+	const ObjList& l = m_queues[i].m_messages;
+	if (l.get() || l.next())
+	    return true;
+    }
+    return false;
+}
+
 unsigned int MessageDispatcher::messageCount()
 {
-    RLock lck(m_messagesLock);
-    return (unsigned int)(m_enqueueCount - m_dequeueCount);
+    u_int64_t count = 0;
+    for (unsigned int i = 0; i < m_queueCount; i++) {
+	DispatcherQueue& q = m_queues[i];
+	Lock lck(q.m_lock);
+	count += q.m_enqueued - q.m_dequeued;
+    }
+    return (unsigned int)count;
+}
+
+u_int64_t MessageDispatcher::enqueueCount() const
+{
+    u_int64_t count = 0;
+    for (unsigned int i = 0; i < m_queueCount; i++)
+	count += m_queues[i].m_enqueued;
+    return count;
+}
+
+u_int64_t MessageDispatcher::dequeueCount() const
+{
+    u_int64_t count = 0;
+    for (unsigned int i = 0; i < m_queueCount; i++)
+	count += m_queues[i].m_dequeued;
+    return count;
+}
+
+u_int64_t MessageDispatcher::messageAge(bool usec) const
+{
+    u_int64_t age = 0;
+    for (unsigned int i = 0; i < m_queueCount; i++)
+	age += m_queues[i].m_avgAge;
+    age /= m_queueCount;
+    return usec ? age : ((age + 500) / 1000);
 }
 
 unsigned int MessageDispatcher::handlerCount()
@@ -633,11 +814,15 @@ unsigned int MessageDispatcher::postHookCount()
 
 void MessageDispatcher::getStats(u_int64_t& enqueued, u_int64_t& dequeued, u_int64_t& dispatched, u_int64_t& queueMax)
 {
-    RLock lck(m_messagesLock);
-    enqueued = m_enqueueCount;
-    dequeued = m_dequeueCount;
+    enqueued = dequeued = 0;
+    for (unsigned int i = 0; i < m_queueCount; i++) {
+	DispatcherQueue& q = m_queues[i];
+	Lock lck(q.m_lock);
+	enqueued += q.m_enqueued;
+	dequeued += q.m_dequeued;
+    }
     queueMax = m_queuedMax;
-    lck.acquire(m_handlersLock);
+    RLock lck(m_handlersLock);
     dispatched = m_dispatchCount;
 }
 
@@ -20,9 +20,153 @@
 #include "yateclass.h"
 #include "yatexml.h"
 
+#include <string.h>
+
+// Parameters scanned by a lookup before building a name index
+#define INDEX_THRESHOLD 16
+
+namespace TelEngine {
+
+// Open addressing table of the first parameter holding each name
+class NamedListIndex
+{
+public:
+    NamedListIndex(unsigned int count);
+    inline ~NamedListIndex()
+	{ delete[] m_table; }
+    bool stale() const;
+    void setStale();
+    NamedString* find(const String& name) const;
+    bool add(NamedString* param);
+    void replace(NamedString* oldParam, NamedString* newParam);
+    void remove(NamedString* param);
+private:
+    NamedString** m_table;
+    unsigned int m_mask;
+    unsigned int m_used;
+    volatile bool m_stale;
+};
+
+}; // namespace TelEngine
+
 using namespace TelEngine;
 
 static const NamedList s_empty("");
+// Serializes lazy index creation from const lookups
+static Mutex s_indexMutex(false,"NamedListIndex");
+
+// Publish a fully built index to lock free readers
+static inline void storeIndex(NamedListIndex*& slot, NamedListIndex* index)
+{
+#ifdef __ATOMIC_RELEASE
+    __atomic_store_n(&slot,index,__ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+    slot = index;
+#endif
+}
+
+static inline NamedListIndex* loadIndex(NamedListIndex* const& slot)
+{
+#ifdef __ATOMIC_ACQUIRE
+    return __atomic_load_n(&slot,__ATOMIC_ACQUIRE);
+#else
+    NamedListIndex* index = *const_cast<NamedListIndex* const volatile*>(&slot);
+    __sync_synchronize();
+    return index;
+#endif
+}
+
+NamedListIndex::NamedListIndex(unsigned int count)
+    : m_table(0), m_mask(31), m_used(0), m_stale(false)
+{
+    while (m_mask < 2 * count)
+	m_mask = (m_mask << 1) | 1;
+    m_table = new NamedString*[m_mask + 1];
+    ::memset(m_table,0,(m_mask + 1) * sizeof(NamedString*));
+}
+
+bool NamedListIndex::stale() const
+{
+#ifdef __ATOMIC_ACQUIRE
+    return __atomic_load_n(&m_stale,__ATOMIC_ACQUIRE);
+#else
+    return m_stale;
+#endif
+}
+
+void NamedListIndex::setStale()
+{
+#ifdef __ATOMIC_RELEASE
+    __atomic_store_n(&m_stale,true,__ATOMIC_RELEASE);
+#else
+    m_stale = true;
+    __sync_synchronize();
+#endif
+}
+
+NamedString* NamedListIndex::find(const String& name) const
+{
+    for (unsigned int i = name.hash() & m_mask; m_table[i]; i = (i + 1) & m_mask) {
+	if (m_table[i]->name() == name)
+	    return m_table[i];
+    }
+    return 0;
+}
+
+// Add a parameter unless its name is already present, fails if table is full
+bool NamedListIndex::add(NamedString* param)
+{
+    unsigned int i = param->name().hash() & m_mask;
+    for (; m_table[i]; i = (i + 1) & m_mask) {
+	if (m_table[i]->name() == param->name())
+	    return true;
+    }
+    // keep load factor under 3/4
+    if (4 * (m_used + 1) > 3 * (m_mask + 1))
+	return false;
+    m_table[i] = param;
+    m_used++;
+    return true;
+}
+
+void NamedListIndex::replace(NamedString* oldParam, NamedString* newParam)
+{
+    for (unsigned int i = oldParam->name().hash() & m_mask; m_table[i]; i = (i + 1) & m_mask) {
+	if (m_table[i] == oldParam) {
+	    m_table[i] = newParam;
+	    return;
+	}
+    }
+}
+
+// Remove a parameter, shift back the following entries of the probe chain
+void NamedListIndex::remove(NamedString* param)
+{
+    unsigned int i = param->name().hash() & m_mask;
+    for (; m_table[i] != param; i = (i + 1) & m_mask) {
+	if (!m_table[i])
+	    return;
+    }
+    m_used--;
+    unsigned int j = i;
+    for (;;) {
+	m_table[i] = 0;
+	for (;;) {
+	    j = (j + 1) & m_mask;
+	    if (!m_table[j])
+		return;
+	    unsigned int k = m_table[j]->name().hash() & m_mask;
+	    // entry can be moved if its home slot is not cyclically in (i,j]
+	    if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+		continue;
+	    break;
+	}
+	m_table[i] = m_table[j];
+	i = j;
+    }
+}
+
 
 const NamedList& NamedList::empty()
 {
@@ -30,22 +174,30 @@ const NamedList& NamedList::empty()
 }
 
 NamedList::NamedList(const char* name)
-    : String(name)
+    : String(name),
+      m_index(0)
 {
 }
 
 NamedList::NamedList(const NamedList& original)
-    : String(original)
+    : String(original),
+      m_index(0)
 {
     copyParams(false,original);
 }
 
 NamedList::NamedList(const char* name, const NamedList& original, const String& prefix)
-    : String(name)
+    : String(name),
+      m_index(0)
 {
     copySubParams(original,prefix);
 }
 
+NamedList::~NamedList()
+{
+    clearIndex();
+}
+
 NamedList& NamedList::operator=(const NamedList& value)
 {
     String::operator=(value);
@@ -64,16 +216,21 @@ NamedList& NamedList::addParam(NamedString* param)
 {
     XDebug(DebugInfo,"NamedList::addParam(%p) [\"%s\",\"%s\"]",
         param,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
-    if (param)
+    if (param) {
 	m_params.append(param);
+	indexParam(param);
+    }
     return *this;
 }
 
 NamedList& NamedList::addParam(const char* name, const char* value, bool emptyOK)
 {
     XDebug(DebugInfo,"NamedList::addParam(\"%s\",\"%s\",%s)",name,value,String::boolText(emptyOK));
-    if (emptyOK || !TelEngine::null(value))
-	m_params.append(new NamedString(name, value));
+    if (emptyOK || !TelEngine::null(value)) {
+	NamedString* ns = new NamedString(name, value);
+	m_params.append(ns);
+	indexParam(ns);
+    }
     return *this;
 }
 
@@ -86,6 +243,9 @@ NamedList& NamedList::setParam(NamedString* param)
     while (o) {
         NamedString* s = static_cast<NamedString*>(o->get());
         if (s->name() == param->name()) {
+	    NamedListIndex* index = liveIndex();
+	    if (index)
+		index->replace(s,param);
 	    o->set(param);
 	    return *this;
 	}
@@ -99,25 +259,38 @@ NamedList& NamedList::setParam(NamedString* param)
 	o->append(param);
     else
 	m_params.append(param);
+    indexParam(param);
     return *this;   
 }
 
-static inline NamedString* nlSetParamCreate(NamedList& list, const String& name, ObjList*& append)
+// Find an existing parameter or append a new empty one
+NamedString* NamedList::setParamCreate(const String& name)
 {
-    append = list.paramList()->skipNull();
-    while (append) {
-        NamedString* ns = static_cast<NamedString*>(append->get());
-        if (ns->name() == name) {
-	    append = 0;
+    ObjList* append = &m_params;
+    NamedListIndex* index = liveIndex();
+    if (index) {
+	NamedString* ns = index->find(name);
+	if (ns)
 	    return ns;
+    }
+    else {
+	unsigned int n = 0;
+	for (ObjList* o = m_params.skipNull(); o; o = o->skipNext(), n++) {
+	    NamedString* ns = static_cast<NamedString*>(o->get());
+	    if (ns->name() == name) {
+		if (n >= INDEX_THRESHOLD)
+		    buildIndex();
+		return ns;
+	    }
+	    append = o;
 	}
-	ObjList* next = append->skipNext();
-	if (!next)
-	    return new NamedString(name);
-	append = next;
+	if (n >= INDEX_THRESHOLD)
+	    buildIndex();
     }
-    append = list.paramList();
-    return new NamedString(name);
+    NamedString* ns = new NamedString(name);
+    append->append(ns);
+    indexParam(ns);
+    return ns;
 }
 
 NamedList& NamedList::setParam(const String& name, unsigned int flags, const TokenDict* tokens,
@@ -125,12 +298,9 @@ NamedList& NamedList::setParam(const String& name, unsigned int flags, const Tok
 {
     XDebug(DebugAll,"NamedList::setParam(%s) flags=%u tokens=%p unkFlag=%u [%p]",
 	name.safe(),flags,tokens,unknownflag,this);
-    ObjList* append = 0;
-    NamedString* ns = nlSetParamCreate(*this,name,append);
+    NamedString* ns = setParamCreate(name);
     *static_cast<String*>(ns) = "";
     ns->decodeFlags(flags,tokens,unknownflag);
-    if (append)
-	append->append(ns);
     return *this;   
 }
 
@@ -139,70 +309,59 @@ NamedList& NamedList::setParam(const String& name, uint64_t flags, const TokenDi
 {
     XDebug(DebugAll,"NamedList::setParam(%s) flags64=" FMT64U " tokens=%p unkFlag=%u [%p]",
 	name.safe(),flags,tokens,unknownflag,this);
-    ObjList* append = 0;
-    NamedString* ns = nlSetParamCreate(*this,name,append);
+    NamedString* ns = setParamCreate(name);
     *static_cast<String*>(ns) = "";
     ns->decodeFlags(flags,tokens,unknownflag);
-    if (append)
-	append->append(ns);
     return *this;   
 }
 
 NamedList& NamedList::setParamHex(const String& name, const void* buf, unsigned int len, char sep)
 {
     XDebug(DebugAll,"NamedList::setParamHex(%s,%p,%u,%c) [%p]",name.safe(),buf,len,sep,this);
-    ObjList* append = 0;
-    NamedString* ns = nlSetParamCreate(*this,name,append);
-    ns->hexify((void*)buf,len,sep);
-    if (append)
-	append->append(ns);
+    setParamCreate(name)->hexify((void*)buf,len,sep);
     return *this;   
 }
 
-template <class Obj> NamedList& nlSetParamValue(NamedList& list, const String& name, Obj& value)
-{
-    ObjList* append = 0;
-    NamedString* ns = nlSetParamCreate(list,name,append);
-    *static_cast<String*>(ns) = value;
-    if (append)
-	append->append(ns);
-    return list;
-}
-
 NamedList& NamedList::setParam(const String& name, const char* value)
 {
     XDebug(DebugAll,"NamedList::setParam('%s','%s') [%p]",name.c_str(),value,this);
-    return nlSetParamValue(*this,name,value);
+    *static_cast<String*>(setParamCreate(name)) = value;
+    return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, int64_t value)
 {
     XDebug(DebugAll,"NamedList::setParam(%s) INT64=" FMT64 " [%p]",name.c_str(),value,this);
-    return nlSetParamValue(*this,name,value);
+    *static_cast<String*>(setParamCreate(name)) = value;
+    return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, uint64_t value)
 {
     XDebug(DebugAll,"NamedList::setParam(%s) UINT64=" FMT64U " [%p]",name.c_str(),value,this);
-    return nlSetParamValue(*this,name,value);
+    *static_cast<String*>(setParamCreate(name)) = value;
+    return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, int32_t value)
 {
     XDebug(DebugAll,"NamedList::setParam(%s) INT32=%d [%p]",name.c_str(),value,this);
-    return nlSetParamValue(*this,name,value);
+    *static_cast<String*>(setParamCreate(name)) = value;
+    return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, uint32_t value)
 {
     XDebug(DebugAll,"NamedList::setParam(%s) UINT32=%u [%p]",name.c_str(),value,this);
-    return nlSetParamValue(*this,name,value);
+    *static_cast<String*>(setParamCreate(name)) = value;
+    return *this;
 }
 
 NamedList& NamedList::setParam(const String& name, double value)
 {
     XDebug(DebugAll,"NamedList::setParam(%s) DOUBLE=%f [%p]",name.c_str(),value,this);
-    return nlSetParamValue(*this,name,value);
+    *static_cast<String*>(setParamCreate(name)) = value;
+    return *this;
 }
 
 NamedList& NamedList::clearParam(const String& name, char childSep, const String* value)
@@ -216,8 +375,15 @@ NamedList& NamedList::clearParam(const String& name, char childSep, const String
     while (p) {
         NamedString *s = static_cast<NamedString *>(p->get());
         if (s && ((s->name() == name) || s->name().startsWith(tmp))
-	    && (!value || value->matches(*s)))
+	    && (!value || value->matches(*s))) {
+	    // a value filter may leave behind a parameter with same name
+	    NamedListIndex* index = liveIndex();
+	    if (value)
+		clearIndex();
+	    else if (index)
+		index->remove(s);
             p->remove();
+	}
 	else
 	    p = p->next();
     }
@@ -230,8 +396,13 @@ NamedList& NamedList::clearParam(NamedString* param, bool delParam)
     if (!param)
 	return *this;
     ObjList* o = m_params.find(param);
-    if (o)
+    if (o) {
+	// a parameter with same name may follow, let the index be rebuilt
+	NamedListIndex* index = liveIndex();
+	if (index && (index->find(param->name()) == param))
+	    dropIndex();
 	o->remove(delParam);
+    }
     XDebug(DebugInfo,"NamedList::clearParam(%p) found=%p",param,o);
     return *this;
 }
@@ -251,8 +422,10 @@ NamedList& NamedList::copyParam(const NamedList& original, const String& name, c
     ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* s = static_cast<const NamedString*>(l->get());
-        if ((s->name() == name) || s->name().startsWith(tmp))
+        if ((s->name() == name) || s->name().startsWith(tmp)) {
 	    dest = dest->append(new NamedString(s->name(),*s));
+	    indexParam(static_cast<NamedString*>(dest->get()));
+	}
     }
     return *this;
 }
@@ -284,8 +457,10 @@ NamedList& NamedList::copyParams(bool replace, const NamedList& original, bool c
 	    ns = nlCopyParam(*p);
 	if (!ns)
 	    ns = new NamedString(p->name(),*p);
-	if (append)
+	if (append) {
 	    append = append->append(ns);
+	    indexParam(ns);
+	}
 	else
 	    setParam(ns);
     }
@@ -335,8 +510,10 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 		const char* name = s->name().c_str() + offs;
 		if (!*name)
 		    continue;
-		if (!replace)
+		if (!replace) {
 		    dest = dest->append(new NamedString(name,*s));
+		    indexParam(static_cast<NamedString*>(dest->get()));
+		}
 		else if (offs)
 		    setParam(name,*s);
 		else
@@ -400,13 +577,69 @@ int NamedList::getIndex(const String& name) const
 NamedString* NamedList::getParam(const String& name) const
 {
     XDebug(DebugInfo,"NamedList::getParam(\"%s\")",name.c_str());
+    // a stale index is kept alive for concurrent readers, scan the list instead
+    NamedListIndex* index = loadIndex(m_index);
+    if (index && !index->stale())
+	return index->find(name);
+    NamedString* found = 0;
+    unsigned int n = 0;
     const ObjList *p = m_params.skipNull();
-    for (; p; p=p->skipNext()) {
+    for (; p; p=p->skipNext(), n++) {
         NamedString *s = static_cast<NamedString *>(p->get());
-        if (s->name() == name)
-            return s;
+        if (s->name() == name) {
+	    found = s;
+	    break;
+	}
     }
-    return 0;
+    // scanning a long list, next lookups will use an index
+    if (!index && (n >= INDEX_THRESHOLD))
+	buildIndex();
+    return found;
+}
+
+void NamedList::buildIndex() const
+{
+    Lock lck(s_indexMutex);
+    if (m_index)
+	return;
+    NamedListIndex* index = new NamedListIndex(m_params.count());
+    for (const ObjList* l = m_params.skipNull(); l; l = l->skipNext()) {
+	if (!index->add(static_cast<NamedString*>(l->get()))) {
+	    delete index;
+	    return;
+	}
+    }
+    storeIndex(m_index,index);
+}
+
+// Only called while modifying the list, no other thread may be reading it
+void NamedList::dropIndex()
+{
+    NamedListIndex* index = m_index;
+    storeIndex(m_index,0);
+    delete index;
+}
+
+// Mark the index unusable but keep it allocated until the list is modified
+void NamedList::retireIndex()
+{
+    NamedListIndex* index = loadIndex(m_index);
+    if (index)
+	index->setStale();
+}
+
+NamedListIndex* NamedList::liveIndex()
+{
+    if (m_index && m_index->stale())
+	dropIndex();
+    return m_index;
+}
+
+void NamedList::indexParam(NamedString* param)
+{
+    NamedListIndex* index = liveIndex();
+    if (index && !index->add(param))
+	dropIndex();
 }
 
 NamedString* NamedList::getParam(unsigned int index) const
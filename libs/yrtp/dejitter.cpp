@@ -19,19 +19,31 @@
  */
 
 #include <yatertp.h>
+#include <string.h>
+
+// Amount to grow the buffer when packets arrive or get delivered too late
+#define DELAY_GROW 10000
+// Amount to shrink the buffer after a quiet interval
+#define DELAY_SHRINK 5000
+// Interval without late packets before shrinking the buffer
+#define SHRINK_INTERVAL 10000000
 
 using namespace TelEngine;
 
-namespace { // anonymous
+namespace TelEngine {
 
-class RTPDelayedData : public DataBlock
+// Preallocated packet slot, the payload buffer is kept and reused
+class RTPDelayedData
 {
 public:
-    inline RTPDelayedData(u_int64_t when, bool mark, int payload,
-	unsigned int tstamp, const void* data, int len)
-	: DataBlock(const_cast<void*>(data),len), m_scheduled(when),
-	  m_marker(mark), m_payload(payload), m_timestamp(tstamp)
+    inline RTPDelayedData()
+	: m_scheduled(0), m_marker(false), m_payload(0), m_timestamp(0),
+	  m_data(0), m_length(0), m_size(0)
 	{ }
+    inline ~RTPDelayedData()
+	{ delete[] m_data; }
+    void set(u_int64_t when, bool mark, int payload, unsigned int tstamp,
+	const void* data, int len);
     inline u_int64_t scheduled() const
 	{ return m_scheduled; }
     inline bool marker() const
@@ -40,20 +52,50 @@ public:
 	{ return m_payload; }
     inline unsigned int timestamp() const
 	{ return m_timestamp; }
+    inline const void* data() const
+	{ return m_data; }
+    inline int length() const
+	{ return m_length; }
 private:
     u_int64_t m_scheduled;
     bool m_marker;
     int m_payload;
     unsigned int m_timestamp;
+    unsigned char* m_data;
+    int m_length;
+    int m_size;
 };
 
-}; // anonymous namespace
+}; // namespace TelEngine
+
+
+void RTPDelayedData::set(u_int64_t when, bool mark, int payload, unsigned int tstamp,
+    const void* data, int len)
+{
+    m_scheduled = when;
+    m_marker = mark;
+    m_payload = payload;
+    m_timestamp = tstamp;
+    if (!data || len < 0)
+	len = 0;
+    if (len > m_size) {
+	delete[] m_data;
+	// round up so small size changes don't reallocate
+	m_size = (len + 63) & ~63;
+	m_data = new unsigned char[m_size];
+    }
+    if (len)
+	::memcpy(m_data,data,len);
+    m_length = len;
+}
 
 
 RTPDejitter::RTPDejitter(RTPReceiver* receiver, unsigned int mindelay, unsigned int maxdelay,
     DebugEnabler* dbg, const char* traceId)
     : RTPProcessor(dbg,traceId),
+      m_slots(0), m_capacity(0), m_first(0), m_count(0),
       m_receiver(receiver), m_minDelay(mindelay), m_maxDelay(maxdelay),
+      m_delay(0), m_shrinkTime(0), m_late(0), m_dropped(0), m_reordered(0),
       m_headStamp(0), m_tailStamp(0), m_headTime(0), m_sampRate(125000), m_fastRate(10)
 {
     if (m_maxDelay > 1000000)
@@ -64,19 +106,59 @@ RTPDejitter::RTPDejitter(RTPReceiver* receiver, unsigned int mindelay, unsigned
 	m_minDelay = 5000;
     if (m_minDelay > m_maxDelay - 30000)
 	m_minDelay = m_maxDelay - 30000;
+    m_delay = m_minDelay;
+    // enough slots to fill the maximum buffer with 5ms packets
+    m_capacity = m_maxDelay / 5000 + 4;
+    m_slots = new RTPDelayedData*[m_capacity];
+    for (unsigned int i = 0; i < m_capacity; i++)
+	m_slots[i] = new RTPDelayedData;
 }
 
 RTPDejitter::~RTPDejitter()
 {
-    DDebug(dbg(),DebugInfo,"Dejitter destroyed with %u packets [%p]",m_packets.count(),this);
+    DDebug(dbg(),DebugInfo,"Dejitter destroyed with %u packets, late=%u dropped=%u reordered=%u [%p]",
+	m_count,m_late,m_dropped,m_reordered,this);
+    for (unsigned int i = 0; i < m_capacity; i++)
+	delete m_slots[i];
+    delete[] m_slots;
 }
 
 void RTPDejitter::clear()
 {
-    m_packets.clear();
+    m_first = m_count = 0;
     m_headStamp = m_tailStamp = 0;
 }
 
+void RTPDejitter::stats(NamedList& stat) const
+{
+    stat.setParam("jitterdelay",String(m_delay / 1000));
+    stat.setParam("jitterlate",String(m_late));
+    stat.setParam("jitterdropped",String(m_dropped));
+    stat.setParam("jitterreordered",String(m_reordered));
+}
+
+// Grow the buffer on late packets, shrink it back slowly when things are quiet
+void RTPDejitter::adjustDelay(u_int64_t now, bool grow)
+{
+    if (grow) {
+	m_shrinkTime = now + SHRINK_INTERVAL;
+	if (m_delay >= m_maxDelay - 30000)
+	    return;
+	m_delay += DELAY_GROW;
+	if (m_delay > m_maxDelay - 30000)
+	    m_delay = m_maxDelay - 30000;
+    }
+    else {
+	if (m_delay <= m_minDelay || now < m_shrinkTime)
+	    return;
+	m_shrinkTime = now + SHRINK_INTERVAL;
+	m_delay -= DELAY_SHRINK;
+	if (m_delay < m_minDelay)
+	    m_delay = m_minDelay;
+    }
+    DDebug(dbg(),DebugInfo,"Dejitter delay changed to %u usec [%p]",m_delay,this);
+}
+
 bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, const void* data, int len)
 {
     u_int64_t when = 0;
@@ -90,9 +172,12 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 	else if (dTs < 0) {
 	    DDebug(dbg(),DebugNote,"Dejitter dropping TS %u, last delivered was %u [%p]",
 		timestamp,m_headStamp,this);
+	    m_late++;
+	    adjustDelay(Time::now(),true);
 	    return false;
 	}
 	u_int64_t now = Time::now();
+	adjustDelay(now,false);
 	int64_t rate = 1000 * (now - m_headTime) / dTs;
 	if (rate > 0) {
 	    if (m_sampRate) {
@@ -113,9 +198,9 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 	else
 	    rate = m_sampRate;
 	if (rate > 0)
-	    when = m_headTime + (dTs * rate / 1000) + m_minDelay;
+	    when = m_headTime + (dTs * rate / 1000) + m_delay;
 	else
-	    when = now + m_minDelay;
+	    when = now + m_delay;
 	if (m_tailStamp) {
 	    if (timestamp == m_tailStamp)
 		return true;
@@ -123,6 +208,7 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 		insert = true;
 	    else if (when > now + m_maxDelay) {
 		DDebug(dbg(),DebugNote,"Packet with TS %u falls after max buffer [%p]",timestamp,this);
+		m_dropped++;
 		return false;
 	    }
 	}
@@ -131,59 +217,80 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 	if (m_tailStamp && ((int)(timestamp - m_tailStamp)) < 0) {
 	    // until we get some statistics don't attempt to reorder packets
 	    DDebug(dbg(),DebugNote,"Dejitter got TS %u while last queued was %u [%p]",timestamp,m_tailStamp,this);
+	    m_dropped++;
 	    return false;
 	}
 	// we got no packets out yet so use a fixed interval
-	when = Time::now() + m_minDelay;
+	when = Time::now() + m_delay;
     }
 
+    if (m_count >= m_capacity) {
+	DDebug(dbg(),DebugNote,"Dejitter buffer full, dropping TS %u [%p]",timestamp,this);
+	m_dropped++;
+	return false;
+    }
+    // walk back from the tail over the packets that must come after this one
+    unsigned int pos = m_count;
     if (insert) {
-	for (ObjList* l = m_packets.skipNull(); l; l = l->skipNext()) {
-	    RTPDelayedData* pkt = static_cast<RTPDelayedData*>(l->get());
+	while (pos) {
+	    RTPDelayedData* pkt = m_slots[(m_first + pos - 1) % m_capacity];
 	    if (pkt->timestamp() == timestamp)
 		return true;
-	    if (pkt->timestamp() > timestamp && pkt->scheduled() > when) {
-		l->insert(new RTPDelayedData(when,marker,payload,timestamp,data,len));
-		return true;
-	    }
+	    if (((int)(pkt->timestamp() - timestamp)) < 0 || pkt->scheduled() <= when)
+		break;
+	    pos--;
 	}
+	if (pos < m_count)
+	    m_reordered++;
     }
-    m_tailStamp = timestamp;
-    m_packets.append(new RTPDelayedData(when,marker,payload,timestamp,data,len));
+    // the free slot past the tail gets recycled at the insertion point
+    RTPDelayedData* slot = m_slots[(m_first + m_count) % m_capacity];
+    for (unsigned int i = m_count; i > pos; i--)
+	m_slots[(m_first + i) % m_capacity] = m_slots[(m_first + i - 1) % m_capacity];
+    m_slots[(m_first + pos) % m_capacity] = slot;
+    slot->set(when,marker,payload,timestamp,data,len);
+    if (pos == m_count)
+	m_tailStamp = timestamp;
+    m_count++;
     return true;
 }
 
 void RTPDejitter::timerTick(const Time& when)
 {
-    RTPDelayedData* packet = static_cast<RTPDelayedData*>(m_packets.get());
-    if (!packet) {
+    if (!m_count) {
 	m_tailStamp = 0;
 	if (m_headStamp && (m_headTime + m_maxDelay < when))
 	    m_headStamp = 0;
 	return;
     }
+    RTPDelayedData* packet = m_slots[m_first];
     if (packet->scheduled() > when)
 	return;
-    m_packets.remove(packet,false);
+    m_first = (m_first + 1) % m_capacity;
+    m_count--;
     // remember the last delivered
     m_headStamp = packet->timestamp();
     m_headTime = packet->scheduled();
     if (m_receiver)
 	m_receiver->rtpRecv(packet->marker(),packet->payload(),
 	    packet->timestamp(),packet->data(),packet->length());
-    TelEngine::destruct(packet);
     unsigned int count = 0;
-    while ((packet = static_cast<RTPDelayedData*>(m_packets.get()))) {
+    while (m_count) {
+	packet = m_slots[m_first];
 	long int delayed = (long int)(when - packet->scheduled());
-	if (delayed <= 0 || delayed <= (long)m_minDelay)
+	if (delayed <= 0 || delayed <= (long)m_delay)
 	    break;
 	// we are too delayed - probably rtpRecv() took too long to complete...
-	m_packets.remove(packet,true);
+	m_first = (m_first + 1) % m_capacity;
+	m_count--;
 	count++;
     }
-    if (count)
+    if (count) {
+	m_dropped += count;
+	adjustDelay(when,true);
 	TraceDebug(m_traceId,dbg(),(count > 1) ? DebugMild : DebugNote,
 	    "Dropped %u delayed packet%s from buffer [%p]",count,((count > 1) ? "s" : ""),this);
+    }
 }
 
 /* vi: set ts=8 sw=4 sts=4 noet: */
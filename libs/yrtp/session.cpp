@@ -481,6 +481,8 @@ void RTPReceiver::stats(NamedList& stat) const
     stat.setParam("synclost",String(m_syncLost));
     stat.setParam("wrongssrc",String(m_wrongSSRC));
     stat.setParam("seqslost",String(m_seqLost));
+    if (m_dejitter)
+	m_dejitter->stats(stat);
 }
 
 
@@ -994,6 +996,12 @@ void RTPSession::getStats(String& stats) const
 	stats.append("PR=",",") << m_recv->ioPackets();
 	stats << ",OR=" << m_recv->ioOctets();
 	stats << ",PL=" << m_recv->ioPacketsLost();
+	const RTPDejitter* dj = m_recv->dejitter();
+	if (dj) {
+	    stats << ",JL=" << dj->latePackets();
+	    stats << ",JD=" << dj->droppedPackets();
+	    stats << ",JR=" << dj->reorderedPackets();
+	}
     }
 }
 
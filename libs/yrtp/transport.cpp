@@ -21,11 +21,21 @@
 #include <yatertp.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#define RTP_EPOLL
+#endif
+
 #define BUF_SIZE 1500
+// Maximum number of socket events handled in one wait
+#define MAX_EVENTS 64
 
 using namespace TelEngine;
 
 static unsigned long s_sleep = 5;
+static bool s_event = false;
 
 // Set IPv6 sin6_scope_id for remote addresses from local address
 // recvFrom() will set the sin6_scope_id of the remote socket address
@@ -45,7 +55,8 @@ static inline void setScopeId(const SocketAddr& local, SocketAddr& sa1,
 
 RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
     : Mutex(true,"RTPGroup"),
-      Thread("RTP Group",prio), m_listChanged(false)
+      Thread("RTP Group",prio), m_listChanged(false), m_watchChanged(false),
+      m_poll(-1)
 {
     DDebug(DebugInfo,"RTPGroup::RTPGroup() [%p]",this);
     if (msec < 1)
@@ -59,11 +70,25 @@ RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
 	    Debug(DebugWarn,"Failed to set affinity to '%s', error=%s(%d) [%p]",
 		    affinity.c_str(),::strerror(err),err,this);
     }
+#ifdef RTP_EPOLL
+    if (s_event) {
+	m_poll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (m_poll < 0) {
+	    int err = errno;
+	    Debug(DebugWarn,"Failed to create event poll, error=%s(%d) [%p]",
+		::strerror(err),err,this);
+	}
+    }
+#endif
 }
 
 RTPGroup::~RTPGroup()
 {
     DDebug(DebugInfo,"RTPGroup::~RTPGroup() [%p]",this);
+#ifdef RTP_EPOLL
+    if (m_poll >= 0)
+	::close(m_poll);
+#endif
 }
 
 void RTPGroup::cleanup()
@@ -88,6 +113,16 @@ void RTPGroup::cleanup()
 void RTPGroup::run()
 {
     DDebug(DebugInfo,"RTPGroup::run() [%p]",this);
+    if (m_poll >= 0)
+	runEvents();
+    else
+	runPolling();
+    DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
+}
+
+// Sleep and read all sockets on each loop
+void RTPGroup::runPolling()
+{
     bool ok = true;
     while (ok) {
 	unsigned long msec = m_sleep;
@@ -112,7 +147,60 @@ void RTPGroup::run()
 	unlock();
 	Thread::msleep(msec,true);
     }
-    DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
+}
+
+// Wait for socket events, run processor timers once per loop interval
+void RTPGroup::runEvents()
+{
+#ifdef RTP_EPOLL
+    struct epoll_event events[MAX_EVENTS];
+    u_int64_t tick = 0;
+    bool ok = true;
+    while (ok) {
+	unsigned long msec = m_sleep;
+	if (msec < s_sleep)
+	    msec = s_sleep;
+	int wait = 0;
+	u_int64_t now = Time::now();
+	if (tick > now)
+	    wait = (int)((tick - now + 999) / 1000);
+	int n = ::epoll_wait(m_poll,events,MAX_EVENTS,wait);
+	Thread::check();
+	lock();
+	if (m_watchChanged) {
+	    // transports may have left while we were waiting, get fresh events
+	    m_watchChanged = false;
+	    n = ::epoll_wait(m_poll,events,MAX_EVENTS,0);
+	}
+	for (int i = 0; i < n; i++) {
+	    RTPTransport* trans = (RTPTransport*)(uintptr_t)(events[i].data.u64 & ~(u_int64_t)1);
+	    if (events[i].data.u64 & 1)
+		trans->receiveRtcp();
+	    else
+		trans->receiveRtp();
+	    // remaining events may belong to a transport that just left
+	    //  but they are level triggered so we will get them again
+	    if (m_watchChanged)
+		break;
+	}
+	Time t;
+	if (t >= tick) {
+	    tick = t + msec * 1000;
+	    ObjList* l = &m_processors;
+	    m_listChanged = false;
+	    for (ok = false;l;l = l->next()) {
+		RTPProcessor* p = static_cast<RTPProcessor*>(l->get());
+		if (p) {
+		    ok = true;
+		    p->timerTick(t);
+		    if (m_listChanged)
+			break;
+		}
+	    }
+	}
+	unlock();
+    }
+#endif
 }
 
 void RTPGroup::join(RTPProcessor* proc)
@@ -131,9 +219,66 @@ void RTPGroup::part(RTPProcessor* proc)
     lock();
     m_listChanged = true;
     m_processors.remove(proc,false);
+    unwatch(proc);
     unlock();
 }
 
+// Start waiting for events on the sockets of a transport, group must be locked
+// A transport that failed to register is polled for the rest of its life
+bool RTPGroup::watch(RTPTransport* trans)
+{
+#ifdef RTP_EPOLL
+    if (m_poll < 0 || !trans->m_rtpSock.valid())
+	return false;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uintptr_t)trans;
+    if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,trans->m_rtpSock.handle(),&ev)) {
+	int err = errno;
+	Debug(DebugWarn,"Failed to watch RTP socket, error=%s(%d) [%p]",
+	    ::strerror(err),err,this);
+	trans->m_watchFailed = true;
+	return false;
+    }
+    if (trans->m_rtcpSock.valid()) {
+	// tag RTCP events in the lowest bit of the aligned pointer
+	ev.data.u64 = 1 | (uintptr_t)trans;
+	if (::epoll_ctl(m_poll,EPOLL_CTL_ADD,trans->m_rtcpSock.handle(),&ev)) {
+	    int err = errno;
+	    Debug(DebugWarn,"Failed to watch RTCP socket, error=%s(%d) [%p]",
+		::strerror(err),err,this);
+	    ::epoll_ctl(m_poll,EPOLL_CTL_DEL,trans->m_rtpSock.handle(),&ev);
+	    trans->m_watchFailed = true;
+	    return false;
+	}
+    }
+    m_watched.append(trans)->setDelete(false);
+    trans->m_watched = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Stop waiting for events of a processor if it's a watched transport
+void RTPGroup::unwatch(RTPProcessor* proc)
+{
+    ObjList* o = m_watched.find(proc);
+    if (!o)
+	return;
+    RTPTransport* trans = static_cast<RTPTransport*>(o->get());
+    o->remove(false);
+    trans->m_watched = false;
+    m_watchChanged = true;
+#ifdef RTP_EPOLL
+    struct epoll_event ev;
+    if (trans->m_rtpSock.valid())
+	::epoll_ctl(m_poll,EPOLL_CTL_DEL,trans->m_rtpSock.handle(),&ev);
+    if (trans->m_rtcpSock.valid())
+	::epoll_ctl(m_poll,EPOLL_CTL_DEL,trans->m_rtcpSock.handle(),&ev);
+#endif
+}
+
 void RTPGroup::setMinSleep(int msec)
 {
     if (msec < 1)
@@ -143,6 +288,16 @@ void RTPGroup::setMinSleep(int msec)
     s_sleep = msec;
 }
 
+bool RTPGroup::setEventDriven(bool enable)
+{
+#ifdef RTP_EPOLL
+    s_event = enable;
+#else
+    s_event = false;
+#endif
+    return s_event == enable;
+}
+
 
 RTPProcessor::RTPProcessor(DebugEnabler* dbg, const char* traceId)
     : RTPDebug(dbg,traceId),
@@ -185,7 +340,7 @@ void RTPProcessor::getStats(String& stats) const
 RTPTransport::RTPTransport(RTPTransport::Type type, DebugEnabler* dbg, const char* traceId)
     : RTPProcessor(dbg,traceId),
       m_type(type), m_processor(0), m_monitor(0), m_autoRemote(false),
-      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true)
+      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true), m_watched(false), m_watchFailed(false)
 {
     DDebug(this->dbg(),DebugAll,"RTPTransport::RTPTransport(%d) [%p]",type,this);
 }
@@ -212,6 +367,22 @@ void RTPTransport::destruct()
 void RTPTransport::timerTick(const Time& when)
 {
     XDebug(dbg(),DebugAll,"RTPTransport::timerTick() group=%p [%p]",group(),this);
+    if (m_rtpSock.valid()) {
+	// sockets watched by an event driven group are read when data arrives
+	if (!(m_watched || (!m_watchFailed && group() && group()->eventDriven() && group()->watch(this))))
+	    receiveRtp();
+	m_rtpSock.timerTick(when);
+    }
+    if (m_rtcpSock.valid()) {
+	if (!m_watched)
+	    receiveRtcp();
+	m_rtcpSock.timerTick(when);
+    }
+}
+
+// Read all available packets from the RTP socket
+void RTPTransport::receiveRtp()
+{
     if (m_rtpSock.valid()) {
 	char buf[BUF_SIZE];
 	int len;
@@ -256,8 +427,12 @@ void RTPTransport::timerTick(const Time& when)
 	    else if (m_processor)
 		m_processor->incWrongSrc();
 	}
-	m_rtpSock.timerTick(when);
     }
+}
+
+// Read all available packets from the RTCP socket
+void RTPTransport::receiveRtcp()
+{
     if (m_rtcpSock.valid()) {
 	char buf[BUF_SIZE];
 	int len;
@@ -269,7 +444,6 @@ void RTPTransport::timerTick(const Time& when)
 	    if (m_monitor)
 		m_monitor->rtcpData(buf,len);
 	}
-	m_rtcpSock.timerTick(when);
     }
 }
 
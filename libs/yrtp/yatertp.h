@@ -50,6 +50,7 @@ class RTPSession;
 class RTPSender;
 class RTPReceiver;
 class RTPSecure;
+class RTPDelayedData;
 
 /**
  * Object holding RTP debug
@@ -196,6 +197,7 @@ private:
 class YRTP_API RTPGroup : public GenObject, public Mutex, public Thread
 {
     friend class RTPProcessor;
+    friend class RTPTransport;
 
 public:
     /**
@@ -227,6 +229,22 @@ public:
      */
     static void setMinSleep(int msec);
 
+    /**
+     * Set the system global event driven mode of newly created groups.
+     * In event driven mode the group waits for activity on the sockets of its
+     *  transports instead of polling each of them on every loop
+     * @param enable True to create event driven groups if supported
+     * @return True if the requested mode is effective
+     */
+    static bool setEventDriven(bool enable);
+
+    /**
+     * Check if this group waits for socket events instead of polling
+     * @return True if the group is event driven
+     */
+    inline bool eventDriven() const
+	{ return m_poll >= 0; }
+
     /**
      * Add a RTP processor to this group
      * @param proc Pointer to the RTP processor to add
@@ -240,9 +258,16 @@ public:
     void part(RTPProcessor* proc);
 
 private:
+    void runPolling();
+    void runEvents();
+    bool watch(RTPTransport* trans);
+    void unwatch(RTPProcessor* proc);
     ObjList m_processors;
+    ObjList m_watched;
     bool m_listChanged;
+    bool m_watchChanged;
     unsigned long m_sleep;
+    int m_poll;
 };
 
 /**
@@ -387,6 +412,9 @@ protected:
     virtual void rtcpData(const void* data, int len);
 
 private:
+    friend class RTPGroup;
+    void receiveRtp();
+    void receiveRtcp();
     bool sendData(Socket& sock, const SocketAddr& to, const void* data, int len,
 	const char* what, bool& flag);
     Type m_type;
@@ -403,6 +431,8 @@ private:
     bool m_autoRemote;
     bool m_warnSendErrorRtp;
     bool m_warnSendErrorRtcp;
+    bool m_watched;
+    bool m_watchFailed;
 };
 
 /**
@@ -447,6 +477,40 @@ public:
      */
     void clear();
 
+    /**
+     * Retrieve the current adaptive length of the buffer
+     * @return Delay applied to new packets in microseconds
+     */
+    inline unsigned int delay() const
+	{ return m_delay; }
+
+    /**
+     * Retrieve the number of packets dropped because a later one was already delivered
+     * @return Number of packets that arrived too late
+     */
+    inline unsigned int latePackets() const
+	{ return m_late; }
+
+    /**
+     * Retrieve the number of packets dropped by the buffer
+     * @return Number of packets dropped for buffer full, too far or delivered too late
+     */
+    inline unsigned int droppedPackets() const
+	{ return m_dropped; }
+
+    /**
+     * Retrieve the number of packets that were put back in order
+     * @return Number of out of order packets inserted in the buffer
+     */
+    inline unsigned int reorderedPackets() const
+	{ return m_reordered; }
+
+    /**
+     * Fill in dejitter buffer statistics
+     * @param stat List of statistics parameters to fill in
+     */
+    void stats(NamedList& stat) const;
+
 protected:
     /**
      * Method called periodically to keep the data flowing
@@ -455,10 +519,19 @@ protected:
     virtual void timerTick(const Time& when);
 
 private:
-    ObjList m_packets;
+    void adjustDelay(u_int64_t now, bool grow);
+    RTPDelayedData** m_slots;
+    unsigned int m_capacity;
+    unsigned int m_first;
+    unsigned int m_count;
     RTPReceiver* m_receiver;
     unsigned int m_minDelay;
     unsigned int m_maxDelay;
+    unsigned int m_delay;
+    u_int64_t m_shrinkTime;
+    unsigned int m_late;
+    unsigned int m_dropped;
+    unsigned int m_reordered;
     unsigned int m_headStamp;
     unsigned int m_tailStamp;
     u_int64_t m_headTime;
@@ -719,6 +792,13 @@ public:
     inline void setDejitter(unsigned int mindelay, unsigned int maxdelay)
 	{ setDejitter(new RTPDejitter(this,mindelay,maxdelay,dbg(),m_traceId)); }
 
+    /**
+     * Retrieve the dejitter buffer of this receiver
+     * @return Pointer to the dejitter buffer, NULL if not set
+     */
+    inline RTPDejitter* dejitter() const
+	{ return m_dejitter; }
+
     /**
      * Process one RTP payload packet.
      * Default behaviour is to call rtpRecvData() or rtpRecvEvent().
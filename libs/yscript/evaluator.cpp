@@ -1027,6 +1027,34 @@ ExpOperation* ExpEvaluator::popValue(ObjList& stack, GenObject* context) const
     return ok ? popOne(stack) : 0;
 }
 
+bool ExpEvaluator::compareValues(Opcode oper, const ExpOperation& op1, const ExpOperation& op2)
+{
+    switch (oper) {
+	case OpcLt:
+	    return op1.valInteger() < op2.valInteger();
+	case OpcGt:
+	    return op1.valInteger() > op2.valInteger();
+	case OpcLe:
+	    return op1.valInteger() <= op2.valInteger();
+	case OpcGe:
+	    return op1.valInteger() >= op2.valInteger();
+	case OpcEq:
+	case OpcNe:
+	    {
+		bool eq;
+		const ExpWrapper* w1 = YOBJECT(ExpWrapper,&op1);
+		const ExpWrapper* w2 = YOBJECT(ExpWrapper,&op2);
+		if (op1.opcode() == op2.opcode() && w1 && w2)
+		    eq = w1->object() == w2->object();
+		else
+		    eq = (op1 == op2);
+		return (oper == OpcNe) ? !eq : eq;
+	    }
+	default:
+	    return false;
+    }
+}
+
 bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObject* context) const
 {
     DDebug(this,DebugAll,"runOperation(%p,%u,%p) %s",&stack,oper.opcode(),context,getOperator(oper.opcode()));
@@ -1133,30 +1161,13 @@ bool ExpEvaluator::runOperation(ObjList& stack, const ExpOperation& oper, GenObj
 			val = op1->valInteger() >> op2->valInteger();
 			break;
 		    case OpcLt:
-			val = (op1->valInteger() < op2->valInteger()) ? 1 : 0;
-			break;
 		    case OpcGt:
-			val = (op1->valInteger() > op2->valInteger()) ? 1 : 0;
-			break;
 		    case OpcLe:
-			val = (op1->valInteger() <= op2->valInteger()) ? 1 : 0;
-			break;
 		    case OpcGe:
-			val = (op1->valInteger() >= op2->valInteger()) ? 1 : 0;
-			break;
 		    case OpcEq:
 		    case OpcNe:
-		    {
-			ExpWrapper* w1 = YOBJECT(ExpWrapper,op1);
-			ExpWrapper* w2 = YOBJECT(ExpWrapper,op2);
-			if (op1->opcode() == op2->opcode() && w1 && w2)
-			    val = w1->object() == w2->object() ? 1 : 0;
-			else
-			    val = (*op1 == *op2) ? 1 : 0;
-			if (oper.opcode() == OpcNe)
-			    val = val ? 0 : 1;
+			val = compareValues(oper.opcode(),*op1,*op2) ? 1 : 0;
 			break;
-		    }
 		    default:
 			handled = false;
 			break;
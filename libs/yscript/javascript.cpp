@@ -20,6 +20,8 @@
 
 #include "yatescript.h"
 #include <yatengine.h>
+#include <string.h>
+#include <stdio.h>
 
 //#define STATS_TRACE "jstrace"
 
@@ -63,6 +65,7 @@ public:
     void trackObjs(unsigned int track = 0);
     ObjList* countAllocations();
 private:
+    friend class JsCode;
     GenObject* resolveTop(ObjList& stack, const String& name, GenObject* context);
     HashList* m_trackObjs;
     Mutex m_trackObjsMtx;
@@ -136,6 +139,76 @@ struct JsEntry
     unsigned int index;
 };
 
+// Operand of lowered code held on the value stack of a runner
+struct JsValue
+{
+    enum Type {
+	// integer or NaN, as pushed by new ExpOperation(int64_t)
+	Number,
+	// boolean, as pushed by new ExpOperation(bool)
+	Boolean,
+	// plain constant owned by the code
+	Constant,
+	// field reference owned by the code, not yet resolved
+	Field,
+	// block start, as pushed by OpcBegin
+	Marker,
+    };
+    // the accessors below mirror ExpOperation and need a resolved value
+    inline bool isInteger() const
+	{ return (type == Constant) ? oper->isInteger() : (number != ExpOperation::nonInteger()); }
+    inline bool isNumber() const
+	{ return (type == Constant) ? oper->isNumber() : true; }
+    inline int64_t valInteger() const
+	{ return (type == Constant) ? oper->valInteger() : (isInteger() ? number : 0); }
+    inline int64_t toNumber() const
+	{ return (type == Constant) ? oper->toNumber() : number; }
+    inline int64_t valNumber() const
+	{ return (type == Constant) ? oper->number() : number; }
+    inline bool valBoolean() const
+	{ return (type == Constant) ? oper->valBoolean() : (!isInteger() || number != 0); }
+    const char* text(char* buf) const;
+    Type type;
+    int64_t number;
+    const ExpOperation* oper;
+};
+
+// Lowered form of a linked operation, one for each entry in the linked vector
+struct JsInstr
+{
+    enum Kind {
+	// run the original operation on the ObjList stack
+	Generic,
+	// labels and empty operations
+	Nop,
+	// unconditional jump
+	Jump,
+	// pop a value and jump if its boolean value matches
+	JumpCond,
+	// compare and jump without pushing the result
+	CmpJump,
+	// push a constant or a field reference on the value stack
+	Push,
+	// unary operator on the value stack
+	Unary,
+	// binary operator on the value stack
+	Binary,
+	// block start, end or statement flush
+	Begin,
+	End,
+	Flush,
+    };
+    Kind kind;
+    // boolean value that triggers a conditional jump
+    bool jumpIf;
+    // operator of an unary, binary or compare instruction
+    int op;
+    // absolute index of the jump destination
+    unsigned int target;
+    // original operation, used for errors and fallback
+    const ExpOperation* oper;
+};
+
 class JsCode : public ScriptCode, public ExpEvaluator
 {
     friend class TelEngine::JsFunction;
@@ -190,7 +263,7 @@ public:
     };
     inline JsCode()
 	: ExpEvaluator(C),
-	  m_pragmas(""), m_label(0), m_depth(0), m_entries(0), m_traceable(false)
+	  m_pragmas(""), m_label(0), m_depth(0), m_entries(0), m_lowered(0), m_traceable(false)
 	{ debugName("JsCode"); }
     ~JsCode();
     virtual void* getObject(const String& name) const
@@ -270,6 +343,13 @@ private:
     bool parseSimple(ParsePoint& expr, bool constOnly, ScriptMutex* mtx = 0);
     bool evalList(ObjList& stack, GenObject* context) const;
     bool evalVector(ObjList& stack, GenObject* context) const;
+    bool evalLowered(ObjList& stack, JsRunner* runner) const;
+    bool fetchValue(JsValue& val, ObjList& stack, JsContext* ctxt, JsRunner* runner) const;
+    void spillValues(ObjList& stack, JsRunner* runner, unsigned int& depth) const;
+    void lower();
+    static bool unaryOp(int oper, JsValue& val);
+    static bool binaryOp(int oper, JsValue& op1, const JsValue& op2);
+    static bool compareOps(int oper, const ExpOperation& op1, const ExpOperation& op2);
     bool jumpToLabel(long int label, GenObject* context) const;
     bool jumpRelative(long int offset, GenObject* context) const;
     bool jumpAbsolute(long int index, GenObject* context) const;
@@ -286,6 +366,7 @@ private:
     long int m_label;
     int m_depth;
     JsEntry* m_entries;
+    JsInstr* m_lowered;
     bool m_traceable;
 };
 
@@ -399,10 +480,11 @@ public:
     inline JsRunner(ScriptCode* code, ScriptContext* context, const char* title)
 	: ScriptRun(code,context),
 	  m_paused(false), m_tracing(false), m_opcode(0), m_index(0),
-	  m_instr(0), m_lastLine(0), m_lastTime(0), m_totalTime(0), m_callInfo(0)
+	  m_instr(0), m_lastLine(0), m_lastTime(0), m_totalTime(0), m_callInfo(0),
+	  m_values(0), m_valuesLen(0)
 	{ traceCheck(title); }
     virtual ~JsRunner()
-	{ if (m_tracing) traceDump(); }
+	{ if (m_tracing) traceDump(); delete[] m_values; }
     inline bool tracing() const
 	{ return m_tracing; }
     virtual Status reset(bool init);
@@ -432,6 +514,8 @@ private:
     u_int64_t m_lastTime;
     u_int64_t m_totalTime;
     JsCallInfo* m_callInfo;
+    JsValue* m_values;
+    unsigned int m_valuesLen;
     ObjList m_traceStack;
     RefPointer<JsCodeStats> m_stats;
 };
@@ -1055,6 +1139,7 @@ ObjList* JsContext::countAllocations()
 JsCode::~JsCode()
 {
     delete[] m_entries;
+    delete[] m_lowered;
 }
 
 // Initialize standard globals in the execution context
@@ -1100,6 +1185,8 @@ bool JsCode::link()
     m_linked.assign(m_opcodes);
     delete[] m_entries;
     m_entries = 0;
+    delete[] m_lowered;
+    m_lowered = 0;
     unsigned int n = m_linked.count();
     if (!n)
 	return false;
@@ -1148,9 +1235,123 @@ bool JsCode::link()
 	m_entries[entries].number = -1;
 	m_entries[entries].index = 0;
     }
+    lower();
     return true;
 }
 
+// Lower the linked vector to an instruction array
+// Control flow, constants, field reads and arithmetic are executed on the
+//  value stack of the runner, everything else runs the original operation
+void JsCode::lower()
+{
+    unsigned int n = m_linked.count();
+    m_lowered = new JsInstr[n];
+    for (unsigned int i = 0; i < n; i++) {
+	JsInstr& in = m_lowered[i];
+	in.kind = JsInstr::Generic;
+	in.jumpIf = false;
+	in.op = OpcNone;
+	in.target = 0;
+	in.oper = static_cast<const ExpOperation*>(m_linked[i]);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+	JsInstr& in = m_lowered[i];
+	if (!in.oper)
+	    continue;
+	int op = in.oper->opcode();
+	switch (op) {
+	    case OpcNone:
+	    case OpcLabel:
+		in.kind = JsInstr::Nop;
+		continue;
+	    case OpcPush:
+	    case OpcField:
+		// wrappers and functions are not plain values, keep them on the ObjList
+		if (!in.oper->barrier() && !YOBJECT(ExpWrapper,in.oper) && !YOBJECT(ExpFunction,in.oper))
+		    in.kind = JsInstr::Push;
+		continue;
+	    case OpcBegin:
+		in.kind = JsInstr::Begin;
+		continue;
+	    case OpcEnd:
+		in.kind = JsInstr::End;
+		continue;
+	    case OpcFlush:
+		in.kind = JsInstr::Flush;
+		continue;
+	    case OpcNeg:
+	    case OpcNot:
+	    case OpcLNot:
+		in.kind = JsInstr::Unary;
+		in.op = op;
+		continue;
+	    case OpcAdd:
+	    case OpcSub:
+	    case OpcMul:
+	    case OpcDiv:
+	    case OpcMod:
+	    case OpcAnd:
+	    case OpcOr:
+	    case OpcXor:
+	    case OpcShl:
+	    case OpcShr:
+	    case OpcLAnd:
+	    case OpcLOr:
+	    case OpcEq:
+	    case OpcNe:
+	    case OpcLt:
+	    case OpcGt:
+	    case OpcLe:
+	    case OpcGe:
+	    case OpcEqIdentity:
+	    case OpcNeIdentity:
+		in.kind = JsInstr::Binary;
+		in.op = op;
+		continue;
+	    case OpcJRel:
+	    case OpcJRelTrue:
+	    case OpcJRelFalse:
+		break;
+	    default:
+		continue;
+	}
+	// relative jumps are computed from the index past the jump
+	long int dest = (long int)i + 1 + (long int)in.oper->number();
+	if (dest < 0 || dest > (long int)n)
+	    continue;
+	in.target = (unsigned int)dest;
+	if (op == OpcJRel) {
+	    in.kind = JsInstr::Jump;
+	    continue;
+	}
+	in.kind = JsInstr::JumpCond;
+	in.jumpIf = (op == OpcJRelTrue);
+	if (!i)
+	    continue;
+	// fuse with a preceding comparison, it keeps its own operator if
+	//  something jumps directly to the conditional jump
+	JsInstr& c = m_lowered[i - 1];
+	switch (c.op) {
+	    case OpcEq:
+	    case OpcNe:
+	    case OpcLt:
+	    case OpcGt:
+	    case OpcLe:
+	    case OpcGe:
+	    case OpcEqIdentity:
+	    case OpcNeIdentity:
+		if (c.kind != JsInstr::Binary)
+		    continue;
+		break;
+	    default:
+		continue;
+	}
+	c.kind = JsInstr::CmpJump;
+	c.jumpIf = in.jumpIf;
+	c.target = in.target;
+    }
+}
+
 const String& JsCode::getFileAt(unsigned int index, bool wholePath) const
 {
     if (!index)
@@ -2275,19 +2476,9 @@ bool JsCode::runOperation(ObjList& stack, const ExpOperation& oper, GenObject* c
 		    TelEngine::destruct(op2);
 		    return gotError("ExpEvaluator stack underflow",oper.lineNumber());
 		}
-		bool eq = (op1->opcode() == op2->opcode());
-		if (eq) {
-		    ExpWrapper* w1 = YOBJECT(ExpWrapper,op1);
-		    ExpWrapper* w2 = YOBJECT(ExpWrapper,op2);
-		    if (w1 || w2)
-			eq = w1 && w2 && w1->object() == w2->object();
-		    else
-			eq = (op1->number() == op2->number()) && (*op1 == *op2);
-		}
+		bool eq = compareOps(oper.opcode(),*op1,*op2);
 		TelEngine::destruct(op1);
 		TelEngine::destruct(op2);
-		if ((JsOpcode)oper.opcode() == OpcNeIdentity)
-		    eq = !eq;
 		pushOne(stack,new ExpOperation(eq));
 	    }
 	    break;
@@ -2842,6 +3033,8 @@ bool JsCode::evalVector(ObjList& stack, GenObject* context) const
 {
     XDebug(this,DebugInfo,"JsCode::evalVector(%p,%p)",&stack,context);
     JsRunner* runner = static_cast<JsRunner*>(context);
+    if (m_lowered)
+	return evalLowered(stack,runner);
     unsigned int& index = runner->m_index;
     while (index < m_linked.length()) {
 	const ExpOperation* o = static_cast<const ExpOperation*>(m_linked[index++]);
@@ -2853,6 +3046,387 @@ bool JsCode::evalVector(ObjList& stack, GenObject* context) const
     return true;
 }
 
+// Text of a resolved value, as the String of the equivalent ExpOperation
+const char* JsValue::text(char* buf) const
+{
+    switch (type) {
+	case Boolean:
+	    return String::boolText(number != 0);
+	case Number:
+	    if (number == ExpOperation::nonInteger())
+		return "NaN";
+	    ::sprintf(buf,FMT64,number);
+	    return buf;
+	default:
+	    return oper->safe();
+    }
+}
+
+// Tag a field value if it is exactly represented by a number or boolean value
+static bool tagValue(JsValue& val, const String& str, int64_t num, bool isBool, bool isNum)
+{
+    if (!isNum || (isBool && num != 0 && num != 1))
+	return false;
+    val.type = isBool ? JsValue::Boolean : JsValue::Number;
+    val.number = num;
+    char buf[24];
+    return str == val.text(buf);
+}
+
+// Resolve a field reference the way JsContext::runField() does
+// Only plain numeric and boolean fields are resolved, anything else must go
+//  through runField() so getters, wrappers and strings behave as before
+// The value may be altered even if resolving fails so callers pass a copy
+bool JsCode::fetchValue(JsValue& val, ObjList& stack, JsContext* ctxt, JsRunner* runner) const
+{
+    if (val.type == JsValue::Marker)
+	return false;
+    if (val.type != JsValue::Field)
+	return true;
+    const String& name = val.oper->name();
+    if (!ctxt || name.find('.') >= 0)
+	return false;
+    JsObject* obj = YOBJECT(JsObject,ctxt->resolveTop(stack,name,runner));
+    const NamedString* param = obj ? obj->getField(stack,name,runner) : 0;
+    if (!param || YOBJECT(ExpFunction,param) || YOBJECT(ExpWrapper,param) || YOBJECT(JsObject,param))
+	return false;
+    const ExpOperation* op = YOBJECT(ExpOperation,param);
+    if (op)
+	return tagValue(val,*op,op->number(),op->isBoolean(),op->isNumber());
+    bool isBool = param->isBoolean();
+    int64_t num = isBool ? (param->toBoolean() ? 1 : 0) : param->toInt64(ExpOperation::nonInteger());
+    return tagValue(val,*param,num,isBool,
+	isBool || (*param == YSTRING("NaN")) || (num != ExpOperation::nonInteger()));
+}
+
+// Move values to the ObjList stack before running an operation on it
+void JsCode::spillValues(ObjList& stack, JsRunner* runner, unsigned int& depth) const
+{
+    for (unsigned int i = 0; i < depth; i++) {
+	const JsValue& v = runner->m_values[i];
+	switch (v.type) {
+	    case JsValue::Number:
+		pushOne(stack,new ExpOperation(v.number));
+		break;
+	    case JsValue::Boolean:
+		pushOne(stack,new ExpOperation(v.number != 0));
+		break;
+	    case JsValue::Marker:
+		pushOne(stack,new ExpOperation((Opcode)OpcBegin));
+		break;
+	    default:
+		pushOne(stack,v.oper->clone());
+		break;
+	}
+    }
+    depth = 0;
+}
+
+// Unary operators as executed by ExpEvaluator::runOperation()
+bool JsCode::unaryOp(int oper, JsValue& val)
+{
+    switch (oper) {
+	case OpcNeg:
+	    // negating NaN is left to runOperation()
+	    if (val.toNumber() == ExpOperation::nonInteger())
+		return false;
+	    val.number = -val.toNumber();
+	    val.type = JsValue::Number;
+	    return true;
+	case OpcNot:
+	    val.number = ~val.valInteger();
+	    val.type = JsValue::Number;
+	    return true;
+	case OpcLNot:
+	    val.number = val.valBoolean() ? 0 : 1;
+	    val.type = JsValue::Boolean;
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+// Binary operators as executed by runOperation(), result is left in op1
+// Returns false if the operation must run on the ObjList stack
+bool JsCode::binaryOp(int oper, JsValue& op1, const JsValue& op2)
+{
+    int64_t val = 0;
+    bool boolRes = false;
+    switch (oper) {
+	case OpcDiv:
+	case OpcMod:
+	    // let runOperation() report the error
+	    if (!op2.toNumber())
+		return false;
+	    break;
+	case OpcAdd:
+	    // string concatenation allocates anyway
+	    if (!(op1.isNumber() && op2.isNumber()))
+		return false;
+	    break;
+	default:
+	    break;
+    }
+    switch (oper) {
+	case OpcAnd:
+	    val = op1.valInteger() & op2.valInteger();
+	    break;
+	case OpcOr:
+	    val = op1.valInteger() | op2.valInteger();
+	    break;
+	case OpcXor:
+	    val = op1.valInteger() ^ op2.valInteger();
+	    break;
+	case OpcShl:
+	    val = op1.valInteger() << op2.valInteger();
+	    break;
+	case OpcShr:
+	    val = op1.valInteger() >> op2.valInteger();
+	    break;
+	case OpcLAnd:
+	    val = op1.valBoolean() && op2.valBoolean();
+	    boolRes = true;
+	    break;
+	case OpcLOr:
+	    val = op1.valBoolean() || op2.valBoolean();
+	    boolRes = true;
+	    break;
+	case OpcLt:
+	    val = op1.valInteger() < op2.valInteger();
+	    boolRes = true;
+	    break;
+	case OpcGt:
+	    val = op1.valInteger() > op2.valInteger();
+	    boolRes = true;
+	    break;
+	case OpcLe:
+	    val = op1.valInteger() <= op2.valInteger();
+	    boolRes = true;
+	    break;
+	case OpcGe:
+	    val = op1.valInteger() >= op2.valInteger();
+	    boolRes = true;
+	    break;
+	case OpcEq:
+	case OpcNe:
+	case OpcEqIdentity:
+	case OpcNeIdentity:
+	    {
+		// all values are plain pushed operations, wrappers never get here
+		char buf1[24];
+		char buf2[24];
+		bool eq = !::strcmp(op1.text(buf1),op2.text(buf2));
+		if (eq && (oper == OpcEqIdentity || oper == OpcNeIdentity))
+		    eq = (op1.valNumber() == op2.valNumber());
+		val = (oper == OpcNe || oper == OpcNeIdentity) ? !eq : eq;
+		boolRes = true;
+	    }
+	    break;
+	default:
+	    {
+		int64_t op1Val = op1.toNumber();
+		int64_t op2Val = op2.toNumber();
+		val = ExpOperation::nonInteger();
+		if (op1Val == ExpOperation::nonInteger() || op2Val == ExpOperation::nonInteger())
+		    break;
+		switch (oper) {
+		    case OpcAdd:
+			val = op1Val + op2Val;
+			break;
+		    case OpcSub:
+			val = op1Val - op2Val;
+			break;
+		    case OpcMul:
+			val = op1Val * op2Val;
+			break;
+		    case OpcDiv:
+			val = op1Val / op2Val;
+			break;
+		    case OpcMod:
+			val = op1Val % op2Val;
+			break;
+		    default:
+			return false;
+		}
+	    }
+	    break;
+    }
+    op1.type = boolRes ? JsValue::Boolean : JsValue::Number;
+    op1.number = boolRes ? (val ? 1 : 0) : val;
+    return true;
+}
+
+// Run the lowered code, keeping plain values on the value stack of the runner
+// The logical stack is the ObjList stack with the value stack on top of it,
+//  values are moved to the ObjList before running any other operation
+bool JsCode::evalLowered(ObjList& stack, JsRunner* runner) const
+{
+    unsigned int& index = runner->m_index;
+    unsigned int n = m_linked.length();
+    JsContext* ctxt = YOBJECT(JsContext,runner->context());
+    unsigned int depth = 0;
+    while (index < n) {
+	const JsInstr& in = m_lowered[index];
+	if (!runner->tracing()) {
+	    JsValue* v = runner->m_values;
+	    switch (in.kind) {
+		case JsInstr::Nop:
+		    index++;
+		    continue;
+		case JsInstr::Jump:
+		    index = in.target;
+		    continue;
+		case JsInstr::Push:
+		case JsInstr::Begin:
+		    if (depth >= runner->m_valuesLen) {
+			unsigned int len = runner->m_valuesLen ? 2 * runner->m_valuesLen : 16;
+			v = new JsValue[len];
+			for (unsigned int i = 0; i < depth; i++)
+			    v[i] = runner->m_values[i];
+			delete[] runner->m_values;
+			runner->m_values = v;
+			runner->m_valuesLen = len;
+		    }
+		    if (in.kind == JsInstr::Begin)
+			v[depth].type = JsValue::Marker;
+		    else if (in.oper->opcode() == OpcField)
+			v[depth].type = JsValue::Field;
+		    else
+			v[depth].type = JsValue::Constant;
+		    v[depth].number = 0;
+		    v[depth++].oper = in.oper;
+		    index++;
+		    continue;
+		case JsInstr::End:
+		case JsInstr::Flush:
+		    {
+			unsigned int b = depth;
+			while (b && v[b - 1].type != JsValue::Marker)
+			    b--;
+			if (b) {
+			    // End keeps the block value in place of the marker
+			    if (in.kind == JsInstr::End && b < depth)
+				v[b - 1] = v[depth - 1];
+			    else
+				b--;
+			    depth = b;
+			    index++;
+			    continue;
+			}
+			// values above a marker on the ObjList are discarded by a flush
+			if (in.kind == JsInstr::Flush)
+			    depth = 0;
+		    }
+		    break;
+		case JsInstr::Unary:
+		    if (depth) {
+			JsValue op = v[depth - 1];
+			if (fetchValue(op,stack,ctxt,runner) && unaryOp(in.op,op)) {
+			    v[depth - 1] = op;
+			    index++;
+			    continue;
+			}
+		    }
+		    break;
+		case JsInstr::Binary:
+		    if (depth >= 2) {
+			JsValue op1 = v[depth - 2];
+			JsValue op2 = v[depth - 1];
+			if (fetchValue(op2,stack,ctxt,runner) && fetchValue(op1,stack,ctxt,runner)
+			    && binaryOp(in.op,op1,op2)) {
+			    v[--depth - 1] = op1;
+			    index++;
+			    continue;
+			}
+		    }
+		    break;
+		case JsInstr::CmpJump:
+		    if (depth >= 2) {
+			JsValue op1 = v[depth - 2];
+			JsValue op2 = v[depth - 1];
+			if (fetchValue(op2,stack,ctxt,runner) && fetchValue(op1,stack,ctxt,runner)
+			    && binaryOp(in.op,op1,op2)) {
+			    depth -= 2;
+			    index = ((op1.number != 0) == in.jumpIf) ? in.target : index + 2;
+			    continue;
+			}
+		    }
+		    spillValues(stack,runner,depth);
+		    {
+			// keep index past the compare while evaluating operands
+			index++;
+			ExpOperation* op2 = popValue(stack,runner);
+			ExpOperation* op1 = popValue(stack,runner);
+			if (!op1 || !op2) {
+			    TelEngine::destruct(op1);
+			    TelEngine::destruct(op2);
+			    return gotError("ExpEvaluator stack underflow",in.oper->lineNumber());
+			}
+			bool val = compareOps(in.op,*op1,*op2);
+			TelEngine::destruct(op1);
+			TelEngine::destruct(op2);
+			index = (val == in.jumpIf) ? in.target : index + 1;
+		    }
+		    continue;
+		case JsInstr::JumpCond:
+		    if (depth) {
+			JsValue op = v[depth - 1];
+			if (fetchValue(op,stack,ctxt,runner)) {
+			    depth--;
+			    index = (op.valBoolean() == in.jumpIf) ? in.target : index + 1;
+			    continue;
+			}
+		    }
+		    spillValues(stack,runner,depth);
+		    {
+			index++;
+			ExpOperation* op = popValue(stack,runner);
+			if (!op)
+			    return gotError("Stack underflow",in.oper->lineNumber());
+			if (op->valBoolean() == in.jumpIf)
+			    index = in.target;
+			TelEngine::destruct(op);
+		    }
+		    continue;
+		default:
+		    break;
+	    }
+	}
+	// generic operations, tracing and values that need the ObjList go the slow way
+	spillValues(stack,runner,depth);
+	const ExpOperation* o = static_cast<const ExpOperation*>(m_linked[index++]);
+	if (o && !runOperation(stack,*o,runner))
+	    return false;
+	if (runner->m_paused)
+	    break;
+    }
+    spillValues(stack,runner,depth);
+    return true;
+}
+
+// Comparison operators as executed by runOperation()
+bool JsCode::compareOps(int oper, const ExpOperation& op1, const ExpOperation& op2)
+{
+    switch (oper) {
+	case OpcEqIdentity:
+	case OpcNeIdentity:
+	    {
+		bool eq = (op1.opcode() == op2.opcode());
+		if (eq) {
+		    const ExpWrapper* w1 = YOBJECT(ExpWrapper,&op1);
+		    const ExpWrapper* w2 = YOBJECT(ExpWrapper,&op2);
+		    if (w1 || w2)
+			eq = w1 && w2 && w1->object() == w2->object();
+		    else
+			eq = (op1.number() == op2.number()) && (op1 == op2);
+		}
+		return (oper == OpcNeIdentity) ? !eq : eq;
+	    }
+	default:
+	    return compareValues((Opcode)oper,op1,op2);
+    }
+}
+
 bool JsCode::jumpToLabel(long int label, GenObject* context) const
 {
     if (!context)
@@ -1881,11 +1881,13 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	    return false;
 	int i1 = 0;
 	int i2 = length() - 1;
+	// renaming in place, access through the list so the name index is dropped
+	ObjList* l = params().paramList();
 	for (; i1 < i2; i1++, i2--) {
 	    String s1(i1);
 	    String s2(i2);
-	    NamedString* n1 = params().getParam(s1);
-	    NamedString* n2 = params().getParam(s2);
+	    NamedString* n1 = static_cast<NamedString*>((*l)[s1]);
+	    NamedString* n2 = static_cast<NamedString*>((*l)[s2]);
 	    if (n1)
 		const_cast<String&>(n1->name()) = s2;
 	    if (n2)
@@ -668,6 +668,15 @@ public:
      */
     virtual ExpOperation* popValue(ObjList& stack, GenObject* context = 0) const;
 
+    /**
+     * Compare two operand values the same way the comparison operators do
+     * @param oper Comparison to perform: OpcEq, OpcNe, OpcLt, OpcGt, OpcLe or OpcGe
+     * @param op1 First (left side) operand
+     * @param op2 Second (right side) operand
+     * @return True if the comparison holds
+     */
+    static bool compareValues(Opcode oper, const ExpOperation& op1, const ExpOperation& op2);
+
     /**
      * Try to evaluate a single operation
      * @param stack Evaluation stack in use, operands are popped off this stack
@@ -2731,6 +2731,8 @@ bool SS7ISUPCall::replaceCircuit(SignallingCircuit* circuit, SS7MsgISUP* msg)
     if (controller())
 	controller()->releaseCircuit(m_circuit);
     m_circuit = circuit;
+    if (controller())
+	controller()->reindexCall(this,id());
     Debug(isup(),DebugNote,"Call(%u). Circuit replaced by %u [%p]",oldId,id(),this);
     m_circuitChanged = true;
     return transmitIAM();
@@ -3737,7 +3739,7 @@ SignallingCall* SS7ISUP::call(SignallingMessage* msg, String& reason)
 	}
 	call = new SS7ISUPCall(this,cic,*m_defPoint,dest,true,sls,range);
 	call->ref();
-	m_calls.append(call);
+	appendCall(call,call->id());
 	SignallingEvent* event = new SignallingEvent(SignallingEvent::NewCall,msg,call);
 	// (re)start RSC timer if not currently reseting
 	if (!m_rscCic && m_rscTimer.interval())
@@ -5098,7 +5100,7 @@ void SS7ISUP::processCallMsg(SS7MsgISUP* msg, const SS7Label& label, int sls)
 	if (reserveCircuit(circuit,0,flags,&s,true)) {
 	    call = new SS7ISUPCall(this,circuit,label.dpc(),label.opc(),false,label.sls(),
 		0,msg->type() == SS7MsgISUP::CCR);
-	    m_calls.append(call);
+	    appendCall(call,call->id());
 	    break;
 	}
 	// Congestion: send REL
@@ -5610,9 +5612,20 @@ bool SS7ISUP::blockCircuit(unsigned int cic, bool block, bool remote, bool hwFai
     return true;
 }
 
+// Find a call by circuit code
+// Calls are indexed by the code of their circuit, a call whose circuit was
+//  released is still indexed by the old code but no longer matches it
 SS7ISUPCall* SS7ISUP::findCall(unsigned int cic)
 {
-    for (ObjList* o = m_calls.skipNull(); o; o = o->skipNext()) {
+    if (!cic) {
+	for (ObjList* o = m_calls.skipNull(); o; o = o->skipNext()) {
+	    SS7ISUPCall* call = static_cast<SS7ISUPCall*>(o->get());
+	    if (!call->id())
+		return call;
+	}
+	return 0;
+    }
+    for (ObjList* o = indexedCalls(cic); o; o = o->skipNext()) {
 	SS7ISUPCall* call = static_cast<SS7ISUPCall*>(o->get());
 	if (call->id() == cic)
 	    return call;
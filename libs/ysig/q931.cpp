@@ -39,6 +39,12 @@ using namespace TelEngine;
 
 #define Q931_MSG_PROTOQ931 0x08          // Q.931 protocol discriminator in the message header
 
+// Build the call index key of a call reference and direction
+static inline u_int32_t callIndexKey(u_int32_t callRef, bool outgoing)
+{
+    return (callRef << 1) | (outgoing ? 1 : 0);
+}
+
 // Clear the bit 7 for each byte in a buffer
 static inline void clearBit7(const void* buffer, u_int32_t len)
 {
@@ -2486,7 +2492,7 @@ ISDNQ931::~ISDNQ931()
 {
     if (m_calls.count()) {
 	cleanup();
-	m_calls.clear();
+	clearCalls();
     }
     TelEngine::destruct(attach((ISDNLayer2*)0));
     TelEngine::destruct(SignallingCallControl::attach(0));
@@ -2779,7 +2785,7 @@ void ISDNQ931::receiveData(const DataBlock& data, u_int8_t tei, ISDNLayer2* laye
 	    String reason;
 	    if (acceptNewCall(false,reason)) {
 		call = new ISDNQ931Call(this,false,msg->callRef(),msg->callRefLen(),tei);
-		m_calls.append(call);
+		appendCall(call,callIndexKey(call->callRef(),false));
 		call->enqueue(msg);
 		msg = 0;
 		call = 0;
@@ -2892,7 +2898,7 @@ SignallingCall* ISDNQ931::call(SignallingMessage* msg, String& reason)
     m_callRef = (m_callRef + 1) & m_callRefMask;
     if (!m_callRef)
 	m_callRef = 1;
-    m_calls.append(call);
+    appendCall(call,callIndexKey(call->callRef(),true));
     SignallingEvent* event = new SignallingEvent(SignallingEvent::NewCall,msg,call);
     TelEngine::destruct(msg);
     call->sendEvent(event);
@@ -2973,7 +2979,7 @@ void ISDNQ931::timerTick(const Time& when)
 ISDNQ931Call* ISDNQ931::findCall(u_int32_t callRef, bool outgoing, u_int8_t tei)
 {
     Lock lock(this);
-    ObjList* obj = m_calls.skipNull();
+    ObjList* obj = indexedCalls(callIndexKey(callRef,outgoing));
     for (; obj; obj = obj->skipNext()) {
 	ISDNQ931Call* call = static_cast<ISDNQ931Call*>(obj->get());
 	if (callRef == call->callRef() && outgoing == call->outgoing()) {
@@ -3513,7 +3519,7 @@ ISDNQ931Monitor::~ISDNQ931Monitor()
     TelEngine::destruct(attach((ISDNQ921Passive*)0,false));
     TelEngine::destruct(attach((SignallingCircuitGroup*)0,true));
     TelEngine::destruct(attach((SignallingCircuitGroup*)0,false));
-    m_calls.clear();
+    clearCalls();
     DDebug(this,DebugAll,"ISDN Monitor destroyed [%p]",this);
 }
 
@@ -3637,7 +3643,7 @@ void ISDNQ931Monitor::receiveData(const DataBlock& data, u_int8_t tei, ISDNLayer
 	if (msg->initiator() && msg->type() == ISDNQ931Message::Setup) {
 	    lock();
 	    ISDNQ931CallMonitor* newMon = new ISDNQ931CallMonitor(this,msg->callRef(),m_q921Net == layer2);
-	    m_calls.append(newMon);
+	    appendCall(newMon,msg->callRef());
 	    unlock();
 	    newMon->enqueue(msg);
 	    msg = 0;
@@ -3793,9 +3799,8 @@ void ISDNQ931Monitor::processMsgRestart(ISDNQ931Message* msg)
 ISDNQ931CallMonitor* ISDNQ931Monitor::findMonitor(unsigned int value, bool byCallRef)
 {
     Lock lock(this);
-    ObjList* obj = m_calls.skipNull();
     if (byCallRef) {
-	for (; obj; obj = obj->skipNext()) {
+	for (ObjList* obj = indexedCalls(value); obj; obj = obj->skipNext()) {
 	    ISDNQ931CallMonitor* mon = static_cast<ISDNQ931CallMonitor*>(obj->get());
 	    if (value == mon->m_callRef)
 		return (mon->ref() ? mon : 0);
@@ -3803,7 +3808,7 @@ ISDNQ931CallMonitor* ISDNQ931Monitor::findMonitor(unsigned int value, bool byCal
 	return 0;
     }
     // Find by reserved circuit
-    for (; obj; obj = obj->skipNext()) {
+    for (ObjList* obj = m_calls.skipNull(); obj; obj = obj->skipNext()) {
 	ISDNQ931CallMonitor* mon = static_cast<ISDNQ931CallMonitor*>(obj->get());
 	if (mon->m_callerCircuit && value == mon->m_callerCircuit->code())
 	    return (mon->ref() ? mon : 0);
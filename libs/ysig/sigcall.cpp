@@ -27,6 +27,9 @@
 
 using namespace TelEngine;
 
+// Number of buckets in the call index of a call controller
+static const unsigned int s_callIndexSize = 1024;
+
 const TokenDict SignallingCircuit::s_lockNames[] = {
     {"localhw",            LockLocalHWFail},
     {"localmaint",         LockLocalMaint},
@@ -69,7 +72,8 @@ SignallingCallControl::SignallingCallControl(const NamedList& params,
       m_verifyTimer(0),
       m_circuits(0),
       m_strategy(SignallingCircuitGroup::Increment),
-      m_exiting(false)
+      m_exiting(false),
+      m_callIndex(0)
 {
     // Controller location
     m_location = params.getValue(YSTRING("location"));
@@ -105,6 +109,7 @@ SignallingCallControl::SignallingCallControl(const NamedList& params,
 SignallingCallControl::~SignallingCallControl()
 {
     attach((SignallingCircuitGroup*)0);
+    delete[] m_callIndex;
 }
 
 // Attach a signalling circuit group. Set its strategy
@@ -266,6 +271,8 @@ SignallingEvent* SignallingCallControl::getEvent(const Time& when)
 void SignallingCallControl::clearCalls()
 {
     lock();
+    for (ObjList* o = m_calls.skipNull(); o; o = o->skipNext())
+	unindexCall(static_cast<SignallingCall*>(o->get()));
     m_calls.clear();
     unlock();
 }
@@ -276,6 +283,7 @@ void SignallingCallControl::removeCall(SignallingCall* call, bool del)
     if (!call)
 	return;
     lock();
+    unindexCall(call);
     if (m_calls.remove(call,del))
 	DDebug(DebugAll,
 	    "SignallingCallControl. Call (%p) removed%s from queue [%p]",
@@ -283,6 +291,45 @@ void SignallingCallControl::removeCall(SignallingCall* call, bool del)
     unlock();
 }
 
+// Append a call to list and index it
+void SignallingCallControl::appendCall(SignallingCall* call, u_int32_t key)
+{
+    if (!call)
+	return;
+    Lock mylock(this);
+    m_calls.append(call);
+    reindexCall(call,key);
+}
+
+// Move a call to the index bucket of a new key
+void SignallingCallControl::reindexCall(SignallingCall* call, u_int32_t key)
+{
+    if (!call)
+	return;
+    Lock mylock(this);
+    unindexCall(call);
+    if (!m_callIndex)
+	m_callIndex = new ObjList[s_callIndexSize];
+    call->m_indexKey = key;
+    call->m_indexed = true;
+    m_callIndex[key % s_callIndexSize].append(call)->setDelete(false);
+}
+
+// Retrieve the index bucket of a key
+ObjList* SignallingCallControl::indexedCalls(u_int32_t key) const
+{
+    return m_callIndex ? m_callIndex[key % s_callIndexSize].skipNull() : 0;
+}
+
+// Remove a call from the index
+void SignallingCallControl::unindexCall(SignallingCall* call)
+{
+    if (!(call->m_indexed && m_callIndex))
+	return;
+    m_callIndex[call->m_indexKey % s_callIndexSize].remove(call,false);
+    call->m_indexed = false;
+}
+
 // Set the verify event flag. Restart/fire verify timer
 void SignallingCallControl::setVerify(bool restartTimer, bool fireNow, const Time* time)
 {
@@ -308,7 +355,9 @@ SignallingCall::SignallingCall(SignallingCallControl* controller, bool outgoing,
     m_outgoing(outgoing),
     m_signalOnly(signalOnly),
     m_inMsgMutex(true,"SignallingCall::inMsg"),
-    m_private(0)
+    m_private(0),
+    m_indexKey(0),
+    m_indexed(false)
 {
 }
 
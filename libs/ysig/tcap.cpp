@@ -25,6 +25,29 @@
 
 using namespace TelEngine;
 
+// Number of shards of the transaction table
+#define TCAP_SHARDS 16
+// Number of hash buckets in each shard
+#define TCAP_SHARD_BUCKETS 257
+// Number of slots in the expiry wheel of each shard
+#define TCAP_WHEEL_SLOTS 512
+// Time span of one expiry wheel slot in milliseconds
+#define TCAP_WHEEL_TICK 100
+
+// One shard of the transaction table with its own lock and expiry wheel
+class SS7TCAP::TransactionShard : public Mutex
+{
+public:
+    inline TransactionShard()
+	: Mutex(true,"TCAPTransactions"),
+	  m_transactions(TCAP_SHARD_BUCKETS), m_count(0), m_slot(0)
+	{ }
+    HashList m_transactions;                 // Transactions, each one referenced
+    unsigned int m_count;                    // Number of transactions
+    ObjList m_wheel[TCAP_WHEEL_SLOTS];       // Expiry wheel, transactions not referenced
+    u_int64_t m_slot;                        // Absolute index of the first slot to check
+};
+
 #ifdef DEBUG
 static void dumpData(int debugLevel, SS7TCAP* tcap, String message, void* obj, NamedList& params,
 		    DataBlock data = DataBlock::empty())
@@ -265,12 +288,16 @@ SS7TCAP::SS7TCAP(const NamedList& params)
       m_defaultRemotePC(0),
       m_remoteTypePC(SS7PointCode::Other),
       m_trTimeout(300),
+      m_shards(new TransactionShard[TCAP_SHARDS]),
       m_transactionsMtx(true,"TCAPTransactions"),
       m_tcapType(UnknownTCAP),
-      m_idsPool(0)
+      m_idsPool(0),
+      m_rateTime(0)
 {
     Debug(this,DebugAll,"SS7TCAP::SS7TCAP() [%p] created",this);
     m_recvMsgs = m_sentMsgs = m_discardMsgs = m_normalMsgs = m_abnormalMsgs = 0;
+    for (int i = 0; i < 4; i++)
+	m_trMsgs[i] = m_trMsgsLast[i] = m_trMsgsRate[i] = 0;
     m_ssnStatus = SCCPManagement::UserOutOfService;
 }
 
@@ -290,7 +317,12 @@ SS7TCAP::~SS7TCAP()
 	}
 	m_users.setDelete(false);
     }
-    m_transactions.clear();
+    for (int i = 0; i < TCAP_SHARDS; i++) {
+	for (int j = 0; j < TCAP_WHEEL_SLOTS; j++)
+	    m_shards[i].m_wheel[j].clear();
+	m_shards[i].m_transactions.clear();
+    }
+    delete[] m_shards;
     m_inQueue.clear();
 
 }
@@ -590,6 +622,15 @@ void SS7TCAP::status(NamedList& status)
     status.setParam("totalDiscarded",String(m_discardMsgs));
     status.setParam("totalNormal",String(m_normalMsgs));
     status.setParam("totalAbnormal",String(m_abnormalMsgs));
+    status.setParam("totalBegin",String(m_trMsgs[0]));
+    status.setParam("totalContinue",String(m_trMsgs[1]));
+    status.setParam("totalEnd",String(m_trMsgs[2]));
+    status.setParam("totalAbort",String(m_trMsgs[3]));
+    status.setParam("beginPerSecond",String(m_trMsgsRate[0]));
+    status.setParam("continuePerSecond",String(m_trMsgsRate[1]));
+    status.setParam("endPerSecond",String(m_trMsgsRate[2]));
+    status.setParam("abortPerSecond",String(m_trMsgsRate[3]));
+    status.setParam("transactions",String(transactionCount()));
 }
 
 void SS7TCAP::userStatus(NamedList& status)
@@ -597,22 +638,108 @@ void SS7TCAP::userStatus(NamedList& status)
     Debug(this,DebugStub,"Please implement SS7TCAP::userStatus()");
 }
 
+SS7TCAP::TransactionShard& SS7TCAP::shard(const String& tid) const
+{
+    return m_shards[tid.hash() % TCAP_SHARDS];
+}
+
+// Find a transaction. A caller changing it must schedule it when done
+//  so the timer tick sees the changed state and timers
 SS7TCAPTransaction* SS7TCAP::getTransaction(const String& tid)
 {
-    SS7TCAPTransaction* tr = 0;
-    Lock lock(m_transactionsMtx);
-    ObjList* o = m_transactions.find(tid);
-    if (o)
-	tr = static_cast<SS7TCAPTransaction*>(o->get());
-    if (tr && tr->ref())
-	return tr;
-    return 0;
+    TransactionShard& sh = shard(tid);
+    Lock lock(sh);
+    SS7TCAPTransaction* tr = static_cast<SS7TCAPTransaction*>(sh.m_transactions[tid]);
+    if (!(tr && tr->ref()))
+	return 0;
+    return tr;
+}
+
+void SS7TCAP::addTransaction(SS7TCAPTransaction* tr)
+{
+    if (!tr)
+	return;
+    TransactionShard& sh = shard(tr->toString());
+    Lock lock(sh);
+    if (tr->m_wheelSlot != -2 || !tr->ref())
+	return;
+    sh.m_transactions.append(tr);
+    sh.m_count++;
+    tr->m_wheelSlot = -1;
+    scheduleTransaction(tr,0);
 }
 
 void SS7TCAP::removeTransaction(SS7TCAPTransaction* tr)
 {
-    Lock lock(m_transactionsMtx);
-    m_transactions.remove(tr);
+    if (!tr)
+	return;
+    TransactionShard& sh = shard(tr->toString());
+    Lock lock(sh);
+    if (tr->m_wheelSlot == -2)
+	return;
+    if (tr->m_wheelSlot >= 0)
+	sh.m_wheel[tr->m_wheelSlot].remove(tr,false);
+    tr->m_wheelSlot = -2;
+    if (!sh.m_transactions.remove(tr,false,true))
+	return;
+    sh.m_count--;
+    lock.drop();
+    TelEngine::destruct(tr);
+}
+
+unsigned int SS7TCAP::transactionCount() const
+{
+    unsigned int count = 0;
+    for (int i = 0; i < TCAP_SHARDS; i++)
+	count += m_shards[i].m_count;
+    return count;
+}
+
+// Put a transaction in the expiry wheel of its shard, a zero due time means next timer tick.
+// A transaction already in the wheel is only moved to an earlier time, unless forced
+void SS7TCAP::scheduleTransaction(SS7TCAPTransaction* tr, u_int64_t due, bool force)
+{
+    TransactionShard& sh = shard(tr->toString());
+    Lock lock(sh);
+    if (tr->m_wheelSlot == -2)
+	return;
+    if (tr->m_wheelSlot >= 0) {
+	if (!force && tr->m_wheelDue <= due)
+	    return;
+	sh.m_wheel[tr->m_wheelSlot].remove(tr,false);
+    }
+    u_int64_t slot = (due + TCAP_WHEEL_TICK - 1) / TCAP_WHEEL_TICK;
+    if (slot < sh.m_slot)
+	slot = sh.m_slot;
+    tr->m_wheelDue = due;
+    tr->m_wheelSlot = (int)(slot % TCAP_WHEEL_SLOTS);
+    sh.m_wheel[tr->m_wheelSlot].append(tr)->setDelete(false);
+}
+
+void SS7TCAP::countPrimitive(int type)
+{
+    switch (type) {
+	case TC_Begin:
+	case TC_QueryWithPerm:
+	case TC_QueryWithoutPerm:
+	    incCounter(BeginMsgs);
+	    break;
+	case TC_Continue:
+	case TC_ConversationWithPerm:
+	case TC_ConversationWithoutPerm:
+	    incCounter(ContinueMsgs);
+	    break;
+	case TC_End:
+	case TC_Response:
+	    incCounter(EndMsgs);
+	    break;
+	case TC_U_Abort:
+	case TC_P_Abort:
+	    incCounter(AbortMsgs);
+	    break;
+	default:
+	    break;
+    }
 }
 
 void SS7TCAP::timerTick(const Time& when)
@@ -627,17 +754,53 @@ void SS7TCAP::timerTick(const Time& when)
 	msg = dequeue();
     }
 
-    // update/handle rest of transactions
-    Lock lock(m_transactionsMtx);
-    ListIterator iter(m_transactions);
+    u_int64_t now = when.msec();
+    // update the per second transaction counters
+    m_transactionsMtx.lock();
+    if (now >= m_rateTime + 1000) {
+	for (int i = 0; i < 4; i++) {
+	    unsigned int n = m_trMsgs[i];
+	    m_trMsgsRate[i] = m_rateTime ?
+		(unsigned int)((u_int64_t)(n - m_trMsgsLast[i]) * 1000 / (now - m_rateTime)) : 0;
+	    m_trMsgsLast[i] = n;
+	}
+	m_rateTime = now;
+    }
+    m_transactionsMtx.unlock();
+
+    // collect transactions that are due from the expiry wheels
+    ObjList due;
+    u_int64_t slot = now / TCAP_WHEEL_TICK;
+    for (int i = 0; i < TCAP_SHARDS; i++) {
+	TransactionShard& sh = m_shards[i];
+	Lock lock(sh);
+	u_int64_t s = sh.m_slot;
+	if (s + TCAP_WHEEL_SLOTS <= slot)
+	    s = slot + 1 - TCAP_WHEEL_SLOTS;
+	// the current slot is checked again on next tick
+	for (; s <= slot; s++) {
+	    ObjList* o = sh.m_wheel[s % TCAP_WHEEL_SLOTS].skipNull();
+	    while (o) {
+		SS7TCAPTransaction* tr = static_cast<SS7TCAPTransaction*>(o->get());
+		if (tr->m_wheelDue > now) {
+		    o = o->skipNext();
+		    continue;
+		}
+		o->remove(false);
+		tr->m_wheelSlot = -1;
+		if (tr->ref())
+		    due.append(tr);
+		o = o->skipNull();
+	    }
+	}
+	sh.m_slot = slot;
+    }
+
+    // update/handle the due transactions
     for (;;) {
-	SS7TCAPTransaction* tr = static_cast<SS7TCAPTransaction*>(iter.get());
-	// End of iteration?
+	SS7TCAPTransaction* tr = static_cast<SS7TCAPTransaction*>(due.remove(false));
 	if (!tr)
 	    break;
-	if (!tr->ref())
-	    continue;
-	lock.drop();
 	NamedList params("");
 	DataBlock data;
 	if (tr->transactionState() != SS7TCAPTransaction::Idle)
@@ -656,9 +819,13 @@ void SS7TCAP::timerTick(const Time& when)
 
 	if (tr->transactionState() == SS7TCAPTransaction::Idle)
 	    removeTransaction(tr);
+	else {
+	    // wait for the next timer or for a new message if there is none
+	    u_int64_t t = tr->nextTimeout();
+	    if (t)
+		scheduleTransaction(tr,t + 1);
+	}
 	TelEngine::destruct(tr);
-	if (!lock.acquire(m_transactionsMtx))
-	    break;
     }
 }
 
@@ -688,8 +855,10 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 	type = TC_Notice;
 	msgParams.setParam(s_tcapRequest,lookup(type,SS7TCAP::s_transPrimitives,"Notice"));
      }
-    else
+    else {
 	incCounter(SS7TCAP::IncomingMsgs);
+	countPrimitive(type);
+    }
 
     SS7TCAPTransaction* tr = 0;
     switch (type) {
@@ -702,10 +871,7 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 		String newID;
 		allocTransactionID(newID);
 		tr = buildTransaction(type,newID,msgParams,false);
-		tr->ref();
-		m_transactionsMtx.lock();
-		m_transactions.append(tr);
-		m_transactionsMtx.unlock();
+		addTransaction(tr);
 		msgParams.setParam(s_tcapLocalTID,newID);
 	    }
 	    break;
@@ -729,6 +895,7 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 	    transactError = tr->update((SS7TCAP::TCAPUserTransActions)type,msgParams,false);
 	    if (transactError.error() != SS7TCAPError::NoError) {
 		result = handleError(transactError,msgParams,msgData,tr);
+		scheduleTransaction(tr,0);
 		TelEngine::destruct(tr);
 		return result;
 	    }
@@ -741,6 +908,7 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 	transactError = tr->handleData(msgParams,msgData);
 	if (transactError.error() != SS7TCAPError::NoError) {
 	    result = handleError(transactError,msgParams,msgData,tr);
+	    scheduleTransaction(tr,0);
 	    TelEngine::destruct(tr);
 	    return result;
 	}
@@ -768,6 +936,8 @@ HandledMSU SS7TCAP::processSCCPData(SS7TCAPMessage* msg)
 	}
 	else
 	    tr->setState(SS7TCAPTransaction::Idle);
+	// let the timer tick handle the new state and timers
+	scheduleTransaction(tr,0);
 	TelEngine::destruct(tr);
     }
     result = HandledMSU::Accepted;
@@ -798,6 +968,7 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
     SS7TCAPTransaction* tr = 0;
     if (!TelEngine::null(req)) {
 	int type = req->toInteger(SS7TCAP::s_transPrimitives);
+	countPrimitive(type);
 	switch (type) {
 	    case SS7TCAP::TC_Unidirectional:
 	    case SS7TCAP::TC_Begin:
@@ -824,10 +995,7 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
 		tr = buildTransaction((SS7TCAP::TCAPUserTransActions)type,otid,params,true);
 		if (!TelEngine::null(user))
 		    tr->setUserName(user);
-		tr->ref();
-		m_transactionsMtx.lock();
-		m_transactions.append(tr);
-		m_transactionsMtx.unlock();
+		addTransaction(tr);
 		break;
 	    case SS7TCAP::TC_Continue:
 	    case SS7TCAP::TC_ConversationWithPerm:
@@ -845,6 +1013,7 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
 		    }
 		    error = tr->update((SS7TCAP::TCAPUserTransActions)type,params);
 		    if (error.error() != SS7TCAPError::NoError) {
+			scheduleTransaction(tr,0);
 			TelEngine::destruct(tr);
 			return error;
 		    }
@@ -871,11 +1040,13 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
     if (tr) {
 	error = tr->handleDialogPortion(params,true);
 	if (error.error() != SS7TCAPError::NoError) {
+	    scheduleTransaction(tr,0);
 	    TelEngine::destruct(tr);
 	    return error;
 	}
 	error = tr->handleComponents(params,true);
 	if (error.error() != SS7TCAPError::NoError) {
+	    scheduleTransaction(tr,0);
 	    TelEngine::destruct(tr);
 	    return error;
 	}
@@ -886,6 +1057,8 @@ SS7TCAPError SS7TCAP::userRequest(NamedList& params)
 	}
 	else if (tr->transmitState() == SS7TCAPTransaction::NoTransmit)
 	    removeTransaction(tr);
+	// let the timer tick handle any change done concurrently with it
+	scheduleTransaction(tr,0);
 	TelEngine::destruct(tr);
     }
     return error;
@@ -1223,7 +1396,8 @@ SS7TCAPTransaction::SS7TCAPTransaction(SS7TCAP* tcap, SS7TCAP::TCAPUserTransActi
 	const String& transactID, NamedList& params, u_int64_t timeout, bool initLocal)
     : Mutex(true,"TcapTransaction"),
       m_tcap(tcap), m_tcapType(SS7TCAP::UnknownTCAP), m_userName(""), m_localID(transactID), m_type(type),
-      m_localSCCPAddr(""), m_remoteSCCPAddr(""), m_basicEnd(true), m_endNow(false), m_timeout(timeout)
+      m_localSCCPAddr(""), m_remoteSCCPAddr(""), m_basicEnd(true), m_endNow(false), m_timeout(timeout),
+      m_wheelDue(0), m_wheelSlot(-2)
 {
 
     DDebug(m_tcap,DebugAll,"SS7TCAPTransaction(tcap = '%s' [%p], transactID = %s) created [%p]",
@@ -1462,6 +1636,18 @@ void SS7TCAPTransaction::transactionData(NamedList& params)
 #endif
 }
 
+u_int64_t SS7TCAPTransaction::nextTimeout()
+{
+    Lock l(this);
+    u_int64_t t = m_timeout.fireTime();
+    for (ObjList* o = m_components.skipNull(); o; o = o->skipNext()) {
+	u_int64_t c = static_cast<SS7TCAPComponent*>(o->get())->timeoutTime();
+	if (c && (!t || c < t))
+	    t = c;
+    }
+    return t;
+}
+
 void SS7TCAPTransaction::checkComponents()
 {
     NamedList params("");
@@ -1856,7 +2042,7 @@ SS7TCAPANSI::SS7TCAPANSI(const NamedList& params)
 SS7TCAPANSI::~SS7TCAPANSI()
 {
     DDebug(this,DebugAll,"SS7TCAPANSI::~SS7TCAPANSI() [%p] destroyed with %d transactions, refCount=%d",
-		this,m_transactions.count(),refcount());
+		this,transactionCount(),refcount());
 }
 
 SS7TCAPTransaction* SS7TCAPANSI::buildTransaction(SS7TCAP::TCAPUserTransActions type, const String& transactID, NamedList& params,
@@ -3103,7 +3289,7 @@ SS7TCAPITU::SS7TCAPITU(const NamedList& params)
 SS7TCAPITU::~SS7TCAPITU()
 {
     DDebug(this,DebugAll,"SS7TCAPITU::~SS7TCAPITU() [%p] destroyed with %d transactions, refCount=%d",
-	this,m_transactions.count(),refcount());
+	this,transactionCount(),refcount());
 }
 
 SS7TCAPTransaction* SS7TCAPITU::buildTransaction(SS7TCAP::TCAPUserTransActions type, const String& transactID, NamedList& params,
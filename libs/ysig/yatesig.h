@@ -1234,6 +1234,31 @@ protected:
      */
     void removeCall(SignallingCall* call, bool del = false);
 
+    /**
+     * Append a call to the list and index it by a numeric key.
+     * This method is thread safe
+     * @param call The call to append
+     * @param key Key used to find the call later (circuit code, call reference)
+     */
+    void appendCall(SignallingCall* call, u_int32_t key);
+
+    /**
+     * Change the key a call from the list is indexed by.
+     * This method is thread safe
+     * @param call The call to reindex
+     * @param key The new key of the call
+     */
+    void reindexCall(SignallingCall* call, u_int32_t key);
+
+    /**
+     * Retrieve the bucket of the call index holding a given key.
+     * A bucket is shared by several keys so each call must be checked.
+     * The controller must be locked while using the returned list
+     * @param key The key to look for
+     * @return First non empty entry of the bucket, NULL if there are no candidates
+     */
+    ObjList* indexedCalls(u_int32_t key) const;
+
     /**
      * Set the verify event flag. Restart/fire verify timer
      * @param restartTimer True to restart/fire the timer
@@ -1280,9 +1305,11 @@ protected:
     static const TokenDict s_mediaRequired[];
 
 private:
+    void unindexCall(SignallingCall* call);
     SignallingCircuitGroup* m_circuits;  // Circuit group
     int m_strategy;                      // Strategy to allocate circuits for outgoing calls
     bool m_exiting;                      // Call control is terminating. Generate a Disable event when no more calls
+    ObjList* m_callIndex;                // Buckets of calls indexed by key, not owning them
 };
 
 /**
@@ -1291,6 +1318,7 @@ private:
  */
 class YSIG_API SignallingCall : public RefObject, public Mutex
 {
+    friend class SignallingCallControl;
 public:
     /**
      * Constructor
@@ -1412,6 +1440,8 @@ private:
     ObjList m_inMsg;                     // Incoming messages queue
     Mutex m_inMsgMutex;                  // Lock incoming messages queue
     void* m_private;                     // Private user data
+    u_int32_t m_indexKey;                // Key in the controller's call index
+    bool m_indexed;                      // Call is present in the controller's call index
 };
 
 /**
@@ -10850,6 +10880,10 @@ public:
 	DiscardedMsgs,
 	NormalMsgs,
 	AbnormalMsgs,
+	BeginMsgs,
+	ContinueMsgs,
+	EndMsgs,
+	AbortMsgs,
     };
 
     /**
@@ -11002,12 +11036,24 @@ public:
      */
     SS7TCAPTransaction* getTransaction(const String& tid);
 
+    /**
+     * Add a transaction to the transaction table, the table keeps its own reference
+     * @param tr The transaction to add
+     */
+    void addTransaction(SS7TCAPTransaction* tr);
+
     /**
      * Remove transaction
      * @param tr The transaction to remove
      */
     void removeTransaction(SS7TCAPTransaction* tr);
 
+    /**
+     * Get the number of transactions in the transaction table
+     * @return Number of current transactions
+     */
+    unsigned int transactionCount() const;
+
     /**
      * Method called periodically to do processing and timeout checks
      * @param when Time to use as computing base for events and timeouts
@@ -11080,6 +11126,12 @@ public:
 	    case AbnormalMsgs:
 		m_abnormalMsgs++;
 		break;
+	    case BeginMsgs:
+	    case ContinueMsgs:
+	    case EndMsgs:
+	    case AbortMsgs:
+		m_trMsgs[counterType - BeginMsgs]++;
+		break;
 	    default:
 		break;
 	}
@@ -11103,6 +11155,11 @@ public:
 		return m_normalMsgs;
 	    case AbnormalMsgs:
 		return m_abnormalMsgs;
+	    case BeginMsgs:
+	    case ContinueMsgs:
+	    case EndMsgs:
+	    case AbortMsgs:
+		return m_trMsgs[counterType - BeginMsgs];
 	    default:
 		break;
 	}
@@ -11160,9 +11217,11 @@ protected:
     SS7PointCode::Type m_remoteTypePC;
     u_int64_t m_trTimeout;
 
-    // list of current TCAP transactions
+    // table of current TCAP transactions, split in shards by transaction ID
+    class TransactionShard;
+    TransactionShard* m_shards;
+    // protects the IDs pool and per second counters
     Mutex m_transactionsMtx;
-    ObjList m_transactions;
     // type of TCAP
     TCAPType m_tcapType;
 
@@ -11175,9 +11234,19 @@ protected:
     unsigned int m_discardMsgs;
     unsigned int m_normalMsgs;
     unsigned int m_abnormalMsgs;
+    // begin, continue, end and abort totals, last second snapshot and rate
+    unsigned int m_trMsgs[4];
+    unsigned int m_trMsgsLast[4];
+    unsigned int m_trMsgsRate[4];
+    u_int64_t m_rateTime;
 
     // Subsystem Status
     SCCPManagement::LocalBroadcast m_ssnStatus;
+
+private:
+    TransactionShard& shard(const String& tid) const;
+    void scheduleTransaction(SS7TCAPTransaction* tr, u_int64_t due, bool force = false);
+    void countPrimitive(int type);
 };
 
 class YSIG_API SS7TCAPError
@@ -11309,6 +11378,7 @@ private:
  */
 class YSIG_API SS7TCAPTransaction : public RefObject, public Mutex
 {
+    friend class SS7TCAP;
 public:
     enum TransactionState {
 	Idle                      = 0,
@@ -11517,6 +11587,12 @@ public:
     inline bool timedOut()
 	{ return m_timeout.timeout(); }
 
+    /**
+     * Retrieve the earliest time a component or the transaction itself times out
+     * @return Time in milliseconds, 0 if no timer is running
+     */
+    u_int64_t nextTimeout();
+
     /**
      * Find a component with given id
      * @param id Id of component to find
@@ -11585,6 +11661,10 @@ protected:
     bool m_basicEnd; // basic or prearranged end (specified by user when sending a Response)
     bool m_endNow; // delete immediately after sending
     SignallingTimer m_timeout;
+
+private:
+    u_int64_t m_wheelDue; // time this transaction is due in TCAP's expiry wheel
+    int m_wheelSlot; // expiry wheel slot holding this transaction, -1 if none
 };
 
 /**
@@ -11694,6 +11774,13 @@ public:
     inline bool timedOut()
 	{ return m_opTimer.timeout(); }
 
+    /**
+     * Get the time the operation timer of the component fires
+     * @return Timeout in milliseconds, 0 if the timer is not started
+     */
+    inline u_int64_t timeoutTime() const
+	{ return m_opTimer.fireTime(); }
+
     /**
      * Set component state
      * @param state The state to be set
@@ -29,6 +29,10 @@
 
 using namespace TelEngine;
 
+// Timer wheel size and time covered by each slot in microseconds
+#define SIP_TIMER_SLOTS 1024
+#define SIP_TIMER_SLICE 10000
+
 static TokenDict sip_responses[] = {
     { "Trying", 100 },
     { "Ringing", 180 },
@@ -110,6 +114,42 @@ static TokenDict sip_responses[] = {
 
 TokenDict* TelEngine::SIPResponses = sip_responses;
 
+// Entry in a transaction lookup index, the string holds the key
+class SIPTransIndex : public String
+{
+public:
+    inline SIPTransIndex(const String& key, SIPTransaction* trans)
+	: String(key), m_trans(trans)
+	{ }
+    inline SIPTransaction* trans() const
+	{ return m_trans; }
+private:
+    SIPTransaction* m_trans;
+};
+
+// Add a transaction to an index keeping the relative order of the list
+static void addIndex(HashList& index, const String& key, SIPTransaction* trans, bool first)
+{
+    SIPTransIndex* idx = new SIPTransIndex(key,trans);
+    ObjList* l = first ? index.getHashList(idx->hash()) : 0;
+    if (l)
+	l->insert(idx);
+    else
+	index.append(idx);
+}
+
+// Remove a transaction from an index
+static void removeIndex(HashList& index, const String& key, SIPTransaction* trans)
+{
+    for (ObjList* l = index.getHashList(key); l; l = l->next()) {
+	SIPTransIndex* idx = static_cast<SIPTransIndex*>(l->get());
+	if (idx && (idx->trans() == trans)) {
+	    l->remove();
+	    return;
+	}
+    }
+}
+
 SIPParty::SIPParty(Mutex* mutex)
     : m_mutex(mutex), m_reliable(false), m_localPort(0), m_partyPort(0)
 {
@@ -169,6 +209,7 @@ SIPEvent::~SIPEvent()
 
 SIPEngine::SIPEngine(const char* userAgent)
     : Mutex(true,"SIPEngine"),
+      m_transByBranch(1021), m_transByCallId(1021),
       m_t1(500000), m_t4(5000000), m_reqTransCount(5), m_rspTransCount(6),
       m_maxForwards(70),
       m_flags(0), m_lazyTrying(false),
@@ -176,6 +217,11 @@ SIPEngine::SIPEngine(const char* userAgent)
       m_nonce_mutex(false,"SIPEngine::nonce"),
       m_autoChangeParty(false)
 {
+    m_readyAppend = &m_transReady;
+    m_timerSlots = new ObjList[SIP_TIMER_SLOTS];
+    m_timerTick = Time::now() / SIP_TIMER_SLICE;
+    m_timerWoken = 0;
+    m_timerLast = m_timerMax = 0;
     debugName("sipengine");
     DDebug(this,DebugInfo,"SIPEngine::SIPEngine() [%p]",this);
     m_seq = new SIPSequence;
@@ -191,6 +237,9 @@ SIPEngine::SIPEngine(const char* userAgent)
 SIPEngine::~SIPEngine()
 {
     DDebug(this,DebugInfo,"SIPEngine::~SIPEngine() [%p]",this);
+    // transactions must go away while the timer wheel still exists
+    clearTransactions();
+    delete[] m_timerSlots;
 }
 
 SIPTransaction* SIPEngine::addMessage(SIPParty* ep, const char* buf, int len)
@@ -229,20 +278,36 @@ SIPTransaction* SIPEngine::addMessage(SIPMessage* message, bool* autoChangeParty
 	branch = *br;
     Lock lock(this);
     SIPTransaction* forked = 0;
-    ObjList* l = &m_transList;
-    for (; l; l = l->next()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	if (!t)
-	    continue;
-	switch (t->processMessage(message,branch)) {
-	    case SIPTransaction::Matched:
-		return t;
-	    case SIPTransaction::NoDialog:
-		forked = t;
-		break;
-	    case SIPTransaction::NoMatch:
-	    default:
+    // a branch can match only the transactions sharing it, all others
+    //  (no branch messages, ACK for incoming INVITE) must match the Call-ID
+    for (int i = 0; i < 2; i++) {
+	const String* key = &branch;
+	if (i) {
+	    if (branch && !message->isACK())
 		break;
+	    key = &message->getHeaderValue("Call-ID");
+	}
+	else if (!branch)
+	    continue;
+	ObjList* l = (i ? m_transByCallId : m_transByBranch).getHashList(*key);
+	for (; l; l = l->next()) {
+	    SIPTransIndex* idx = static_cast<SIPTransIndex*>(l->get());
+	    if (!idx || (*idx != *key))
+		continue;
+	    SIPTransaction* t = idx->trans();
+	    // already checked when looking up the branch
+	    if (i && branch && (t->getBranch() == branch))
+		continue;
+	    switch (t->processMessage(message,branch)) {
+		case SIPTransaction::Matched:
+		    return t;
+		case SIPTransaction::NoDialog:
+		    forked = t;
+		    break;
+		case SIPTransaction::NoMatch:
+		default:
+		    break;
+	    }
 	}
     }
     if (forked)
@@ -280,10 +345,11 @@ bool SIPEngine::process()
 SIPEvent* SIPEngine::getEvent()
 {
     Lock lock(this);
-    ObjList* l = m_transList.skipNull();
+    u_int64_t time = Time::now();
+    checkTimers(time);
+    ObjList* l = m_transReady.skipNull();
     if (!l)
 	return 0;
-    u_int64_t time = Time::now();
     for (; l; l = l->skipNext()) {
 	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
 	SIPEvent* e = t->getEvent(true,time);
@@ -291,25 +357,182 @@ SIPEvent* SIPEngine::getEvent()
 	    DDebug(this,DebugInfo,"Got pending event %p (state %s) from transaction %p [%p]",
 		e,SIPTransaction::stateName(e->getState()),t,this);
 	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
+		removeTransaction(t,true);
 	    return e;
 	}
     }
     time = Time::now();
-    for (l = m_transList.skipNull(); l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    while (m_transReady.get() || m_transReady.next()) {
+	if (m_transReady.next() == m_readyAppend)
+	    m_readyAppend = &m_transReady;
+	SIPTransaction* t = static_cast<SIPTransaction*>(m_transReady.remove(false));
+	if (!t)
+	    continue;
+	// the transaction gets back in the ready list if it changes
+	t->m_ready = false;
 	SIPEvent* e = t->getEvent(false,time);
+	transactionTimer(t);
 	if (e) {
 	    DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
 		e,SIPTransaction::stateName(e->getState()),t,this);
 	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
+		removeTransaction(t,true);
+	    else
+		transactionReady(t);
 	    return e;
 	}
     }
     return 0;
 }
 
+void SIPEngine::transactionReady(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    if (!transaction->m_listed || transaction->m_ready)
+	return;
+    transaction->m_ready = true;
+    m_readyAppend = m_readyAppend->append(transaction);
+    m_readyAppend->setDelete(false);
+}
+
+void SIPEngine::transactionTimer(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    if (transaction->m_timerSlot >= 0) {
+	m_timerSlots[transaction->m_timerSlot].remove(transaction,false);
+	transaction->m_timerSlot = -1;
+    }
+    if (!(transaction->m_listed && transaction->m_timeout))
+	return;
+    u_int64_t tick = transaction->m_timeout / SIP_TIMER_SLICE;
+    // already expired timers are checked at the next event retrieval
+    if (tick < m_timerTick)
+	tick = m_timerTick;
+    transaction->m_timerSlot = (int)(tick % SIP_TIMER_SLOTS);
+    m_timerSlots[transaction->m_timerSlot].append(transaction)->setDelete(false);
+}
+
+void SIPEngine::checkTimers(u_int64_t time)
+{
+    u_int64_t tick = time / SIP_TIMER_SLICE;
+    unsigned int woken = 0;
+    // the current slot is checked again next time as it may hold later timers
+    for (unsigned int n = 0; (m_timerTick <= tick) && (n < SIP_TIMER_SLOTS); n++) {
+	ObjList* l = m_timerSlots[m_timerTick % SIP_TIMER_SLOTS].skipNull();
+	while (l) {
+	    SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	    if (t->m_timeout > time) {
+		l = l->skipNext();
+		continue;
+	    }
+	    l->remove(false);
+	    l = l->skipNull();
+	    t->m_timerSlot = -1;
+	    transactionReady(t);
+	    woken++;
+	}
+	if (m_timerTick == tick)
+	    break;
+	m_timerTick++;
+    }
+    if (m_timerTick < tick)
+	m_timerTick = tick;
+    if (!woken)
+	return;
+    XDebug(this,DebugAll,"Timers expired for %u transactions [%p]",woken,this);
+    m_timerWoken += woken;
+    m_timerLast = woken;
+    if (m_timerMax < woken)
+	m_timerMax = woken;
+}
+
+void SIPEngine::getTimerStats(u_int64_t& total, unsigned int& last, unsigned int& max)
+{
+    Lock lock(this);
+    total = m_timerWoken;
+    last = m_timerLast;
+    max = m_timerMax;
+}
+
+void SIPEngine::remove(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    removeTransaction(transaction,false);
+}
+
+void SIPEngine::append(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    m_transList.append(transaction);
+    transaction->m_listed = true;
+    transactionReady(transaction);
+    transactionTimer(transaction);
+    addIndex(m_transByBranch,transaction->getBranch(),transaction,false);
+    addIndex(m_transByCallId,transaction->getCallID(),transaction,false);
+}
+
+void SIPEngine::insert(SIPTransaction* transaction)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    m_transList.insert(transaction);
+    transaction->m_listed = true;
+    transactionReady(transaction);
+    transactionTimer(transaction);
+    addIndex(m_transByBranch,transaction->getBranch(),transaction,true);
+    addIndex(m_transByCallId,transaction->getCallID(),transaction,true);
+}
+
+void SIPEngine::changedBranch(SIPTransaction* transaction, const String& oldBranch)
+{
+    if (!transaction)
+	return;
+    Lock lock(this);
+    if (!m_transList.find(transaction))
+	return;
+    removeIndex(m_transByBranch,oldBranch,transaction);
+    addIndex(m_transByBranch,transaction->getBranch(),transaction,false);
+}
+
+void SIPEngine::clearTransactions()
+{
+    Lock lock(this);
+    for (ObjList* l = m_transList.skipNull(); l; l = l->skipNext()) {
+	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	t->m_listed = t->m_ready = false;
+	t->m_timerSlot = -1;
+    }
+    m_transReady.clear();
+    m_readyAppend = &m_transReady;
+    for (unsigned int i = 0; i < SIP_TIMER_SLOTS; i++)
+	m_timerSlots[i].clear();
+    m_transByBranch.clear();
+    m_transByCallId.clear();
+    m_transList.clear();
+}
+
+void SIPEngine::removeTransaction(SIPTransaction* transaction, bool delobj)
+{
+    transaction->m_listed = false;
+    if (transaction->m_ready) {
+	// leave a hole in the ready list, it is skipped when retrieving events
+	ObjList* l = m_transReady.find(transaction);
+	if (l)
+	    l->set(0,false);
+	transaction->m_ready = false;
+    }
+    transactionTimer(transaction);
+    if (!m_transList.remove(transaction,false))
+	return;
+    removeIndex(m_transByBranch,transaction->getBranch(),transaction);
+    removeIndex(m_transByCallId,transaction->getCallID(),transaction);
+    if (delobj)
+	TelEngine::destruct(transaction);
+}
+
 void SIPEngine::processEvent(SIPEvent *event)
 {
     if (!event)
@@ -519,14 +742,8 @@ int SIPEngine::authUser(const SIPMessage* message, String& user, bool proxy, Gen
     long bestAge = -1;
     String bestNonce;
     const char* hdr = proxy ? "Proxy-Authorization" : "Authorization";
-    const ObjList* l = &message->header;
-    for (; l; l = l->next()) {
-	const GenObject* o = l->get();
-	if (!o)
-	    continue;
-	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(o->getObject(YATOM("MimeHeaderLine")));
-	if (!t || (t->name() |= hdr))
-	    continue;
+    const MimeHeaderLine* t = 0;
+    while ((t = message->getNextHeader(hdr,t))) {
 	// remember this line for foreign authentication
 	if (!authLine)
 	    authLine = t;
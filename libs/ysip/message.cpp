@@ -28,6 +28,142 @@
 using namespace TelEngine;
 
 static Regexp s_angled("<\\([^>]\\+\\)>");
+// Serializes building header lines of lazily parsed messages from const accessors
+static Mutex s_lazyMutex(false,"SIPLazyHeaders");
+
+namespace TelEngine {
+
+// Header line of a lazily parsed message, kept as offsets in the received bytes
+struct SIPHeaderSpan
+{
+    unsigned int name;                   // Name offset
+    unsigned int nameLen;                // Name length
+    unsigned int value;                  // Value offset
+    unsigned int valueLen;               // Value length
+    const char* fullName;                // Full name of a compact form header
+    MimeHeaderLine* line;                // Header line once built
+};
+
+// Header lines index of a lazily parsed message
+class SIPLazyHeaders
+{
+public:
+    inline SIPLazyHeaders()
+	: m_headersLen(0), m_spans(0), m_count(0), m_size(0)
+	{}
+    ~SIPLazyHeaders();
+    // Append an empty header line to the index
+    SIPHeaderSpan& append();
+    // Check if a header line has the given name
+    bool matches(unsigned int idx, const char* name, unsigned int len) const;
+    // Retrieve a header line, build it on first request
+    MimeHeaderLine* line(unsigned int idx);
+    // Find the index of a built header line
+    int find(const MimeHeaderLine* line) const;
+
+    DataBlock m_raw;                     // Received bytes: headers, empty line and body
+    unsigned int m_headersLen;           // Length of the first line and header lines
+    SIPHeaderSpan* m_spans;              // Header lines in received order
+    unsigned int m_count;                // Number of header lines
+    unsigned int m_size;                 // Allocated header lines
+};
+
+}; // namespace TelEngine
+
+// Build a header line of proper type
+static MimeHeaderLine* buildHeaderLine(const String& name, const String& value)
+{
+    if ((name &= "WWW-Authenticate") ||
+	(name &= "Proxy-Authenticate") ||
+	(name &= "Authorization") ||
+	(name &= "Proxy-Authorization"))
+	return new MimeAuthLine(name,value);
+    return new MimeHeaderLine(name,value);
+}
+
+// Header lines are built and the lazy index released only with s_lazyMutex held
+static inline SIPLazyHeaders* loadLazy(SIPLazyHeaders* const& lazy)
+{
+#ifdef __ATOMIC_ACQUIRE
+    return __atomic_load_n(&lazy,__ATOMIC_ACQUIRE);
+#else
+    SIPLazyHeaders* tmp = *const_cast<SIPLazyHeaders* const volatile*>(&lazy);
+    __sync_synchronize();
+    return tmp;
+#endif
+}
+
+static inline void storeLazy(SIPLazyHeaders*& lazy, SIPLazyHeaders* value)
+{
+#ifdef __ATOMIC_RELEASE
+    __atomic_store_n(&lazy,value,__ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+    lazy = value;
+#endif
+}
+
+static inline bool isHeaderBlank(char c)
+{
+    return (c == ' ') || (c == '\t');
+}
+
+SIPLazyHeaders::~SIPLazyHeaders()
+{
+    for (unsigned int i = 0; i < m_count; i++)
+	TelEngine::destruct(m_spans[i].line);
+    delete[] m_spans;
+}
+
+SIPHeaderSpan& SIPLazyHeaders::append()
+{
+    if (m_count >= m_size) {
+	m_size = m_size ? 2 * m_size : 16;
+	SIPHeaderSpan* spans = new SIPHeaderSpan[m_size];
+	if (m_count)
+	    ::memcpy(spans,m_spans,m_count * sizeof(SIPHeaderSpan));
+	delete[] m_spans;
+	m_spans = spans;
+    }
+    SIPHeaderSpan& span = m_spans[m_count++];
+    span.fullName = 0;
+    span.line = 0;
+    return span;
+}
+
+bool SIPLazyHeaders::matches(unsigned int idx, const char* name, unsigned int len) const
+{
+    const SIPHeaderSpan& s = m_spans[idx];
+    if (s.line)
+	return s.line->name() &= name;
+    if (s.fullName)
+	return !::strcasecmp(s.fullName,name);
+    return (s.nameLen == len) &&
+	!::strncasecmp((const char*)m_raw.data() + s.name,name,len);
+}
+
+MimeHeaderLine* SIPLazyHeaders::line(unsigned int idx)
+{
+    SIPHeaderSpan& s = m_spans[idx];
+    if (!s.line) {
+	const char* buf = (const char*)m_raw.data();
+	String name;
+	if (s.fullName)
+	    name = s.fullName;
+	else
+	    name.assign(buf + s.name,s.nameLen);
+	s.line = buildHeaderLine(name,String(buf + s.value,s.valueLen));
+    }
+    return s.line;
+}
+
+int SIPLazyHeaders::find(const MimeHeaderLine* line) const
+{
+    for (unsigned int i = 0; i < m_count; i++)
+	if (m_spans[i].line == line)
+	    return i;
+    return -1;
+}
 
 SIPMessage::SIPMessage(const SIPMessage& original)
     : RefObject(),
@@ -36,7 +172,7 @@ SIPMessage::SIPMessage(const SIPMessage& original)
       body(0), msgTraceId(original.msgTraceId), msgPrint(true), m_ep(0),
       m_valid(original.isValid()), m_answer(original.isAnswer()),
       m_outgoing(original.isOutgoing()), m_ack(original.isACK()),
-      m_cseq(-1), m_flags(original.getFlags()), m_dontSend(original.m_dontSend)
+      m_cseq(-1), m_flags(original.getFlags()), m_dontSend(original.m_dontSend), m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(&%p) [%p]",
 	&original,this);
@@ -45,7 +181,7 @@ SIPMessage::SIPMessage(const SIPMessage& original)
     setParty(original.getParty());
     setSequence(original.getSequence());
     bool via1 = true;
-    const ObjList* l = &original.header;
+    const ObjList* l = &original.headerList();
     for (; l; l = l->next()) {
 	const MimeHeaderLine* hl = static_cast<MimeHeaderLine*>(l->get());
 	if (!hl)
@@ -67,16 +203,16 @@ SIPMessage::SIPMessage(const char* _method, const char* _uri, const char* _versi
     : version(_version), method(_method), uri(_uri), code(0),
       body(0), msgPrint(true), m_ep(0), m_valid(true),
       m_answer(false), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage('%s','%s','%s') [%p]",
 	_method,_uri,_version,this);
 }
 
-SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen)
+SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen, bool lazy)
     : code(0), body(0), msgPrint(true), m_ep(ep), m_valid(false),
       m_answer(false), m_outgoing(false), m_ack(false), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_lazy(0)
 {
     DDebug(DebugInfo,"SIPMessage::SIPMessage(%p,%d) [%p]\r\n------\r\n%s------",
 	buf,len,this,buf);
@@ -88,14 +224,14 @@ SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bod
     }
     if (len < 0)
 	len = ::strlen(buf);
-    m_valid = parse(buf,len,bodyLen);
+    m_valid = parse(buf,len,bodyLen,lazy);
 }
 
 SIPMessage::SIPMessage(const SIPMessage* message, int _code, const char* _reason)
     : code(_code), body(0), msgPrint(true),
       m_ep(0), m_valid(false),
       m_answer(true), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(%p,%d,'%s') [%p]",
 	message,_code,_reason,this);
@@ -126,7 +262,7 @@ SIPMessage::SIPMessage(const SIPMessage* original, const SIPMessage* answer)
     : method("ACK"), code(0),
       body(0), msgPrint(true), m_ep(0), m_valid(false),
       m_answer(false), m_outgoing(true), m_ack(true), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_lazy(0)
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(%p,%p) [%p]",original,answer,this);
     if (!(original && original->isValid()))
@@ -188,6 +324,8 @@ SIPMessage::~SIPMessage()
 {
     DDebug(DebugAll,"SIPMessage::~SIPMessage() [%p]",this);
     m_valid = false;
+    delete m_lazy;
+    m_lazy = 0;
     setParty();
     setBody();
 }
@@ -200,6 +338,8 @@ void SIPMessage::complete(SIPEngine* engine, const char* user, const char* domai
 	isOutgoing() ? " OUT" : "",
 	isAnswer() ? " ANS" : "",
 	this);
+    // Header lines are changed in place below
+    expandHeaders();
     if (!engine)
 	return;
     if (-1 == flags)
@@ -375,13 +515,10 @@ int SIPMessage::copyAllHeaders(const SIPMessage* message, const char* name, cons
     if (!(message && name && *name))
 	return 0;
     int c = 0;
-    const ObjList* l = &message->header;
-    for (; l; l = l->next()) {
-	const MimeHeaderLine* hl = static_cast<const MimeHeaderLine*>(l->get());
-	if (hl && (hl->name() &= name)) {
-	    ++c;
-	    header.append(hl->clone(newName));
-	}
+    const MimeHeaderLine* hl = 0;
+    while ((hl = message->getNextHeader(name,hl))) {
+	++c;
+	header.append(hl->clone(newName));
     }
     return c;
 }
@@ -422,11 +559,13 @@ bool SIPMessage::parseFirst(String& line)
     return true;
 }
 
-bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
+bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen, bool lazy)
 {
-    DDebug(DebugAll,"SIPMessage::parse(%p,%d) [%p]",buf,len,this);
+    DDebug(DebugAll,"SIPMessage::parse(%p,%d,%s) [%p]",buf,len,String::boolText(lazy),this);
     String* line = 0;
+    const char* start = buf;
     while (len > 0) {
+	start = buf;
 	line = MimeBody::getUnfoldedLine(buf,len);
 	if (!line->null())
 	    break;
@@ -441,7 +580,11 @@ bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
     }
     line->destruct();
     int clen = -1;
-    while (len > 0) {
+    if (lazy) {
+	if (!parseLazy(buf,len,start,clen))
+	    return false;
+    }
+    while (!lazy && len > 0) {
 	line = MimeBody::getUnfoldedLine(buf,len);
 	if (line->null()) {
 	    // Found end of headers
@@ -463,14 +606,7 @@ bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
 	*line >> ":";
 	line->trimBlanks();
 	XDebug(DebugAll,"SIPMessage::parse header='%s' value='%s'",name.c_str(),line->c_str());
-
-	if ((name &= "WWW-Authenticate") ||
-	    (name &= "Proxy-Authenticate") ||
-	    (name &= "Authorization") ||
-	    (name &= "Proxy-Authorization"))
-	    header.append(new MimeAuthLine(name,*line));
-	else
-	    header.append(new MimeHeaderLine(name,*line));
+	header.append(buildHeaderLine(name,*line));
 
 	if ((clen < 0) && (name &= "Content-Length"))
 	    clen = line->toInteger(-1,10);
@@ -500,13 +636,148 @@ bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
     else
 	*bodyLen = (clen >= 0) ? clen : 0;
     DDebug(DebugAll,"SIPMessage::parse %d header lines, body %p",
-	header.count(),body);
+	m_lazy ? m_lazy->m_count : header.count(),body);
+    return true;
+}
+
+// Index header lines, build only the folded or malformed ones
+// Advance the buffer past the empty line ending the headers
+bool SIPMessage::parseLazy(const char*& buf, int& len, const char* start, int& clen)
+{
+    m_lazy = new SIPLazyHeaders;
+    int hdrEnd = -1;
+    while (len > 0) {
+	int eol = 0;
+	while ((eol < len) && buf[eol] != '\r' && buf[eol] != '\n' && buf[eol])
+	    eol++;
+	int next = eol;
+	if ((next < len) && (buf[next] == '\r') && (next + 1 < len) && (buf[next + 1] == '\n'))
+	    next += 2;
+	else if ((next < len) && (buf[next] == '\n'))
+	    next++;
+	if (!eol && next) {
+	    // Found end of headers
+	    hdrEnd = buf - start;
+	    buf += next;
+	    len -= next;
+	    break;
+	}
+	if ((next == eol) || ((next < len) && isHeaderBlank(buf[next]))) {
+	    // Folded, unterminated or with embedded NUL: build it now
+	    const char* lineStart = buf;
+	    String* line = MimeBody::getUnfoldedLine(buf,len);
+	    if (line->null()) {
+		line->destruct();
+		hdrEnd = lineStart - start;
+		break;
+	    }
+	    int col = line->find(':');
+	    String name = (col > 0) ? line->substr(0,col) : String::empty();
+	    name.trimBlanks();
+	    if (name.null()) {
+		line->destruct();
+		return false;
+	    }
+	    name = uncompactForm(name);
+	    *line >> ":";
+	    line->trimBlanks();
+	    m_lazy->append().line = buildHeaderLine(name,*line);
+	    line->destruct();
+	}
+	else {
+	    int col = 0;
+	    while ((col < eol) && (buf[col] != ':'))
+		col++;
+	    int ns = 0;
+	    int ne = col;
+	    while ((ns < ne) && isHeaderBlank(buf[ns]))
+		ns++;
+	    while ((ne > ns) && isHeaderBlank(buf[ne - 1]))
+		ne--;
+	    if ((col >= eol) || (ns >= ne))
+		return false;
+	    int vs = col + 1;
+	    int ve = eol;
+	    while ((vs < ve) && isHeaderBlank(buf[vs]))
+		vs++;
+	    while ((ve > vs) && isHeaderBlank(buf[ve - 1]))
+		ve--;
+	    unsigned int offs = buf - start;
+	    SIPHeaderSpan& span = m_lazy->append();
+	    span.name = offs + ns;
+	    span.nameLen = ne - ns;
+	    span.value = offs + vs;
+	    span.valueLen = ve - vs;
+	    if (span.nameLen == 1) {
+		char tmp[2] = { buf[ns], 0 };
+		const char* full = uncompactForm(tmp);
+		if (full != tmp)
+		    span.fullName = full;
+	    }
+	    buf += next;
+	    len -= next;
+	}
+    }
+    if (hdrEnd < 0)
+	hdrEnd = buf - start;
+    m_lazy->m_headersLen = hdrEnd;
+    m_lazy->m_raw.assign((void*)start,buf - start);
+    // Content length and sequence are always needed
+    for (unsigned int i = 0; i < m_lazy->m_count; i++) {
+	bool isClen = (clen < 0) && m_lazy->matches(i,"Content-Length",14);
+	if (!(isClen || ((m_cseq < 0) && m_lazy->matches(i,"CSeq",4))))
+	    continue;
+	const SIPHeaderSpan& span = m_lazy->m_spans[i];
+	String value;
+	if (span.line)
+	    value = *span.line;
+	else
+	    value.assign((const char*)m_lazy->m_raw.data() + span.value,span.valueLen);
+	if (isClen) {
+	    clen = value.toInteger(-1,10);
+	    continue;
+	}
+	int sep = value.find(' ');
+	if (sep > 0) {
+	    m_cseq = value.substr(0,sep).toInteger(-1,10);
+	    if (m_answer) {
+		method = value.substr(sep + 1);
+		method.trimBlanks().toUpper();
+	    }
+	}
+    }
     return true;
 }
 
-SIPMessage* SIPMessage::fromParsing(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen)
+// Build all header lines of a lazily parsed message
+void SIPMessage::expandHeaders()
+{
+    if (!loadLazy(m_lazy))
+	return;
+    Lock lck(s_lazyMutex);
+    SIPLazyHeaders* lazy = m_lazy;
+    if (!lazy)
+	return;
+    // Fill the list before releasing the index, readers may switch to it
+    ObjList* last = &header;
+    for (unsigned int i = 0; i < lazy->m_count; i++) {
+	last = last->append(lazy->line(i));
+	lazy->m_spans[i].line = 0;
+    }
+    storeLazy(m_lazy,0);
+    lck.drop();
+    delete lazy;
+}
+
+bool SIPMessage::lazyHeaders() const
+{
+    return loadLazy(m_lazy) != 0;
+}
+
+SIPMessage* SIPMessage::fromParsing(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen,
+    bool lazy)
 {
-    SIPMessage* msg = new SIPMessage(ep,buf,len,bodyLen);
+    SIPMessage* msg = new SIPMessage(ep,buf,len,bodyLen,lazy);
     if (msg->isValid())
 	return msg;
     DDebug("SIPMessage",DebugInfo,"Invalid message");
@@ -522,11 +793,25 @@ void SIPMessage::buildBody(const char* buf, int len)
 	return;
     if (len < 0)
 	len = ::strlen(buf);
+    if (m_lazy)
+	m_lazy->m_raw.append(buf,len);
     const MimeHeaderLine* cType = getHeader("Content-Type");
     if (cType)
 	body = MimeBody::build(buf,len,*cType);
+    if (body && m_lazy) {
+	// Lines moved to body are found by value, build all lines only if needed
+	const char* raw = (const char*)m_lazy->m_raw.data();
+	for (unsigned int i = 0; i < m_lazy->m_count; i++) {
+	    const SIPHeaderSpan& span = m_lazy->m_spans[i];
+	    if (span.line ? span.line->startsWith("Content-",false,true) :
+		((span.valueLen >= 8) && !::strncasecmp(raw + span.value,"Content-",8))) {
+		expandHeaders();
+		break;
+	    }
+	}
+    }
     // Move extra Content- header lines to body
-    if (body) {
+    if (body && !m_lazy) {
 	ListIterator iter(header);
 	for (GenObject* o = 0; (o = iter.get());) {
 	    MimeHeaderLine* line = static_cast<MimeHeaderLine*>(o);
@@ -547,6 +832,16 @@ const MimeHeaderLine* SIPMessage::getHeader(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    if (loadLazy(m_lazy)) {
+	Lock lck(s_lazyMutex);
+	if (m_lazy) {
+	    unsigned int len = ::strlen(name);
+	    for (unsigned int i = 0; i < m_lazy->m_count; i++)
+		if (m_lazy->matches(i,name,len))
+		    return m_lazy->line(i);
+	    return 0;
+	}
+    }
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -560,6 +855,16 @@ const MimeHeaderLine* SIPMessage::getLastHeader(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    if (loadLazy(m_lazy)) {
+	Lock lck(s_lazyMutex);
+	if (m_lazy) {
+	    unsigned int len = ::strlen(name);
+	    for (unsigned int i = m_lazy->m_count; i--; )
+		if (m_lazy->matches(i,name,len))
+		    return m_lazy->line(i);
+	    return 0;
+	}
+    }
     const MimeHeaderLine* res = 0;
     const ObjList* l = &header;
     for (; l; l = l->next()) {
@@ -570,10 +875,48 @@ const MimeHeaderLine* SIPMessage::getLastHeader(const char* name) const
     return res;
 }
 
+const MimeHeaderLine* SIPMessage::getNextHeader(const char* name, const MimeHeaderLine* after) const
+{
+    if (!(name && *name))
+	return 0;
+    if (loadLazy(m_lazy)) {
+	Lock lck(s_lazyMutex);
+	if (m_lazy) {
+	    unsigned int i = 0;
+	    if (after) {
+		int idx = m_lazy->find(after);
+		if (idx < 0)
+		    return 0;
+		i = idx + 1;
+	    }
+	    unsigned int len = ::strlen(name);
+	    for (; i < m_lazy->m_count; i++)
+		if (m_lazy->matches(i,name,len))
+		    return m_lazy->line(i);
+	    return 0;
+	}
+    }
+    const ObjList* l = header.skipNull();
+    if (after) {
+	for (; l && (l->get() != after); l = l->skipNext())
+	    ;
+	if (!l)
+	    return 0;
+	l = l->skipNext();
+    }
+    for (; l; l = l->skipNext()) {
+	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
+	if (t->name() &= name)
+	    return t;
+    }
+    return 0;
+}
+
 void SIPMessage::clearHeaders(const char* name)
 {
     if (!(name && *name))
 	return;
+    expandHeaders();
     ObjList* l = &header;
     while (l) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -589,6 +932,16 @@ int SIPMessage::countHeaders(const char* name) const
     if (!(name && *name))
 	return 0;
     int res = 0;
+    if (loadLazy(m_lazy)) {
+	Lock lck(s_lazyMutex);
+	if (m_lazy) {
+	    unsigned int len = ::strlen(name);
+	    for (unsigned int i = 0; i < m_lazy->m_count; i++)
+		if (m_lazy->matches(i,name,len))
+		    ++res;
+	    return res;
+	}
+    }
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -618,6 +971,11 @@ const String& SIPMessage::getParamValue(const char* name, const char* param, boo
 
 const String& SIPMessage::getHeaders() const
 {
+    if (isValid() && m_string.null() && loadLazy(m_lazy)) {
+	Lock lck(s_lazyMutex);
+	if (m_lazy)
+	    m_string.assign((const char*)m_lazy->m_raw.data(),m_lazy->m_headersLen);
+    }
     if (isValid() && m_string.null()) {
 	if (isAnswer())
 	    m_string << version << " " << code << " " << reason << "\r\n";
@@ -636,8 +994,20 @@ const String& SIPMessage::getHeaders() const
     return m_string;
 }
 
+const ObjList& SIPMessage::headerList() const
+{
+    const_cast<SIPMessage*>(this)->expandHeaders();
+    return header;
+}
+
 const DataBlock& SIPMessage::getBuffer() const
 {
+    // Unmodified lazily parsed message: send what was received
+    if (isValid() && m_data.null() && loadLazy(m_lazy)) {
+	Lock lck(s_lazyMutex);
+	if (m_lazy)
+	    m_data = m_lazy->m_raw;
+    }
     if (isValid() && m_data.null()) {
 	m_data.assign((void*)(getHeaders().c_str()),getHeaders().length());
 	if (body) {
@@ -665,6 +1035,8 @@ void SIPMessage::setBody(MimeBody* newbody)
 {
     if (newbody == body)
 	return;
+    // Received bytes no longer match the message
+    expandHeaders();
     TelEngine::destruct(body);
     body = newbody;
 }
@@ -685,10 +1057,10 @@ MimeAuthLine* SIPMessage::buildAuth(const String& username, const String& passwo
     const String& meth, const String& uri, bool proxy, SIPEngine* engine) const
 {
     const char* hdr = proxy ? "Proxy-Authenticate" : "WWW-Authenticate";
-    const ObjList* l = &header;
-    for (; l; l = l->next()) {
-	const MimeAuthLine* t = YOBJECT(MimeAuthLine,l->get());
-	if (t && (t->name() &= hdr) && (*t &= "Digest")) {
+    const MimeHeaderLine* hl = 0;
+    while ((hl = getNextHeader(hdr,hl))) {
+	const MimeAuthLine* t = YOBJECT(MimeAuthLine,hl);
+	if (t && (*t &= "Digest")) {
 	    String nonce(t->getParam("nonce"));
 	    MimeHeaderLine::delQuotes(nonce);
 	    if (nonce.null())
@@ -752,41 +1124,38 @@ MimeAuthLine* SIPMessage::buildAuth(const SIPMessage& original, SIPEngine* engin
 ObjList* SIPMessage::getRoutes() const
 {
     ObjList* list = 0;
-    const ObjList* l = &header;
-    for (; l; l = l->next()) {
-	const MimeHeaderLine* h = YOBJECT(MimeHeaderLine,l->get());
-	if (h && (h->name() &= "Record-Route")) {
-	    int p = 0;
-	    while (p >= 0) {
-		MimeHeaderLine* line = 0;
-		int s = MimeHeaderLine::findSep(*h,',',p);
-		String tmp;
-		if (s < 0) {
-		    if (p)
-			tmp = h->substr(p);
-		    else
-			line = new MimeHeaderLine(*h,"Route");
-		    p = -1;
-		}
-		else {
-		    if (s > p)
-			tmp = h->substr(p,s-p);
-		    p = s + 1;
-		}
-		tmp.trimBlanks();
-		if (tmp)
-		    line = new MimeHeaderLine("Route",tmp);
-		if (!line)
-		    continue;
-		if (!list)
-		    list = new ObjList;
-		if (isAnswer())
-		    // route set learned from an answer, reverse order
-		    list->insert(line);
+    const MimeHeaderLine* h = 0;
+    while ((h = getNextHeader("Record-Route",h))) {
+	int p = 0;
+	while (p >= 0) {
+	    MimeHeaderLine* line = 0;
+	    int s = MimeHeaderLine::findSep(*h,',',p);
+	    String tmp;
+	    if (s < 0) {
+		if (p)
+		    tmp = h->substr(p);
 		else
-		    // route set learned from a request, preserve order
-		    list->append(line);
+		    line = new MimeHeaderLine(*h,"Route");
+		p = -1;
+	    }
+	    else {
+		if (s > p)
+		    tmp = h->substr(p,s-p);
+		p = s + 1;
 	    }
+	    tmp.trimBlanks();
+	    if (tmp)
+		line = new MimeHeaderLine("Route",tmp);
+	    if (!line)
+		continue;
+	    if (!list)
+		list = new ObjList;
+	    if (isAnswer())
+		// route set learned from an answer, reverse order
+		list->insert(line);
+	    else
+		// route set learned from a request, preserve order
+		list->append(line);
 	}
     }
     return list;
@@ -33,7 +33,8 @@ SIPTransaction::SIPTransaction(SIPMessage* message, SIPEngine* engine, bool outg
       m_response(0), m_timeouts(0), m_timeout(0),
       m_firstMessage(message), m_lastMessage(0), m_pending(0), m_engine(engine), m_private(0),
       m_autoChangeParty(autoChangeParty ? *autoChangeParty : engine->autoChangeParty()),
-      m_autoAck(true), m_silent(false)
+      m_autoAck(true), m_silent(false),
+      m_listed(false), m_ready(false), m_timerSlot(-1)
 {
     DDebug(getEngine(),DebugAll,"SIPTransaction::SIPTransaction(%p,%p,%d) [%p]",
 	message,engine,outgoing,this);
@@ -88,7 +89,8 @@ SIPTransaction::SIPTransaction(SIPTransaction& original, SIPMessage* answer)
       m_pending(0), m_engine(original.m_engine),
       m_branch(original.m_branch), m_callid(original.m_callid), m_tag(original.m_tag),
       m_private(0), m_autoChangeParty(original.m_autoChangeParty),
-      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId())
+      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId()),
+      m_listed(false), m_ready(false), m_timerSlot(-1)
 {
     DDebug(getEngine(),DebugAll,"SIPTransaction::SIPTransaction(&%p,%p) [%p]",
 	&original,answer,this);
@@ -98,11 +100,14 @@ SIPTransaction::SIPTransaction(SIPTransaction& original, SIPMessage* answer)
     m_firstMessage->setAutoAuth();
     msg->complete(m_engine);
     msg->addHeader(auth);
+    String oldBranch = original.m_branch;
     const NamedString* ns = msg->getParam("Via","branch",true);
     if (ns)
 	original.m_branch = *ns;
     else
 	original.m_branch.clear();
+    if (original.m_branch != oldBranch)
+	m_engine->changedBranch(&original,oldBranch);
     ns = msg->getParam("To","tag");
     if (ns)
 	original.m_tag = *ns;
@@ -134,7 +139,8 @@ SIPTransaction::SIPTransaction(const SIPTransaction& original, const String& tag
       m_pending(0), m_engine(original.m_engine),
       m_branch(original.m_branch), m_callid(original.m_callid), m_tag(tag),
       m_private(0), m_autoChangeParty(original.m_autoChangeParty),
-      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId())
+      m_autoAck(original.m_autoAck), m_silent(original.m_silent), m_traceId(original.traceId()),
+      m_listed(false), m_ready(false), m_timerSlot(-1)
 {
     if (m_firstMessage)
 	m_firstMessage->ref();
@@ -199,9 +205,16 @@ bool SIPTransaction::changeState(int newstate)
     DDebug(getEngine(),DebugAll,"SIPTransaction state changed from %s to %s [%p]",
 	stateName(m_state),stateName(newstate),this);
     m_state = newstate;
+    m_engine->transactionReady(this);
     return true;
 }
 
+void SIPTransaction::setTransmit()
+{
+    m_transmit = true;
+    m_engine->transactionReady(this);
+}
+
 void SIPTransaction::setDialogTag(const char* tag)
 {
     if (null(tag)) {
@@ -245,6 +258,8 @@ void SIPTransaction::setPendingEvent(SIPEvent* event, bool replace)
 	    delete event;
     else
 	m_pending = event;
+    if (m_pending)
+	m_engine->transactionReady(this);
 }
 
 void SIPTransaction::setTransCount(int count)
@@ -264,6 +279,7 @@ void SIPTransaction::setTimeout(u_int64_t delay, unsigned int count)
     m_timeouts = count;
     m_delay = delay;
     m_timeout = (count && delay) ? Time::now() + delay : 0;
+    m_engine->transactionTimer(this);
 #ifdef DEBUG
     if (m_timeout)
 	TraceDebugObj(this,getEngine(),DebugAll,"SIPTransaction new %d timeouts initially " FMT64U " usec apart [%p]",
@@ -52,6 +52,7 @@ extern YSIP_API TokenDict* SIPResponses;
 
 class SIPEngine;
 class SIPEvent;
+class SIPLazyHeaders;
 
 class YSIP_API SIPParty : public RefObject
 {
@@ -180,8 +181,10 @@ public:
      * @param bodyLen Pointer to body length to be set if the message was received
      *  on a stream transport. If not 0 the buffer must contain the message
      *  without its body
+     * @param lazy True to only index the header lines and build them when requested
      */
-    SIPMessage(SIPParty* ep, const char* buf, int len = -1, unsigned int* bodyLen = 0);
+    SIPMessage(SIPParty* ep, const char* buf, int len = -1, unsigned int* bodyLen = 0,
+	bool lazy = false);
 
     /**
      * Creates a new SIPMessage as answer to another message.
@@ -206,10 +209,12 @@ public:
      * @param bodyLen Pointer to body length to be set if the message was received
      *  on a stream transport. If not 0 the buffer must contain the message
      *  without its body
+     * @param lazy True to only index the header lines and build them when requested.
+     *  An unmodified lazily parsed message is sent using the received bytes
      * @return A pointer to a valid new message or NULL
      */
     static SIPMessage* fromParsing(SIPParty* ep, const char* buf, int len = -1,
-	unsigned int* bodyLen = 0);
+	unsigned int* bodyLen = 0, bool lazy = false);
 
     /**
      * Build message's body. Reset it before.
@@ -341,6 +346,14 @@ public:
      */
     const MimeHeaderLine* getLastHeader(const char* name) const;
 
+    /**
+     * Find the next header line that matches a given name
+     * @param name Name of the header to locate
+     * @param after Header line to search after, 0 to find the first one
+     * @return A pointer to the next matching header line or 0 if not found
+     */
+    const MimeHeaderLine* getNextHeader(const char* name, const MimeHeaderLine* after) const;
+
     /**
      * Count the header lines matching a specific name
      * @param name Name of the header to locate
@@ -380,14 +393,14 @@ public:
      * @param value Content of the new header line
      */
     inline void addHeader(const char* name, const char* value = 0)
-	{ header.append(new MimeHeaderLine(name,value)); }
+	{ expandHeaders(); header.append(new MimeHeaderLine(name,value)); }
 
     /**
      * Append an already constructed header line
      * @param line Header line to add
      */
     inline void addHeader(MimeHeaderLine* line)
-	{ header.append(line); }
+	{ expandHeaders(); header.append(line); }
 
     /**
      * Clear all header lines that match a name
@@ -480,6 +493,18 @@ public:
      */
     const String& getHeaders() const;
 
+    /**
+     * Retrieve the list of header lines, build all of them if the message was lazily parsed
+     * @return The list of MimeHeaderLine of this message
+     */
+    const ObjList& headerList() const;
+
+    /**
+     * Check if the header lines of this message are still lazily built
+     * @return True if the message was lazily parsed and its header lines were not all built
+     */
+    bool lazyHeaders() const;
+
     /**
      * Set a new body for this message
      */
@@ -519,6 +544,8 @@ public:
 
     /**
      * All the headers should be in this list.
+     * The list of a lazily parsed message is filled only by headerList() or by
+     *  methods changing the headers
      */
     ObjList header;
 
@@ -539,8 +566,10 @@ public:
     bool msgPrint;
 
 protected:
-    bool parse(const char* buf, int len, unsigned int* bodyLen);
+    bool parse(const char* buf, int len, unsigned int* bodyLen, bool lazy = false);
     bool parseFirst(String& line);
+    bool parseLazy(const char*& buf, int& len, const char* start, int& clen);
+    void expandHeaders();
     SIPParty* m_ep;
     RefPointer<SIPSequence> m_seq;
     bool m_valid;
@@ -554,6 +583,7 @@ protected:
     String m_authUser;
     String m_authPass;
     bool m_dontSend;
+    SIPLazyHeaders* m_lazy;
 private:
     SIPMessage(); // no, thanks
 };
@@ -770,6 +800,7 @@ protected:
  */
 class YSIP_API SIPTransaction : public RefObject
 {
+    friend class SIPEngine;
 public:
     /**
      * Current state of the transaction
@@ -948,8 +979,7 @@ public:
      * Set the (re)transmission flag that allows the latest outgoing message
      *  to be send over the wire
      */
-    inline void setTransmit()
-	{ m_transmit = true; }
+    void setTransmit();
 
     /**
      * Change transaction status to Cleared
@@ -1204,6 +1234,10 @@ protected:
     bool m_autoAck;
     bool m_silent;
     String m_traceId;
+    // engine scheduling data, protected by the engine lock
+    bool m_listed;
+    bool m_ready;
+    int m_timerSlot;
 };
 
 /**
@@ -1397,6 +1431,8 @@ public:
      * This method mainly looks into the transaction list and get all kind of
      * events, like an incoming request (INVITE, REGISTRATION), a timer, an
      * outgoing message.
+     * Only transactions that changed or whose timer expired are checked,
+     *  transactions waiting for a timer are kept in a timer wheel.
      * This method is thread safe
      */
     SIPEvent *getEvent();
@@ -1579,22 +1615,31 @@ public:
      * Remove a transaction from the list without dereferencing it
      * @param transaction Pointer to transaction to remove
      */
-    inline void remove(SIPTransaction* transaction)
-	{ lock(); m_transList.remove(transaction,false); unlock(); }
+    void remove(SIPTransaction* transaction);
 
     /**
      * Append a transaction to the end of the list
      * @param transaction Pointer to transaction to append
      */
-    inline void append(SIPTransaction* transaction)
-	{ lock(); m_transList.append(transaction); unlock(); }
+    void append(SIPTransaction* transaction);
 
     /**
      * Insert a transaction at the start of the list
      * @param transaction Pointer to transaction to insert
      */
-    inline void insert(SIPTransaction* transaction)
-	{ lock(); m_transList.insert(transaction); unlock(); }
+    void insert(SIPTransaction* transaction);
+
+    /**
+     * Update the lookup index of a transaction whose Via branch has changed
+     * @param transaction Pointer to transaction whose branch changed
+     * @param oldBranch Branch the transaction was previously indexed by
+     */
+    void changedBranch(SIPTransaction* transaction, const String& oldBranch);
+
+    /**
+     * Remove and dereference all transactions
+     */
+    void clearTransactions();
 
     /**
      * Get the number of active SIP transactions
@@ -1603,12 +1648,77 @@ public:
     inline unsigned int transactionCount()
 	{ Lock mylock(this); return m_transList.count(); }
 
+    /**
+     * Retrieve the statistics of transactions woken up by their timers
+     * @param total Returns the total number of timer wake ups
+     * @param last Returns the number of transactions woken in the last
+     *  event retrieval that had any timer expired
+     * @param max Returns the highest number of transactions woken at once
+     */
+    void getTimerStats(u_int64_t& total, unsigned int& last, unsigned int& max);
+
 protected:
+    friend class SIPTransaction;
+
+    /**
+     * Schedule a transaction for event processing after it changed.
+     * The transaction is ignored if it doesn't belong to the engine
+     * @param transaction Pointer to the transaction that has changed
+     */
+    void transactionReady(SIPTransaction* transaction);
+
+    /**
+     * Place a transaction in the timer wheel according to its timeout
+     * @param transaction Pointer to the transaction whose timeout changed
+     */
+    void transactionTimer(SIPTransaction* transaction);
+
+    /**
+     * Move the transactions whose timer expired to the ready list.
+     * The engine must be locked by the caller
+     * @param time Current time
+     */
+    void checkTimers(u_int64_t time);
+
+    /**
+     * Remove a transaction from the list and the lookup index.
+     * The engine must be locked by the caller
+     * @param transaction Pointer to transaction to remove
+     * @param delobj True to also dereference the transaction
+     */
+    void removeTransaction(SIPTransaction* transaction, bool delobj);
+
     /**
      * The list that holds all the SIP transactions.
      */
     ObjList m_transList;
 
+    /**
+     * Transactions indexed by the Via branch of their initial message
+     */
+    HashList m_transByBranch;
+
+    /**
+     * Transactions indexed by their Call-ID
+     */
+    HashList m_transByCallId;
+
+    /**
+     * Transactions that changed or whose timer expired, waiting to be checked
+     */
+    ObjList m_transReady;
+
+    /**
+     * Slots of the timer wheel holding transactions waiting for a timeout
+     */
+    ObjList* m_timerSlots;
+
+    ObjList* m_readyAppend;
+    u_int64_t m_timerTick;
+    u_int64_t m_timerWoken;
+    unsigned int m_timerLast;
+    unsigned int m_timerMax;
+
     u_int64_t m_t1;
     u_int64_t m_t4;
     int m_reqTransCount;
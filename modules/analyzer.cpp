@@ -133,6 +133,7 @@ public:
     virtual bool msgRinging(Message& msg);
     virtual bool msgAnswered(Message& msg);
     virtual void checkTimers(Message& msg, const Time& tmr);
+    virtual u_int64_t timerDue() const;
     void startChannel(NamedList& params);
     void addSource();
     void addConsumer();
@@ -653,6 +654,14 @@ void AnalyzerChan::checkTimers(Message& msg, const Time& tmr)
 	Channel::checkTimers(msg,tmr);
 }
 
+u_int64_t AnalyzerChan::timerDue() const
+{
+    u_int64_t due = Channel::timerDue();
+    if (m_stopTime && (!due || (m_stopTime < due)))
+	due = m_stopTime;
+    return due;
+}
+
 void AnalyzerChan::startChannel(NamedList& params)
 {
     Message* m = message("chan.startup",params);
@@ -678,8 +687,10 @@ void AnalyzerChan::startChannel(NamedList& params)
 void AnalyzerChan::setDuration(NamedList& params)
 {
     int t = params.getIntValue("duration",120000);
-    if (t > 0)
+    if (t > 0) {
 	m_stopTime = Time::now() + 1000 * (uint64_t)t;
+	updateTimer();
+    }
 }
 
 void AnalyzerChan::addSource()
@@ -29,6 +29,15 @@
 using namespace TelEngine;
 namespace { // anonymous
 
+// Number of shards of the CDR table
+#define CDR_SHARDS 16
+// Number of hash buckets in each shard
+#define CDR_SHARD_BUCKETS 257
+// Number of slots in the status timer wheel of each shard
+#define CDR_WHEEL_SLOTS 2048
+// Time span of one status timer wheel slot in milliseconds
+#define CDR_WHEEL_TICK 50
+
 enum {
     CdrStart,
     CdrCall,
@@ -84,19 +93,23 @@ public:
     virtual bool received(Message &msg);
 };
 
+class CdrShard;
+
 // Collects CDR information and emits the call.cdr messages when needed
 class CdrBuilder : public NamedList
 {
 public:
-    CdrBuilder(const char *name);
+    CdrBuilder(const char *name, CdrShard* shard);
     virtual ~CdrBuilder();
     void update(int type, u_int64_t val, const char* status = 0);
     bool update(const Message& msg, int type, u_int64_t val);
     void emit(const char *operation = 0);
     String getStatus() const;
-    static CdrBuilder* find(String &id);
+    void answered();
     u_int64_t m_statusTime;
+    int m_wheelSlot;
 private:
+    CdrShard* m_shard;
     u_int64_t
 	m_start,
 	m_call,
@@ -144,11 +157,52 @@ private:
     u_int64_t m_expires;
 };
 
+// One shard of the CDR table with its own lock, hungup guards and status timers
+class CdrShard : public Mutex
+{
+public:
+    inline CdrShard()
+	: Mutex(false,"CdrBuild"),
+	  m_cdrs(CDR_SHARD_BUCKETS), m_hungup(CDR_SHARD_BUCKETS),
+	  m_count(0), m_hungupCount(0), m_slot(0)
+	{ }
+    inline ~CdrShard()
+	{ clear(); }
+    static inline CdrShard& get(const String& id);
+    inline CdrBuilder* find(const String& id)
+	{ return static_cast<CdrBuilder*>(m_cdrs[id]); }
+    inline Hungup* findHungup(const String& id)
+	{ return static_cast<Hungup*>(m_hungup[id]); }
+    inline unsigned int count() const
+	{ return m_count; }
+    inline unsigned int hungupCount() const
+	{ return m_hungupCount; }
+    void append(CdrBuilder* cdr);
+    void remove(CdrBuilder* cdr);
+    unsigned int clear();
+    void addHungup(const String& id, bool emitHangup);
+    void expireHungup(u_int64_t now);
+    void schedule(CdrBuilder* cdr, u_int64_t due);
+    void unschedule(CdrBuilder* cdr);
+    void timerTick(const Time& when);
+    void status(String& str);
+private:
+    HashList m_cdrs;                         // Active CDR builders
+    HashList m_hungup;                       // Hungup guards by channel ID
+    ObjList m_expire;                        // Hungup guards in expiration order, not owned
+    unsigned int m_count;                    // Number of CDR builders
+    unsigned int m_hungupCount;              // Number of hungup guards
+    ObjList m_wheel[CDR_WHEEL_SLOTS];        // Status timer wheel, builders not owned
+    u_int64_t m_slot;                        // Absolute index of the first slot to check
+};
+
+// Runs the hungup guard and status timers of all shards
 class StatusThread : public Thread
 {
 public:
     inline StatusThread()
-	:m_exit(false),m_maxSleep(25)
+	: Thread("CdrBuild Timer"),
+	  m_exit(false),m_maxSleep(25)
 	{ }
     inline ~StatusThread()
 	{ }
@@ -181,16 +235,16 @@ private:
 };
 
 
-static ObjList s_cdrs;
-static ObjList s_hungup;
+static CdrShard s_shards[CDR_SHARDS];
 CustomTimer m_startTime;
 CustomTimer m_answerTime;
 CustomTimer m_hangupTime;
 CustomTimer m_durationTime(true);
 u_int64_t Hungup::s_exp = 5000000;
 
-// This mutex protects both the CDR list and the params list
-static Mutex s_mutex(false,"CdrBuild");
+// This lock protects the params list and the formatted timers,
+//  it must be acquired before any of the shard locks
+static RWLock s_cfgLock("CdrBuildConfig");
 static ObjList s_params;
 static int s_res = 1;
 static int s_seq = 0;
@@ -293,21 +347,143 @@ static const char* printTime(char* buf, u_int64_t usec, int count)
     return buf;
 }
 
-// Expire hungup guard records
-static void expireHungup()
+
+inline CdrShard& CdrShard::get(const String& id)
+{
+    return s_shards[id.hash() % CDR_SHARDS];
+}
+
+void CdrShard::append(CdrBuilder* cdr)
+{
+    m_cdrs.append(cdr);
+    m_count++;
+}
+
+// Remove and destroy a CDR builder, the shard must be locked
+void CdrShard::remove(CdrBuilder* cdr)
+{
+    unschedule(cdr);
+    if (m_cdrs.remove(cdr,false,true)) {
+	m_count--;
+	TelEngine::destruct(cdr);
+    }
+}
+
+// Destroy all CDR builders, return how many were destroyed
+unsigned int CdrShard::clear()
+{
+    unsigned int n = m_count;
+    for (int i = 0; i < CDR_WHEEL_SLOTS; i++)
+	m_wheel[i].clear();
+    for (unsigned int i = 0; i < m_cdrs.length(); i++) {
+	ObjList* l = m_cdrs.getList(i);
+	if (!l)
+	    continue;
+	while (CdrBuilder* cdr = static_cast<CdrBuilder*>(l->remove(false))) {
+	    m_count--;
+	    cdr->m_wheelSlot = -1;
+	    TelEngine::destruct(cdr);
+	}
+    }
+    return n;
+}
+
+void CdrShard::addHungup(const String& id, bool emitHangup)
+{
+    Hungup* h = new Hungup(id,emitHangup);
+    m_hungup.append(h);
+    m_expire.append(h)->setDelete(false);
+    m_hungupCount++;
+}
+
+// Expire hungup guard records, they all live for the same time so oldest come first
+void CdrShard::expireHungup(u_int64_t now)
 {
-    Time t;
-    while (Hungup* h = static_cast<Hungup*>(s_hungup.get())) {
-	if (h->expires() > t.usec())
+    while (Hungup* h = static_cast<Hungup*>(m_expire.get())) {
+	if (h->expires() > now)
 	    return;
 	DDebug("cdrbuild",DebugInfo,"Expiring hungup guard for '%s'",h->c_str());
-	s_hungup.remove(h);
+	m_expire.remove(false);
+	m_hungup.remove(h,true,true);
+	m_hungupCount--;
     }
 }
 
+// Set the status time of a CDR builder and put it in the timer wheel
+void CdrShard::schedule(CdrBuilder* cdr, u_int64_t due)
+{
+    unschedule(cdr);
+    cdr->m_statusTime = due;
+    u_int64_t slot = (due + CDR_WHEEL_TICK - 1) / CDR_WHEEL_TICK;
+    if (slot < m_slot)
+	slot = m_slot;
+    cdr->m_wheelSlot = (int)(slot % CDR_WHEEL_SLOTS);
+    m_wheel[cdr->m_wheelSlot].append(cdr)->setDelete(false);
+}
 
-CdrBuilder::CdrBuilder(const char *name)
-    : NamedList(name), m_dir("unknown"), m_status("unknown"),
+void CdrShard::unschedule(CdrBuilder* cdr)
+{
+    if (cdr->m_wheelSlot < 0)
+	return;
+    m_wheel[cdr->m_wheelSlot].remove(cdr,false);
+    cdr->m_wheelSlot = -1;
+}
+
+// Expire hungup guards and emit status of answered calls that are due
+void CdrShard::timerTick(const Time& when)
+{
+    Lock lock(this);
+    expireHungup(when.usec());
+    u_int64_t now = when.msec();
+    u_int64_t slot = now / CDR_WHEEL_TICK;
+    u_int64_t s = m_slot;
+    if (s + CDR_WHEEL_SLOTS <= slot)
+	s = slot + 1 - CDR_WHEEL_SLOTS;
+    ObjList due;
+    // the current slot is checked again on next tick
+    for (; s <= slot; s++) {
+	ObjList* o = m_wheel[s % CDR_WHEEL_SLOTS].skipNull();
+	while (o) {
+	    CdrBuilder* cdr = static_cast<CdrBuilder*>(o->get());
+	    if (cdr->m_statusTime > now) {
+		o = o->skipNext();
+		continue;
+	    }
+	    o->remove(false);
+	    cdr->m_wheelSlot = -1;
+	    due.append(cdr)->setDelete(false);
+	    o = o->skipNull();
+	}
+    }
+    m_slot = slot;
+    while (CdrBuilder* cdr = static_cast<CdrBuilder*>(due.remove(false))) {
+	if (s_cdrStatus)
+	    cdr->emit("status");
+	if (s_statusUpdate)
+	    schedule(cdr,now + s_statusUpdate);
+	else
+	    cdr->m_statusTime = (u_int64_t)-1;
+    }
+}
+
+// Append the status of all CDR builders, the shard must be locked
+void CdrShard::status(String& str)
+{
+    for (unsigned int i = 0; i < m_cdrs.length(); i++) {
+	ObjList* l = m_cdrs.getList(i);
+	for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	    CdrBuilder* b = static_cast<CdrBuilder*>(l->get());
+	    if (str)
+		str << ",";
+	    str << *b << "=" << b->getStatus();
+	}
+    }
+}
+
+
+CdrBuilder::CdrBuilder(const char *name, CdrShard* shard)
+    : NamedList(name), m_wheelSlot(-1), m_shard(shard),
+      m_dir("unknown"), m_status("unknown"),
       m_first(true), m_write(true)
 {
     m_statusTime = m_start = m_call = m_ringing = m_answer = m_hangup = 0;
@@ -322,8 +498,8 @@ CdrBuilder::~CdrBuilder()
 	    addParam("reason","CDR shutdown");
     }
     emit("finalize");
-    if (Hungup::s_exp && !s_hungup.find(*this))
-	s_hungup.append(new Hungup(*this,false));
+    if (Hungup::s_exp && !m_shard->findHungup(*this))
+	m_shard->addHungup(*this,false);
 }
 
 void CdrBuilder::emit(const char *operation)
@@ -471,7 +647,7 @@ bool CdrBuilder::update(const Message& msg, int type, u_int64_t val)
 	    if (reason)
 		setParam("reason",reason);
 	}
-	s_cdrs.remove(this);
+	m_shard->remove(this);
 	return true;
     }
     // cdrwrite must be consistent over all emitted messages so we read it once
@@ -512,7 +688,7 @@ bool CdrBuilder::update(const Message& msg, int type, u_int64_t val)
     update(type,val);
 
     if (type == CdrHangup) {
-	s_cdrs.remove(this);
+	m_shard->remove(this);
 	// object is now destroyed, "this" no longer valid
 	return false;
     }
@@ -521,20 +697,27 @@ bool CdrBuilder::update(const Message& msg, int type, u_int64_t val)
     return false;
 }
 
-CdrBuilder* CdrBuilder::find(String &id)
+// Start emitting status for an answered call, the shard must be locked
+void CdrBuilder::answered()
 {
-    return static_cast<CdrBuilder*>(s_cdrs[id]);
+    if (!m_statusTime)
+	m_shard->schedule(this,Time::msecNow() + (s_statusAnswer ? 0 : s_statusUpdate));
 }
 
 
 bool CdrHandler::received(Message &msg)
 {
-    Lock lock(s_mutex);
+    RLock cfg(s_cfgLock);
     if (m_type == EngHalt) {
-	unsigned int n = s_cdrs.count();
+	unsigned int n = 0;
+	for (int i = 0; i < CDR_SHARDS; i++)
+	    n += s_shards[i].count();
 	if (n)
 	    Debug("cdrbuild",DebugWarn,"Forcibly finalizing %u CDR records.",n);
-	s_cdrs.clear();
+	for (int i = 0; i < CDR_SHARDS; i++) {
+	    Lock lock(s_shards[i]);
+	    s_shards[i].clear();
+	}
 	if (s_updaterThread)
 	    s_updaterThread->exit();
 	return false;
@@ -561,15 +744,17 @@ bool CdrHandler::received(Message &msg)
     bool rval = false;
     int type = m_type;
     int level = DebugAll;
-    CdrBuilder *b = CdrBuilder::find(id);
+    CdrShard* sh = &CdrShard::get(id);
+    Lock lock(sh);
+    CdrBuilder *b = sh->find(id);
     if (!b) {
 	switch (type) {
 	    case CdrStart:
 	    case CdrCall:
 	    case CdrAnswer:
 		{
-		    expireHungup();
-		    Hungup* h = static_cast<Hungup*>(s_hungup[id]);
+		    sh->expireHungup(Time::now());
+		    Hungup* h = sh->findHungup(id);
 		    if (h) {
 			if (h->hangup())
 			    // seen hangup but not emitted call.cdr - do it now
@@ -583,14 +768,14 @@ bool CdrHandler::received(Message &msg)
 		}
 		if ((type != CdrHangup) && !msg.getBoolValue(YSTRING("cdrcreate"),true))
 		    break;
-		b = new CdrBuilder(id);
-		s_cdrs.append(b);
+		b = new CdrBuilder(id,sh);
+		sh->append(b);
 		break;
 	    case CdrHangup:
-		expireHungup();
-		if (Hungup::s_exp && !s_hungup.find(id))
+		sh->expireHungup(Time::now());
+		if (Hungup::s_exp && !sh->findHungup(id))
 		    // remember to emit a finalize if we ever see a startup
-		    s_hungup.append(new Hungup(id,true));
+		    sh->addHungup(id,true);
 		else
 		    level = DebugMild;
 		break;
@@ -598,8 +783,8 @@ bool CdrHandler::received(Message &msg)
     }
     if (b) {
 	rval = b->update(msg,type,msg.msgTime().usec());
-	if (type == CdrAnswer && !b->m_statusTime)
-	    b->m_statusTime = Time::msecNow() + (s_statusAnswer ? 0 : s_statusUpdate);
+	if (type == CdrAnswer)
+	    b->answered();
     } else
 	Debug("cdrbuild",level,"Got message '%s' for untracked id '%s'",
 	    msg.c_str(),id.c_str());
@@ -607,11 +792,17 @@ bool CdrHandler::received(Message &msg)
 	id = msg.getValue(YSTRING("peerid"));
 	if (id.null())
 	    id = msg.getValue(YSTRING("targetid"));
-	if (id && (b = CdrBuilder::find(id))) {
+	if (id.null())
+	    return rval;
+	// the peer may live in another shard
+	lock.drop();
+	sh = &CdrShard::get(id);
+	lock.acquire(sh);
+	if ((b = sh->find(id))) {
 	    b->update(type,msg.msgTime().usec(),msg.getValue("status"));
 	    b->emit();
-	    if (type == CdrAnswer && !b->m_statusTime)
-		b->m_statusTime = Time::msecNow() + (s_statusAnswer ? 0 : s_statusUpdate);
+	    if (type == CdrAnswer)
+		b->answered();
 	}
     }
     return rval;
@@ -624,25 +815,24 @@ bool StatusHandler::received(Message &msg)
     if (!(TelEngine::null(sel) || (*sel == YSTRING("cdrbuild"))))
 	return false;
     String st("name=cdrbuild,type=cdr,format=Status|Caller|Called|BillId|Duration");
-    s_mutex.lock();
-    expireHungup();
-    st << ";cdrs=" << s_cdrs.count() << ",hungup=" << s_hungup.count();
-    if (msg.getBoolValue(YSTRING("details"),true)) {
-	st << ";";
-	ObjList *l = &s_cdrs;
-	bool first = true;
-	for (; l; l=l->next()) {
-	    CdrBuilder *b = static_cast<CdrBuilder *>(l->get());
-	    if (b) {
-		if (first)
-		    first = false;
-		else
-		    st << ",";
-		st << *b << "=" << b->getStatus();
-	    }
-	}
+    bool details = msg.getBoolValue(YSTRING("details"),true);
+    unsigned int cdrs = 0;
+    unsigned int hungup = 0;
+    String list;
+    // each shard is locked only while its own records are collected
+    u_int64_t now = Time::now();
+    for (int i = 0; i < CDR_SHARDS; i++) {
+	CdrShard& sh = s_shards[i];
+	Lock lock(sh);
+	sh.expireHungup(now);
+	cdrs += sh.count();
+	hungup += sh.hungupCount();
+	if (details)
+	    sh.status(list);
     }
-    s_mutex.unlock();
+    st << ";cdrs=" << cdrs << ",hungup=" << hungup;
+    if (details)
+	st << ";" << list;
     msg.retValue() << st << "\r\n";
     return false;
 }
@@ -662,32 +852,13 @@ bool CommandHandler::received(Message &msg)
 
 void StatusThread::run()
 {
-    // Check if we should emit cdr status
-    Time now;
-    s_mutex.lock();
-    for (ObjList* o = s_cdrs.skipNull();o;o = o->skipNext()) {
-	CdrBuilder* cdr = static_cast<CdrBuilder*>(o->get());
-	if (cdr->getStatus() != YSTRING("answered"))
-	    continue;
-	if (cdr->m_statusTime && (cdr->m_statusTime < now.msec())) {
-	    cdr->emit("status");
-	    cdr->m_statusTime = s_statusUpdate ? (now.msec() + s_statusUpdate) : (u_int64_t)-1;
-	}
-    }
-    s_mutex.unlock();
-
-    // Check cdrs for timeout and emit cdr status
+    // Expire hungup guards and emit cdr status from the shard timers
     while (!m_exit) {
 	Thread::msleep(m_maxSleep);
-	Lock lock(s_mutex);
+	RLock cfg(s_cfgLock);
 	Time t;
-	for (ObjList* o = s_cdrs.skipNull();o;o = o->skipNext()) {
-	    CdrBuilder* cdr = static_cast<CdrBuilder*>(o->get());
-	    if (cdr->m_statusTime && (cdr->m_statusTime < t.msec())) {
-		cdr->emit("status");
-		cdr->m_statusTime = s_statusUpdate ? (t.msec() + s_statusUpdate) : (u_int64_t)-1;
-	    }
-	}
+	for (int i = 0; i < CDR_SHARDS; i++)
+	    s_shards[i].timerTick(t);
     }
 }
 
@@ -849,7 +1020,7 @@ void CdrBuildPlugin::initialize()
 	exp = 0;
     else if (exp > 600000)
 	exp = 600000;
-    s_mutex.lock();
+    s_cfgLock.writeLock();
     Hungup::s_exp = 1000 * (u_int64_t)exp;
     s_params.clear();
     const struct _params* params = s_defParams;
@@ -891,12 +1062,9 @@ void CdrBuildPlugin::initialize()
 	s_statusUpdate = sUpdate * 1000;
     s_ringOnProgress = cfg.getBoolValue("general","ring_on_progress",false);;
 
-    if (s_cdrStatus && !s_updaterThread) {
+    if (!s_updaterThread) {
 	s_updaterThread = new StatusThread();
 	s_updaterThread->startup();
-    } else if (s_updaterThread && !s_cdrStatus) {
-	s_updaterThread->exit();
-	s_updaterThread = 0;
     }
 
     while (true) {
@@ -929,7 +1097,7 @@ void CdrBuildPlugin::initialize()
 	break;
     }
 
-    s_mutex.unlock();
+    s_cfgLock.unlock();
     if (m_first) {
 	m_first = false;
 	s_runId = Engine::runId();
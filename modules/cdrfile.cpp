@@ -2,7 +2,7 @@
  * cdrfile.cpp
  * This file is part of the YATE Project http://YATE.null.ro
  *
- * Write the CDR to a text file
+ * Write the CDR to a text or binary file
  *
  * Yet Another Telephony Engine - a fully featured software PBX and IVR
  * Copyright (C) 2004-2023 Null Team
@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <stdio.h>
 
 #ifdef _WINDOWS
 #define EOLN "\r\n"
@@ -33,10 +34,16 @@
 #define EOLN "\n"
 #endif
 
+// Magic at the start of binary CDR files
+#define CDR_BINARY_MAGIC "YCDR"
+// Version of the binary CDR file layout
+#define CDR_BINARY_VERSION 1
+
 using namespace TelEngine;
 namespace { // anonymous
 
 class CdrFileHandler;
+class CdrFileWriter;
 
 class CdrFilePlugin : public Plugin
 {
@@ -50,40 +57,159 @@ private:
 
 INIT_PLUGIN(CdrFilePlugin);
 
+// One formatted CDR waiting in the writer queue
+class CdrRecord
+{
+public:
+    inline CdrRecord()
+	: m_next(0)
+	{ }
+    CdrRecord* m_next;
+    DataBlock m_data;
+};
+
+// A column of the binary output, holds the parameter name and its default
+class CdrColumn : public String
+{
+public:
+    inline CdrColumn(const String& name, const String& def)
+	: String(name), m_default(def)
+	{ }
+    String m_default;
+};
+
 class CdrFileHandler : public MessageHandler, public Mutex
 {
+    friend class CdrFileWriter;
 public:
+    enum Sync {
+	SyncNone,
+	SyncWrite,
+	SyncRotate,
+    };
     CdrFileHandler(const char *name)
 	: MessageHandler(name,100,__plugin.name()),
 	  Mutex(false,"CdrFileHandler"),
-	  m_file(-1), m_combined(false)
+	  m_file(-1), m_combined(false), m_binary(false), m_async(false),
+	  m_mode(0640), m_sync(SyncNone), m_flushInterval(100),
+	  m_rotateSize(0), m_rotateInterval(0), m_fileSize(0), m_headerSize(0), m_fileTime(0),
+	  m_cfgLock("CdrFileConfig"), m_queue(0), m_queueMutex(false,"CdrFileQueue"),
+	  m_writer(0)
 	{ }
     virtual ~CdrFileHandler();
     virtual bool received(Message &msg);
-    void init(const char *fname, bool tabsep, bool combined, const char* format, int mode);
+    void init(const NamedList& params, const String& fname);
 private:
+    void format(const Message& msg, DataBlock& data);
+    void enqueue(CdrRecord* rec);
+    CdrRecord* dequeue();
+    void flush();
+    void startWriter();
+    void stopWriter();
+    void openFile();
+    void closeFile();
+    void rotate();
+    void writeData(const void* data, unsigned int len);
     int m_file;
     bool m_combined;
+    bool m_binary;
+    bool m_async;
+    int m_mode;
+    int m_sync;
+    unsigned int m_flushInterval;
+    int64_t m_rotateSize;
+    unsigned int m_rotateInterval;
+    int64_t m_fileSize;
+    int64_t m_headerSize;
+    unsigned int m_fileTime;
+    String m_fileName;
     String m_format;
+    ObjList m_columns;
+    // protects the format and output settings, the handler mutex protects the file
+    RWLock m_cfgLock;
+    // queued records in reverse order, pushed without locking when possible
+    CdrRecord* volatile m_queue;
+    Mutex m_queueMutex;
+    CdrFileWriter* m_writer;
 };
 
+// Collects the queued CDRs and writes them to the file in one operation
+class CdrFileWriter : public Thread
+{
+public:
+    inline CdrFileWriter(CdrFileHandler* handler)
+	: Thread("CdrFile Writer"),
+	  m_handler(handler)
+	{ }
+    virtual ~CdrFileWriter();
+    virtual void run();
+private:
+    CdrFileHandler* m_handler;
+};
+
+static const TokenDict s_syncs[] = {
+    { "no",     CdrFileHandler::SyncNone },
+    { "write",  CdrFileHandler::SyncWrite },
+    { "rotate", CdrFileHandler::SyncRotate },
+    { 0, 0 },
+};
+
+// Append a big endian 16 bit length followed by at most 65535 bytes
+static void putString(DataBlock& data, const String& str)
+{
+    unsigned int len = str.length();
+    if (len > 0xffff)
+	len = 0xffff;
+    unsigned char buf[2];
+    buf[0] = (unsigned char)(len >> 8);
+    buf[1] = (unsigned char)len;
+    data.append(buf,2);
+    data.append((void*)str.c_str(),len);
+}
+
+
+CdrFileWriter::~CdrFileWriter()
+{
+    Lock lock(m_handler);
+    if (m_handler->m_writer == this)
+	m_handler->m_writer = 0;
+}
+
+void CdrFileWriter::run()
+{
+    u_int64_t next = Time::msecNow() + m_handler->m_flushInterval;
+    while (!Thread::check(false)) {
+	Thread::idle();
+	u_int64_t now = Time::msecNow();
+	if (now < next)
+	    continue;
+	m_handler->flush();
+	next = now + m_handler->m_flushInterval;
+    }
+    // write anything queued while we were cancelled
+    m_handler->flush();
+}
+
+
 CdrFileHandler::~CdrFileHandler()
 {
+    stopWriter();
+    flush();
     Lock lock(this);
-    if (m_file >= 0) {
-	::close(m_file);
-	m_file = -1;
-    }
+    closeFile();
 }
 
-void CdrFileHandler::init(const char *fname, bool tabsep, bool combined, const char* format, int mode)
+void CdrFileHandler::init(const NamedList& params, const String& fname)
 {
+    // let the writer finish what was already queued
+    stopWriter();
+    WLock cfg(m_cfgLock);
+    flush();
     Lock lock(this);
-    if (m_file >= 0) {
-	::close(m_file);
-	m_file = -1;
-    }
-    m_format = format;
+    closeFile();
+    bool tabsep = params.getBoolValue("tabs",true);
+    bool combined = params.getBoolValue("combined",false);
+    m_format = params.getValue("format");
     m_combined = combined;
     if (m_format.null()) {
 	m_format = tabsep
@@ -104,12 +230,253 @@ void CdrFileHandler::init(const char *fname, bool tabsep, bool combined, const c
 		    ",${billtime},${ringtime},${duration},\"${direction}\",\"${status}\",\"${reason}\""
 	      );
     }
-    if (fname) {
-	m_file = ::open(fname,O_WRONLY|O_CREAT|O_APPEND|O_LARGEFILE,mode);
+    m_binary = (params[YSTRING("output")] == YSTRING("binary"));
+    m_columns.clear();
+    if (m_binary) {
+	// columns are the ${name} or ${name$default} placeholders of the format
+	int p1 = 0;
+	while ((p1 = m_format.find("${",p1)) >= 0) {
+	    int p2 = m_format.find('}',p1 + 2);
+	    if (p2 < 0)
+		break;
+	    String name = m_format.substr(p1 + 2,p2 - p1 - 2);
+	    String def;
+	    int pq = name.find('$');
+	    if (pq >= 0) {
+		def = name.substr(pq + 1).trimBlanks();
+		name = name.substr(0,pq);
+	    }
+	    name.trimBlanks();
+	    if (name)
+		m_columns.append(new CdrColumn(name,def));
+	    p1 = p2 + 1;
+	}
+    }
+    m_mode = params.getIntValue("mode",0640);
+    m_sync = params.getIntValue("fsync",s_syncs,SyncNone);
+    m_rotateSize = params.getInt64Value("rotate_size",0,0);
+    m_rotateInterval = params.getIntValue("rotate_interval",0,0);
+    m_flushInterval = params.getIntValue("flush_interval",100,10,10000);
+    m_async = params.getBoolValue("async",false);
+    m_fileName = fname;
+    openFile();
+    m_async = m_async && (m_file >= 0);
+    lock.drop();
+    cfg.drop();
+    if (m_async)
+	startWriter();
+}
+
+// Start the writer thread, fall back to synchronous writes if that fails
+void CdrFileHandler::startWriter()
+{
+    CdrFileWriter* writer = new CdrFileWriter(this);
+    lock();
+    m_writer = writer;
+    unlock();
+    if (writer->startup())
+	return;
+    Debug("cdrfile",DebugWarn,"Failed to start writer thread, writing synchronously");
+    delete writer;
+    WLock cfg(m_cfgLock);
+    m_async = false;
+    flush();
+}
+
+// Stop the writer thread and wait for it to write the queued records, the handler must not be locked
+void CdrFileHandler::stopWriter()
+{
+    lock();
+    if (m_writer)
+	m_writer->cancel();
+    unlock();
+    for (;;) {
+	lock();
+	bool running = (m_writer != 0);
+	unlock();
+	if (!running)
+	    break;
+	Thread::idle();
+    }
+}
+
+// Open the output file, write the binary header in a new file. The handler must be locked
+void CdrFileHandler::openFile()
+{
+    if (m_fileName.null())
+	return;
+    m_file = ::open(m_fileName,O_WRONLY|O_CREAT|O_APPEND|O_LARGEFILE,m_mode);
+    if (m_file < 0) {
+	Alarm("cdrfile","system",DebugWarn,"Failed to open or create '%s': %s (%d)",
+	    m_fileName.c_str(),::strerror(errno),errno);
+	return;
+    }
+    struct stat st;
+    m_fileSize = ::fstat(m_file,&st) ? 0 : st.st_size;
+    m_headerSize = 0;
+    m_fileTime = Time::secNow();
+    if (!(m_binary && !m_fileSize))
+	return;
+    DataBlock hdr(0,5);
+    ::memcpy(hdr.data(),CDR_BINARY_MAGIC,4);
+    ((unsigned char*)hdr.data())[4] = CDR_BINARY_VERSION;
+    unsigned char buf[2];
+    unsigned int n = m_columns.count();
+    buf[0] = (unsigned char)(n >> 8);
+    buf[1] = (unsigned char)n;
+    hdr.append(buf,2);
+    for (ObjList* o = m_columns.skipNull(); o; o = o->skipNext())
+	putString(hdr,*static_cast<CdrColumn*>(o->get()));
+    writeData(hdr.data(),hdr.length());
+    m_headerSize = m_fileSize;
+}
+
+// Close the output file. The handler must be locked
+void CdrFileHandler::closeFile()
+{
+    if (m_file < 0)
+	return;
+#ifndef _WINDOWS
+    if (m_sync != SyncNone)
+	::fsync(m_file);
+#endif
+    ::close(m_file);
+    m_file = -1;
+}
+
+// Rename the current file with a timestamp suffix and start a new one. The handler must be locked
+void CdrFileHandler::rotate()
+{
+    closeFile();
+    int year = 0;
+    unsigned int month = 0, day = 0, hour = 0, minute = 0, sec = 0;
+    Time::toDateTime(Time::secNow(),year,month,day,hour,minute,sec);
+    char buf[32];
+    ::sprintf(buf,".%04d%02u%02u%02u%02u%02u",year,month,day,hour,minute,sec);
+    String name = m_fileName + buf;
+    for (int i = 1; File::exists(name); i++)
+	name = m_fileName + buf + "-" + String(i);
+    int error = 0;
+    if (File::rename(m_fileName,name,&error))
+	Debug("cdrfile",DebugInfo,"Rotated '%s' to '%s'",m_fileName.c_str(),name.c_str());
+    else
+	Alarm("cdrfile","system",DebugWarn,"Failed to rotate '%s': %s (%d)",
+	    m_fileName.c_str(),::strerror(error),error);
+    openFile();
+}
+
+// Write to the output file, rotating it first if needed. The handler must be locked
+void CdrFileHandler::writeData(const void* data, unsigned int len)
+{
+    if (m_file < 0)
+	return;
+    // never rotate a file holding no records
+    if ((m_fileSize > m_headerSize) && ((m_rotateSize && (m_fileSize + len > m_rotateSize)) ||
+	    (m_rotateInterval && (Time::secNow() >= m_fileTime + m_rotateInterval)))) {
+	rotate();
 	if (m_file < 0)
-	    Alarm("cdrfile","system",DebugWarn,"Failed to open or create '%s': %s (%d)",
-		fname,::strerror(errno),errno);
+	    return;
+    }
+    const char* buf = (const char*)data;
+    while (len) {
+	int w = ::write(m_file,buf,len);
+	if (w <= 0) {
+	    if ((w < 0) && (errno == EINTR))
+		continue;
+	    Alarm("cdrfile","system",DebugWarn,"Failed to write to '%s': %s (%d)",
+		m_fileName.c_str(),::strerror(errno),errno);
+	    return;
+	}
+	buf += w;
+	len -= w;
+	m_fileSize += w;
+    }
+#ifndef _WINDOWS
+    if (m_sync == SyncWrite)
+	::fsync(m_file);
+#endif
+}
+
+// Build the record for a CDR in the configured output format
+void CdrFileHandler::format(const Message& msg, DataBlock& data)
+{
+    if (!m_binary) {
+	String str = m_format;
+	str += EOLN;
+	msg.replaceParams(str);
+	data.assign((void*)str.c_str(),str.length());
+	return;
+    }
+    // 32 bit record length, 16 bit column count, then each value
+    data.resize(6);
+    unsigned char* d = (unsigned char*)data.data();
+    unsigned int n = m_columns.count();
+    d[4] = (unsigned char)(n >> 8);
+    d[5] = (unsigned char)n;
+    for (ObjList* o = m_columns.skipNull(); o; o = o->skipNext()) {
+	const CdrColumn* c = static_cast<const CdrColumn*>(o->get());
+	const String* val = msg.getParam(*c);
+	putString(data,val ? *val : c->m_default);
+    }
+    unsigned int len = data.length() - 4;
+    d = (unsigned char*)data.data();
+    d[0] = (unsigned char)(len >> 24);
+    d[1] = (unsigned char)(len >> 16);
+    d[2] = (unsigned char)(len >> 8);
+    d[3] = (unsigned char)len;
+}
+
+void CdrFileHandler::enqueue(CdrRecord* rec)
+{
+#ifdef YATOMIC_BUILTIN
+    CdrRecord* head;
+    do {
+	head = m_queue;
+	rec->m_next = head;
+    } while (!__sync_bool_compare_and_swap(&m_queue,head,rec));
+#else
+    Lock lock(m_queueMutex);
+    rec->m_next = m_queue;
+    m_queue = rec;
+#endif
+}
+
+// Take all queued records, return them oldest first
+CdrRecord* CdrFileHandler::dequeue()
+{
+#ifdef YATOMIC_BUILTIN
+    CdrRecord* rec = __sync_lock_test_and_set(&m_queue,(CdrRecord*)0);
+#else
+    m_queueMutex.lock();
+    CdrRecord* rec = m_queue;
+    m_queue = 0;
+    m_queueMutex.unlock();
+#endif
+    CdrRecord* list = 0;
+    while (rec) {
+	CdrRecord* next = rec->m_next;
+	rec->m_next = list;
+	list = rec;
+	rec = next;
+    }
+    return list;
+}
+
+// Write all queued records in a single operation
+void CdrFileHandler::flush()
+{
+    CdrRecord* rec = dequeue();
+    if (!rec)
+	return;
+    DataBlock buf;
+    while (rec) {
+	buf += rec->m_data;
+	CdrRecord* next = rec->m_next;
+	delete rec;
+	rec = next;
     }
+    Lock lock(this);
+    writeData(buf.data(),buf.length());
 }
 
 bool CdrFileHandler::received(Message &msg)
@@ -122,13 +489,20 @@ bool CdrFileHandler::received(Message &msg)
     if (!msg.getBoolValue("cdrwrite",true))
         return false;
 
-    Lock lock(this);
-    if ((m_file >= 0) && m_format) {
-	String str = m_format;
-	str += EOLN;
-	msg.replaceParams(str);
-	YIGNORE(::write(m_file,str.c_str(),str.length()));
+    RLock cfg(m_cfgLock);
+    if (m_fileName.null() || m_format.null())
+	return false;
+    if (m_async) {
+	// format here, the writer thread does the disk access
+	CdrRecord* rec = new CdrRecord;
+	format(msg,rec->m_data);
+	enqueue(rec);
+	return false;
     }
+    DataBlock data;
+    format(msg,data);
+    Lock lock(this);
+    writeData(data.data(),data.length());
     return false;
 };
 
@@ -154,11 +528,10 @@ void CdrFilePlugin::initialize()
 	m_handler = new CdrFileHandler("call.cdr");
 	Engine::install(m_handler);
     }
-    if (m_handler)
-	m_handler->init(file,cfg.getBoolValue("general","tabs",true),
-	    cfg.getBoolValue("general","combined",false),
-	    cfg.getValue("general","format"),
-	    cfg.getIntValue("general","mode",0640));
+    if (m_handler) {
+	const NamedList* sect = cfg.getSection("general");
+	m_handler->init(sect ? *sect : NamedList::empty(),file);
+    }
 }
 
 }; // anonymous namespace
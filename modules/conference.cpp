@@ -22,6 +22,13 @@
  */
 
 #include <yatephone.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace TelEngine;
 namespace { // anonymous
@@ -33,6 +40,9 @@ namespace { // anonymous
 #define MAX_SPEAKERS 8
 #define DEF_SPEAKERS 3
 
+// maximum number of loudest speakers we mix in limited mode
+#define MAX_MIXED 16
+
 // Speaking detector energy square hysteresis
 #define SPEAK_HIST_MIN 16384
 #define SPEAK_HIST_MAX 32768
@@ -146,6 +156,8 @@ private:
     unsigned int m_minBuffer;
     unsigned int m_maxBuffer;
     unsigned int m_dataChunk;
+    int m_mixSpeakers;
+    DataBlock m_mixBuf;
 };
 
 // A conference channel is just a dumb holder of its data channels
@@ -189,7 +201,7 @@ class ConfConsumer : public DataConsumer
 public:
     ConfConsumer(ConfRoom* room, bool smart = false)
 	: m_room(room), m_src(0), m_muted(false), m_smart(smart), m_speak(false),
-	  m_energy2(ENERGY_MIN), m_noise2(ENERGY_MIN), m_envelope2(ENERGY_MIN)
+	  m_mixed(false), m_energy2(ENERGY_MIN), m_noise2(ENERGY_MIN), m_envelope2(ENERGY_MIN)
 	{ DDebug(DebugAll,"ConfConsumer::ConfConsumer(%p,%s) [%p]",room,String::boolText(smart),this); m_format = room->getFormat(); }
     ~ConfConsumer()
 	{ DDebug(DebugAll,"ConfConsumer::~ConfConsumer() [%p]",this); }
@@ -215,17 +227,19 @@ public:
     inline bool shouldMix() const
 	{ return hasSignal() && (m_buffer.length() > 1); }
 private:
-    void consumed(const int* mixed, unsigned int samples);
-    void dataForward(const int* mixed, unsigned int samples);
+    void consumed(const int* mixed, unsigned int samples, const DataBlock& shared);
+    void dataForward(const int* mixed, unsigned int samples, const DataBlock& shared);
     RefPointer<ConfRoom> m_room;
     ConfSource* m_src;
     bool m_muted;
     bool m_smart;
     bool m_speak;
+    bool m_mixed;
     unsigned int m_energy2;
     unsigned int m_noise2;
     unsigned int m_envelope2;
     DataBlock m_buffer;
+    DataBlock m_output;
 };
 
 // Per channel data source with that channel's data removed from the mix
@@ -294,6 +308,76 @@ public:
     virtual bool received(Message& msg);
 };
 
+// Add signed linear samples to the mixing buffer
+static void mixAdd(int* buf, const int16_t* src, unsigned int n)
+{
+    unsigned int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+	__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+	__m256i* d = (__m256i*)(buf + i);
+	_mm256_storeu_si256(d,_mm256_add_epi32(_mm256_loadu_si256(d),s));
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+	__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+	// sign extend the 16 bit samples to 32 bit
+	__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v,v),16);
+	__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v,v),16);
+	__m128i* d = (__m128i*)(buf + i);
+	_mm_storeu_si128(d,_mm_add_epi32(_mm_loadu_si128(d),lo));
+	_mm_storeu_si128(d + 1,_mm_add_epi32(_mm_loadu_si128(d + 1),hi));
+    }
+#endif
+    for (; i < n; i++)
+	buf[i] += src[i];
+}
+
+// Saturate symmetrically the mix, optionally substract own samples first
+static void mixOutput(int16_t* dst, const int* mixed, unsigned int n,
+    const int16_t* own = 0, unsigned int nOwn = 0)
+{
+    if (!own || (nOwn > n))
+	nOwn = own ? n : 0;
+    unsigned int i = 0;
+#if defined(__AVX2__)
+    const __m256i minVal = _mm256_set1_epi16(-32767);
+    for (; i + 16 <= n; i += 16) {
+	__m256i a = _mm256_loadu_si256((const __m256i*)(mixed + i));
+	__m256i b = _mm256_loadu_si256((const __m256i*)(mixed + i + 8));
+	if (i + 16 <= nOwn) {
+	    a = _mm256_sub_epi32(a,_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i))));
+	    b = _mm256_sub_epi32(b,_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i + 8))));
+	}
+	else if (i < nOwn)
+	    break;
+	// packing works per 128 bit lane so put the 64 bit halves back in order
+	__m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(a,b),0xd8);
+	_mm256_storeu_si256((__m256i*)(dst + i),_mm256_max_epi16(r,minVal));
+    }
+#elif defined(__SSE2__)
+    const __m128i minVal = _mm_set1_epi16(-32767);
+    for (; i + 8 <= n; i += 8) {
+	__m128i a = _mm_loadu_si128((const __m128i*)(mixed + i));
+	__m128i b = _mm_loadu_si128((const __m128i*)(mixed + i + 4));
+	if (i + 8 <= nOwn) {
+	    __m128i v = _mm_loadu_si128((const __m128i*)(own + i));
+	    a = _mm_sub_epi32(a,_mm_srai_epi32(_mm_unpacklo_epi16(v,v),16));
+	    b = _mm_sub_epi32(b,_mm_srai_epi32(_mm_unpackhi_epi16(v,v),16));
+	}
+	else if (i < nOwn)
+	    break;
+	_mm_storeu_si128((__m128i*)(dst + i),_mm_max_epi16(_mm_packs_epi32(a,b),minVal));
+    }
+#endif
+    for (; i < n; i++) {
+	int val = mixed[i];
+	if (i < nOwn)
+	    val -= own[i];
+	dst[i] = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+    }
+}
+
 // Count the position of the most significant 1 bit - pretty close to logarithm
 static unsigned int binLog(unsigned int x)
 {
@@ -336,6 +420,7 @@ ConfRoom::ConfRoom(const String& name, const NamedList& params)
     DDebug(&__plugin,DebugInfo,"ConfRoom::ConfRoom('%s',%p) rate=%d maxusers=%d [%p]",
 	name.c_str(),&params,m_rate,m_maxusers,this);
     m_maxLock = params.getIntValue("waitlock",m_maxLock);
+    m_mixSpeakers = params.getIntValue("mixspeakers",0,0,MAX_MIXED);
     m_notify = params.getValue("notify");
     m_trackSpeakers = params.getIntValue("speakers",0);
     if (m_trackSpeakers < 0)
@@ -554,6 +639,8 @@ void ConfRoom::msgStatus(Message& msg)
     msg.retValue() << ",users=" << m_users;
     msg.retValue() << ",chans=" << m_chans.count();
     msg.retValue() << ",owners=" << m_owners.count();
+    if (m_mixSpeakers)
+	msg.retValue() << ",mixspeakers=" << m_mixSpeakers;
     if (m_notify)
 	msg.retValue() << ",notify=" << m_notify;
     if (m_playerId)
@@ -658,6 +745,8 @@ void ConfRoom::mix(ConfConsumer* cons)
 {
     unsigned int len = m_maxBuffer;
     unsigned int mlen = 0;
+    ConfConsumer* loudest[MAX_MIXED];
+    int loud = 0;
     Lock mylock(this);
     // find out the minimum and maximum amount of data in buffers
     ObjList* l = m_chans.skipNull();
@@ -670,6 +759,20 @@ void ConfRoom::mix(ConfConsumer* cons)
 		len = buffered;
 	    if (mlen < buffered)
 		mlen = buffered;
+	    // keep the loudest consumers sorted by decreasing energy
+	    if (m_mixSpeakers && co->shouldMix()) {
+		int pos = loud;
+		while (pos && (loudest[pos-1]->energy2() < co->energy2())) {
+		    if (pos < m_mixSpeakers)
+			loudest[pos] = loudest[pos-1];
+		    pos--;
+		}
+		if (pos < m_mixSpeakers) {
+		    loudest[pos] = co;
+		    if (loud < m_mixSpeakers)
+			loud++;
+		}
+	    }
 	}
     }
     XDebug(&__plugin,DebugAll,"ConfRoom::mix() buffer %u - %u [%p]",len,mlen,this);
@@ -694,14 +797,23 @@ void ConfRoom::mix(ConfConsumer* cons)
 	speakChan[spk] = 0;
     }
     len = len * m_dataChunk / sizeof(int16_t);
-    DataBlock mixbuf(0,len*sizeof(int));
-    int* buf = (int*)mixbuf.data();
+    m_mixBuf.resize(len*sizeof(int));
+    int* buf = (int*)m_mixBuf.data();
+    ::memset(buf,0,len*sizeof(int));
     for (l = m_chans.skipNull(); l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
 	ConfConsumer* co = static_cast<ConfConsumer*>(ch->getConsumer());
 	if (co) {
 	    // avoid mixing in noise
-	    if (co->shouldMix()) {
+	    co->m_mixed = co->shouldMix();
+	    if (co->m_mixed && m_mixSpeakers) {
+		// in limited mode mix only the loudest ones
+		int i = 0;
+		while ((i < loud) && (loudest[i] != co))
+		    i++;
+		co->m_mixed = (i < loud);
+	    }
+	    if (co->m_mixed) {
 		unsigned int n = co->m_buffer.length() / 2;
 #ifdef XDEBUG
 		if (ch->debugAt(DebugAll)) {
@@ -719,9 +831,7 @@ void ConfRoom::mix(ConfConsumer* cons)
 #endif
 		if (n > len)
 		    n = len;
-		const int16_t* p = (const int16_t*)co->m_buffer.data();
-		for (unsigned int i=0; i < n; i++)
-		    buf[i] += *p++;
+		mixAdd(buf,(const int16_t*)co->m_buffer.data(),n);
 	    }
 	    if (m_trackSpeakers && m_notify && !ch->isUtility() && co->speaking()) {
 		int vol = co->envelope();
@@ -738,21 +848,16 @@ void ConfRoom::mix(ConfConsumer* cons)
 	    }
 	}
     }
+    // the full mix is also sent to all channels that were not mixed in
+    DataBlock data(0,len*sizeof(int16_t));
+    mixOutput((int16_t*)data.data(),buf,len);
     // we finished mixing - notify consumers about it
     for (l = m_chans.skipNull(); l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
 	ConfConsumer* co = static_cast<ConfConsumer*>(ch->getConsumer());
 	if (co)
-	    co->consumed(buf,len);
+	    co->consumed(buf,len,data);
     }
-    DataBlock data(0,len*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < len; i++) {
-	int val = buf[i];
-	// saturate symmetrically the result of addition
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
-    }
-    mixbuf.clear();
     Message* m = 0;
     while (m_trackSpeakers && m_notify) {
 	u_int64_t now = Time::now();
@@ -956,11 +1061,11 @@ unsigned long ConfConsumer::Consume(const DataBlock& data, unsigned long tStamp,
 
 // Take out of the buffer the samples mixed in or skipped
 //  this method is called with the room locked
-void ConfConsumer::consumed(const int* mixed, unsigned int samples)
+void ConfConsumer::consumed(const int* mixed, unsigned int samples, const DataBlock& shared)
 {
     if (!samples)
 	return;
-    dataForward(mixed,samples);
+    dataForward(mixed,samples,shared);
     unsigned int n = m_buffer.length() / 2;
     if (samples > n) {
 	// buffer underflowed
@@ -980,7 +1085,8 @@ void ConfConsumer::consumed(const int* mixed, unsigned int samples)
 }
 
 // Substract our own data from the mix and send it on the no-echo source
-void ConfConsumer::dataForward(const int* mixed, unsigned int samples)
+//  if we were not mixed in send the shared full mix instead
+void ConfConsumer::dataForward(const int* mixed, unsigned int samples, const DataBlock& shared)
 {
     if (!(m_src && mixed))
 	return;
@@ -991,19 +1097,16 @@ void ConfConsumer::dataForward(const int* mixed, unsigned int samples)
     if (!src)
 	return;
 
-    int16_t* d = (int16_t*)m_buffer.data();
-    unsigned int n = m_buffer.length() / 2;
-    DataBlock data(0,samples*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < samples; i++) {
-	int val = *mixed++;
-	// substract our own data if we contributed - only as much as we have
-	if ((i < n) && shouldMix())
-	    val -= d[i];
-	// saturate symmetrically the result of additions and substraction
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+    if (!m_mixed) {
+	src->Forward(shared);
+	return;
     }
-    src->Forward(data);
+    // substract our own data since we contributed - only as much as we have
+    //  the output block is reused as we are called with the room locked
+    m_output.resize(samples*sizeof(int16_t));
+    mixOutput((int16_t*)m_output.data(),mixed,samples,
+	(const int16_t*)m_buffer.data(),m_buffer.length() / 2);
+    src->Forward(m_output);
 }
 
 unsigned int ConfConsumer::energy() const
@@ -61,6 +61,14 @@ namespace { // anonymous
 // Safety wait time after we flushed watchers, relays or messages (in ms)
 #define WAIT_FLUSH 5
 
+// Maximum number of names interned in each direction with binary framing
+#define MAX_INTERNED 4096
+
+// Binary frame types
+#define FRAME_LINE    'L'
+#define FRAME_MESSAGE '>'
+#define FRAME_RETURN  '<'
+
 static Configuration s_cfg;
 static ObjList s_chans;
 static ObjList s_modules;
@@ -177,6 +185,8 @@ public:
 	{ return Message::decode(str,m_id); }
     inline const String& id() const
 	{ return m_id; }
+    inline void setId(const String& id)
+	{ m_id = id; }
 private:
     ExtModReceiver* m_receiver;
     String m_id;
@@ -195,6 +205,62 @@ public:
 	{ return &m_msg; }
 };
 
+// Builder of outgoing binary frames, keeps its memory between frames
+class FrameBuffer
+{
+public:
+    inline FrameBuffer()
+	: m_data(0), m_len(0), m_size(0)
+	{ }
+    inline ~FrameBuffer()
+	{ ::free(m_data); }
+    inline const unsigned char* data() const
+	{ return m_data; }
+    inline unsigned int length() const
+	{ return m_len; }
+    void start(unsigned char type);
+    void finish();
+    void putByte(unsigned char val);
+    void putVarint(unsigned int val);
+    void putBytes(const void* buf, unsigned int len);
+    inline void putString(const String& str)
+	{ putVarint(str.length()); putBytes(str.c_str(),str.length()); }
+private:
+    void reserve(unsigned int len);
+    unsigned char* m_data;
+    unsigned int m_len;
+    unsigned int m_size;
+};
+
+// Sequential reader of an incoming binary frame
+class FrameReader
+{
+public:
+    inline FrameReader(const unsigned char* data, unsigned int len)
+	: m_data(data), m_len(len)
+	{ }
+    inline bool eof() const
+	{ return !m_len; }
+    bool getByte(unsigned char& val);
+    bool getVarint(unsigned int& val);
+    bool getBytes(String& str, unsigned int len);
+    inline bool getString(String& str)
+	{ unsigned int len = 0; return getVarint(len) && getBytes(str,len); }
+private:
+    const unsigned char* m_data;
+    unsigned int m_len;
+};
+
+// A name interned in the outgoing direction
+class InternedName : public String
+{
+public:
+    inline InternedName(const String& name, unsigned int index)
+	: String(name), m_index(index)
+	{ }
+    unsigned int m_index;
+};
+
 // Yet Another of Maciek's ideas
 class MsgWatcher : public MessagePostHook
 {
@@ -230,7 +296,9 @@ public:
     virtual void destruct();
     virtual bool received(Message& msg, int id);
     bool processLine(const char* line);
+    bool processFrame(const unsigned char* data, unsigned int len);
     bool outputLine(const char* line);
+    bool outputMessage(const Message& msg, const char* id, int accepted = -1);
     void reportError(const char* line);
     void returnMsg(const Message* msg, const char* id, bool accepted);
     bool addWatched(const String& name);
@@ -265,6 +333,14 @@ private:
     void closeOut();
     void closeAudio();
     bool outputLineInternal(const char* line, int len);
+    bool outputData(const void* data, int len);
+    bool lockOutput(int len);
+    void unlockOutput();
+    void startMessage(ExtMessage* m);
+    void msgReturned(ObjList* item);
+    void putName(const String& name);
+    bool getName(FrameReader& reader, String& name);
+    bool decodeFrame(FrameReader& reader, Message& msg);
     int m_role;
     bool m_dead;
     bool m_quit;
@@ -282,6 +358,7 @@ private:
     bool m_setdata;
     bool m_settime;
     bool m_writing;
+    bool m_binary;
     int m_maxQueue;
     int m_timeout;
     bool m_timebomb;
@@ -294,6 +371,10 @@ private:
     String m_trackName;
     String m_reason;
     String m_debugName;
+    FrameBuffer m_frame;
+    HashList m_outNames;
+    ObjVector m_inNames;
+    unsigned int m_inCount;
 };
 
 class ExtThread : public Thread
@@ -631,6 +712,99 @@ bool MsgHolder::decode(const char *s)
 }
 
 
+// Start a new frame, the length is filled in by finish()
+void FrameBuffer::start(unsigned char type)
+{
+    m_len = 0;
+    reserve(5);
+    ::memset(m_data,0,4);
+    m_data[4] = type;
+    m_len = 5;
+}
+
+// Store the big endian length of type and payload in frame header
+void FrameBuffer::finish()
+{
+    unsigned int len = m_len - 4;
+    m_data[0] = (unsigned char)(len >> 24);
+    m_data[1] = (unsigned char)(len >> 16);
+    m_data[2] = (unsigned char)(len >> 8);
+    m_data[3] = (unsigned char)len;
+}
+
+void FrameBuffer::putByte(unsigned char val)
+{
+    reserve(1);
+    m_data[m_len++] = val;
+}
+
+// Unsigned LEB128, 7 bits per octet, least significant first
+void FrameBuffer::putVarint(unsigned int val)
+{
+    reserve(5);
+    while (val >= 0x80) {
+	m_data[m_len++] = (unsigned char)(val | 0x80);
+	val >>= 7;
+    }
+    m_data[m_len++] = (unsigned char)val;
+}
+
+void FrameBuffer::putBytes(const void* buf, unsigned int len)
+{
+    if (!len)
+	return;
+    reserve(len);
+    ::memcpy(m_data + m_len,buf,len);
+    m_len += len;
+}
+
+void FrameBuffer::reserve(unsigned int len)
+{
+    if (m_len + len <= m_size)
+	return;
+    unsigned int size = m_size ? m_size : 1024;
+    while (size < m_len + len)
+	size <<= 1;
+    m_data = static_cast<unsigned char*>(::realloc(m_data,size));
+    m_size = size;
+}
+
+
+bool FrameReader::getByte(unsigned char& val)
+{
+    if (!m_len)
+	return false;
+    val = *m_data++;
+    m_len--;
+    return true;
+}
+
+bool FrameReader::getVarint(unsigned int& val)
+{
+    val = 0;
+    for (unsigned int shift = 0; shift < 32; shift += 7) {
+	if (!m_len)
+	    return false;
+	unsigned char c = *m_data++;
+	m_len--;
+	val |= ((unsigned int)(c & 0x7f)) << shift;
+	if (!(c & 0x80))
+	    return true;
+    }
+    return false;
+}
+
+bool FrameReader::getBytes(String& str, unsigned int len)
+{
+    if (len > m_len)
+	return false;
+    str.assign(reinterpret_cast<const char*>(m_data),len);
+    m_data += len;
+    m_len -= len;
+    return true;
+}
+
+
 ExtMessage::~ExtMessage()
 {
     if (m_receiver) {
@@ -800,9 +974,10 @@ ExtModReceiver::ExtModReceiver(const char* script, const char* args, File* ain,
       m_role(RoleUnknown), m_dead(false), m_quit(false), m_use(1), m_qLength(0), m_pid(-1),
       m_in(0), m_out(0), m_ain(ain), m_aout(aout),
       m_chan(chan), m_watcher(0),
-      m_selfWatch(false), m_reenter(false), m_setdata(true), m_settime(s_settime), m_writing(false),
+      m_selfWatch(false), m_reenter(false), m_setdata(true), m_settime(s_settime), m_writing(false), m_binary(false),
       m_maxQueue(s_maxQueue), m_timeout(s_timeout), m_timebomb(s_timebomb), m_restart(false), m_scripted(false),
-      m_buffer(0,DEF_INCOMING_LINE), m_script(script), m_args(args), m_trackName(s_trackName)
+      m_buffer(0,DEF_INCOMING_LINE), m_script(script), m_args(args), m_trackName(s_trackName),
+      m_outNames(61), m_inCount(0)
 {
     debugChain(&__plugin);
     debugName(m_script);
@@ -820,9 +995,10 @@ ExtModReceiver::ExtModReceiver(const char* name, Stream* io, ExtModChan* chan, i
       m_role(role), m_dead(false), m_quit(false), m_use(1), m_qLength(0), m_pid(-1),
       m_in(io), m_out(io), m_ain(0), m_aout(0),
       m_chan(chan), m_watcher(0),
-      m_selfWatch(false), m_reenter(false), m_setdata(true), m_settime(s_settime), m_writing(false),
+      m_selfWatch(false), m_reenter(false), m_setdata(true), m_settime(s_settime), m_writing(false), m_binary(false),
       m_maxQueue(s_maxQueue), m_timeout(s_timeout), m_timebomb(s_timebomb), m_restart(false), m_scripted(false),
-      m_buffer(0,DEF_INCOMING_LINE), m_script(name), m_args(conn), m_trackName(s_trackName)
+      m_buffer(0,DEF_INCOMING_LINE), m_script(name), m_args(conn), m_trackName(s_trackName),
+      m_outNames(61), m_inCount(0)
 {
     debugChain(&__plugin);
     debugName(m_script);
@@ -1032,7 +1208,7 @@ bool ExtModReceiver::received(Message &msg, int id)
     bool fail = false;
     u_int64_t tout = (m_timeout > 0) ? Time::now() + 1000 * m_timeout : 0;
     MsgHolder h(msg);
-    if (outputLine(msg.encode(h.m_id))) {
+    if (outputMessage(msg,h.m_id)) {
 	m_qLength++;
 	m_waiting.append(&h)->setDelete(false);
 	DDebug(DebugAll,"ExtMod queued message #%u %p '%s' [%p]",m_qLength,&msg,msg.c_str(),this);
@@ -1238,19 +1414,23 @@ void ExtModReceiver::run()
 	}
 	buffer[totalsize] = 0;
 	for (;;) {
-	    char *eoline = ::strchr(buffer,'\n');
-	    if (!eoline && ((int)::strlen(buffer) < totalsize))
-		eoline=buffer+::strlen(buffer);
-	    if (!eoline)
-		break;
-	    *eoline = 0;
-	    if ((eoline > buffer) && (eoline[-1] == '\r'))
-		eoline[-1] = 0;
-	    readsize = eoline-buffer+1;
-	    if (buffer[0]) {
-		invalid = invalid && (buffer[0] != '%' || buffer[1] != '%');
+	    if (m_binary) {
+		// each frame is prefixed by its big endian length
+		if (totalsize < 4)
+		    break;
+		const unsigned char* frame = reinterpret_cast<const unsigned char*>(buffer);
+		unsigned int flen = ((unsigned int)frame[0] << 24) | ((unsigned int)frame[1] << 16) |
+		    ((unsigned int)frame[2] << 8) | frame[3];
+		if (flen + 5 > m_buffer.length() || flen + 5 < flen) {
+		    Debug("ExtModule",DebugWarn,"Frame of length %u overflows buffer of length %u, closing [%p]",
+			flen,m_buffer.length(),this);
+		    return;
+		}
+		readsize = flen + 4;
+		if (totalsize < readsize)
+		    break;
 		use();
-		bool goOut = processLine(buffer);
+		bool goOut = processFrame(frame + 4,flen);
 		if (unuse() || goOut)
 		    return;
 		if (totalsize >= (int)m_buffer.length()) {
@@ -1259,6 +1439,29 @@ void ExtModReceiver::run()
 		    return;
 		}
 	    }
+	    else {
+		char *eoline = ::strchr(buffer,'\n');
+		if (!eoline && ((int)::strlen(buffer) < totalsize))
+		    eoline=buffer+::strlen(buffer);
+		if (!eoline)
+		    break;
+		*eoline = 0;
+		if ((eoline > buffer) && (eoline[-1] == '\r'))
+		    eoline[-1] = 0;
+		readsize = eoline-buffer+1;
+		if (buffer[0]) {
+		    invalid = invalid && (buffer[0] != '%' || buffer[1] != '%');
+		    use();
+		    bool goOut = processLine(buffer);
+		    if (unuse() || goOut)
+			return;
+		    if (totalsize >= (int)m_buffer.length()) {
+			Debug("ExtModule",DebugWarn,"Lost data shrinking read buffer to %u, closing [%p]",
+			    m_buffer.length(),this);
+			return;
+		    }
+		}
+	    }
 	    totalsize -= readsize;
 	    buffer = static_cast<char*>(m_buffer.data());
 	    ::memmove(buffer,buffer+readsize,totalsize+1);
@@ -1272,6 +1475,63 @@ bool ExtModReceiver::outputLine(const char* line)
     if (TelEngine::null(line))
 	return true;
     int len = ::strlen(line);
+    if (!lockOutput(len))
+	return false;
+    bool ok = false;
+    if (m_binary) {
+	// text commands and answers still flow, wrapped in their own frame
+	m_frame.start(FRAME_LINE);
+	m_frame.putBytes(line,len);
+	m_frame.finish();
+	ok = outputData(m_frame.data(),m_frame.length());
+    }
+    else
+	ok = outputLineInternal(line,len);
+    unlockOutput();
+    return ok;
+}
+
+// Send a message (accepted < 0) or the result of a message to the application
+bool ExtModReceiver::outputMessage(const Message& msg, const char* id, int accepted)
+{
+    // encode text outside the write section, framing switches only to binary
+    String line;
+    if (!m_binary)
+	line = (accepted < 0) ? msg.encode(id) : msg.encode(accepted > 0,id);
+    if (!lockOutput(line.length()))
+	return false;
+    bool ok = false;
+    if (m_binary) {
+	// interned names must be assigned in the order they are written
+	m_frame.start((accepted < 0) ? FRAME_MESSAGE : FRAME_RETURN);
+	m_frame.putString(id);
+	if (accepted < 0)
+	    m_frame.putVarint(msg.msgTime().sec());
+	else
+	    m_frame.putByte(accepted ? 1 : 0);
+	putName(msg);
+	m_frame.putString(msg.retValue());
+	m_frame.putVarint(msg.count());
+	for (const ObjList* l = msg.paramList()->skipNull(); l; l = l->skipNext()) {
+	    const NamedString* s = static_cast<const NamedString*>(l->get());
+	    putName(s->name());
+	    m_frame.putVarint(s->length() + 1);
+	    m_frame.putBytes(s->c_str(),s->length());
+	}
+	m_frame.finish();
+	XDebug("ExtModReceiver",DebugAll,"outputMessage '%s' frame len=%u [%p]",
+	    msg.c_str(),m_frame.length(),this);
+	ok = outputData(m_frame.data(),m_frame.length());
+    }
+    else
+	ok = outputLineInternal(line,line.length());
+    unlockOutput();
+    return ok;
+}
+
+// Wait until we are the single writer, holds an use reference on success
+bool ExtModReceiver::lockOutput(int len)
+{
     if (m_dead || !m_out || !m_out->valid() || !use())
 	return false;
     uint64_t tout = (m_timeout > 0) ? (Time::now() + 1000 * (uint64_t)m_timeout) : 0;
@@ -1283,7 +1543,7 @@ bool ExtModReceiver::outputLine(const char* line)
 	}
 	if (!m_writing) {
 	    m_writing = true;
-	    break;
+	    return true;
 	}
 	if (tout && tout < Time::now()) {
 	    if (!m_quit)
@@ -1295,29 +1555,19 @@ bool ExtModReceiver::outputLine(const char* line)
 	mylock.drop();
 	Thread::idle();
     }
-    bool ok = outputLineInternal(line,len);
+}
+
+void ExtModReceiver::unlockOutput()
+{
     m_writing = false;
     unuse();
-    return ok;
 }
 
 bool ExtModReceiver::outputLineInternal(const char* line, int len)
 {
     DDebug("ExtModReceiver",DebugAll,"outputLine len=%d '%s' [%p]",len,line,this);
-    // since m_out can be non-blocking (the socket) we have to loop
-    while (m_out && m_out->valid() && (len > 0) && !m_dead) {
-	int w = m_out->writeData(line,len);
-	if (w < 0) {
-	    if (m_dead || !m_out || !m_out->canRetry())
-		return false;
-	}
-	else {
-	    line += w;
-	    len -= w;
-	}
-	if (len > 0)
-	    Thread::idle();
-    }
+    if (!outputData(line,len))
+	return false;
     char nl = '\n';
     for (;;) {
 	if (m_dead || !m_out)
@@ -1333,6 +1583,26 @@ bool ExtModReceiver::outputLineInternal(const char* line, int len)
     }
 }
 
+bool ExtModReceiver::outputData(const void* data, int len)
+{
+    const char* buf = static_cast<const char*>(data);
+    // since m_out can be non-blocking (the socket) we have to loop
+    while (m_out && m_out->valid() && (len > 0) && !m_dead) {
+	int w = m_out->writeData(buf,len);
+	if (w < 0) {
+	    if (m_dead || !m_out || !m_out->canRetry())
+		return false;
+	}
+	else {
+	    buf += w;
+	    len -= w;
+	}
+	if (len > 0)
+	    Thread::idle();
+    }
+    return (len <= 0);
+}
+
 void ExtModReceiver::reportError(const char* line)
 {
     Debug("ExtModReceiver",DebugWarn,"Error: '%s'", line);
@@ -1341,8 +1611,7 @@ void ExtModReceiver::reportError(const char* line)
 
 void ExtModReceiver::returnMsg(const Message* msg, const char* id, bool accepted)
 {
-    String ret(msg->encode(accepted,id));
-    if (!outputLine(ret) && m_timebomb)
+    if (!outputMessage(*msg,id,accepted ? 1 : 0) && m_timebomb)
 	die();
 }
 
@@ -1415,15 +1684,7 @@ bool ExtModReceiver::processLine(const char* line)
 	for (; p; p=p->next()) {
 	    MsgHolder *msg = static_cast<MsgHolder *>(p->get());
 	    if (msg && msg->decode(line)) {
-		DDebug("ExtModReceiver",DebugInfo,"Matched message %p [%p]",msg->msg(),this);
-		if (m_chan && (m_chan->waitMsg() == msg->msg())) {
-		    DDebug("ExtModReceiver",DebugNote,"Entering wait mode on channel %p [%p]",m_chan,this);
-		    m_chan->waitMsg(0);
-		    m_chan->waiting(true);
-		}
-		msg->unlock();
-		if (p->remove(false) && (m_qLength > 0))
-		    m_qLength--;
+		msgReturned(p);
 		return false;
 	    }
 	}
@@ -1600,6 +1861,22 @@ bool ExtModReceiver::processLine(const char* line)
 		val = m_selfWatch;
 		ok = true;
 	    }
+	    else if (id == "framing") {
+		if ((val == YSTRING("binary")) && !m_binary) {
+		    // the answer is the last text line, switch before anybody else writes
+		    mylock.drop();
+		    String out("%%<setlocal:framing:binary:true");
+		    if (!lockOutput(out.length()))
+			return false;
+		    m_binary = outputLineInternal(out,out.length());
+		    unlockOutput();
+		    Debug("ExtModReceiver",DebugInfo,"Switched to binary framing [%p]",this);
+		    return false;
+		}
+		// switching back to text framing is not supported
+		ok = val.null() || (val == (m_binary ? "binary" : "text"));
+		val = m_binary ? "binary" : "text";
+	    }
 	    else if (id.startsWith("engine.")) {
 		// keep the index in substr in sync with length of "engine."
 		const NamedString* param = Engine::runParams().getParam(id.substr(7));
@@ -1667,59 +1944,227 @@ bool ExtModReceiver::processLine(const char* line)
 	ExtMessage* m = new ExtMessage;
 	if (m->decode(line) == -2) {
 	    DDebug("ExtModReceiver",DebugAll,"Created message %p '%s' [%p]",m,m->c_str(),this);
-	    lock();
-	    bool note = true;
-	    while (!m_dead && m_chan && m_chan->waiting()) {
-		if (note) {
-		    note = false;
-		    Debug("ExtModReceiver",DebugNote,"Waiting before enqueueing new message %p '%s' [%p]",
-			m,m->c_str(),this);
+	    startMessage(m);
+	    return false;
+	}
+	m->destruct();
+    }
+    reportError(line);
+    return false;
+}
+
+// Enqueue a message decoded from the application
+void ExtModReceiver::startMessage(ExtMessage* m)
+{
+    lock();
+    bool note = true;
+    while (!m_dead && m_chan && m_chan->waiting()) {
+	if (note) {
+	    note = false;
+	    Debug("ExtModReceiver",DebugNote,"Waiting before enqueueing new message %p '%s' [%p]",
+		m,m->c_str(),this);
+	}
+	unlock();
+	Thread::yield();
+	if (m_dead) {
+	    m->destruct();
+	    return;
+	}
+	lock();
+    }
+    ExtModChan* chan = 0;
+    if ((m_role == RoleChannel) && !m_chan && m_setdata && (*m == "call.execute")) {
+	// we delayed channel creation as there was nothing to ref() it
+	chan = new ExtModChan(this);
+	m_chan = chan;
+	m->setParam("id",chan->id());
+    }
+    if (m_setdata)
+	m->userData(m_chan);
+    // now the newly created channel is referenced by the message
+    if (chan)
+	chan->deref();
+    const String& id = m->id();
+    if (id && !chan) {
+	// Copy the user data pointer from waiting message with same id
+	ObjList *p = &m_waiting;
+	for (; p; p=p->next()) {
+	    MsgHolder *h = static_cast<MsgHolder *>(p->get());
+	    if (h && (h->m_id == id)) {
+		RefObject* ud = h->m_msg.userData();
+		Debug("ExtModReceiver",DebugAll,"Copying data pointer %p from %p '%s' [%p]",
+		    ud,h->msg(),h->msg()->c_str(),this);
+		m->userData(ud);
+		break;
+	    }
+	}
+    }
+    if (m_settime || !m->msgTime())
+	m->msgTime() = Time::now();
+    m->startup(this);
+    unlock();
+}
+
+// Release the worker waiting for a message that just returned, call with lock held
+void ExtModReceiver::msgReturned(ObjList* item)
+{
+    MsgHolder* msg = static_cast<MsgHolder*>(item->get());
+    DDebug("ExtModReceiver",DebugInfo,"Matched message %p [%p]",msg->msg(),this);
+    if (m_chan && (m_chan->waitMsg() == msg->msg())) {
+	DDebug("ExtModReceiver",DebugNote,"Entering wait mode on channel %p [%p]",m_chan,this);
+	m_chan->waitMsg(0);
+	m_chan->waiting(true);
+    }
+    msg->unlock();
+    if (item->remove(false) && (m_qLength > 0))
+	m_qLength--;
+}
+
+// Write a name, interning it if there is room left in the table
+void ExtModReceiver::putName(const String& name)
+{
+    const InternedName* n = static_cast<const InternedName*>(m_outNames[name]);
+    if (n) {
+	m_frame.putVarint(n->m_index + 2);
+	return;
+    }
+    if (m_outNames.count() < MAX_INTERNED) {
+	m_outNames.append(new InternedName(name,m_outNames.count()));
+	m_frame.putVarint(1);
+    }
+    else
+	m_frame.putVarint(0);
+    m_frame.putString(name);
+}
+
+// Read a name: 0 - literal, 1 - literal to intern, 2+ - index of interned name
+bool ExtModReceiver::getName(FrameReader& reader, String& name)
+{
+    unsigned int idx = 0;
+    if (!reader.getVarint(idx))
+	return false;
+    if (idx >= 2) {
+	if (idx - 2 >= m_inCount)
+	    return false;
+	const String* s = static_cast<const String*>(m_inNames[idx - 2]);
+	if (!s)
+	    return false;
+	name = *s;
+	return true;
+    }
+    if (!reader.getString(name))
+	return false;
+    if (idx == 1) {
+	if (m_inCount >= MAX_INTERNED)
+	    return false;
+	if (m_inCount >= m_inNames.length())
+	    m_inNames.resize(m_inCount ? 2 * m_inCount : 64,true);
+	m_inNames.set(new String(name),m_inCount++);
+    }
+    return true;
+}
+
+// Decode name, return value and parameters, an empty value clears a parameter
+bool ExtModReceiver::decodeFrame(FrameReader& reader, Message& msg)
+{
+    String tmp;
+    if (!getName(reader,tmp))
+	return false;
+    if (tmp)
+	msg = tmp;
+    if (!reader.getString(msg.retValue()))
+	return false;
+    unsigned int n = 0;
+    if (!reader.getVarint(n))
+	return false;
+    while (n--) {
+	String name;
+	unsigned int len = 0;
+	if (!(getName(reader,name) && name && reader.getVarint(len)))
+	    return false;
+	if (!len) {
+	    msg.clearParam(name);
+	    continue;
+	}
+	if (!reader.getBytes(tmp,len - 1))
+	    return false;
+	msg.setParam(name,tmp);
+    }
+    return reader.eof();
+}
+
+// Process one binary frame, returns true to stop processing
+bool ExtModReceiver::processFrame(const unsigned char* data, unsigned int len)
+{
+    if (m_dead)
+	return false;
+    if (m_quit)
+	return true;
+    if (!len) {
+	Debug("ExtModReceiver",DebugWarn,"Received empty frame [%p]",this);
+	return true;
+    }
+    FrameReader reader(data + 1,len - 1);
+    switch (data[0]) {
+	case FRAME_LINE:
+	    {
+		String line;
+		reader.getBytes(line,len - 1);
+		return processLine(line);
+	    }
+	case FRAME_RETURN:
+	    {
+		String id;
+		unsigned char handled = 0;
+		if (!(reader.getString(id) && reader.getByte(handled)))
+		    break;
+		Lock mylock(this);
+		ObjList* p = m_waiting.skipNull();
+		for (; p; p = p->skipNext()) {
+		    if (static_cast<MsgHolder*>(p->get())->m_id == id)
+			break;
 		}
-		unlock();
-		Thread::yield();
-		if (m_dead) {
-		    m->destruct();
+		if (p) {
+		    MsgHolder* msg = static_cast<MsgHolder*>(p->get());
+		    if (!decodeFrame(reader,msg->m_msg))
+			break;
+		    msg->m_ret = (handled != 0);
+		    msgReturned(p);
 		    return false;
 		}
-		lock();
-	    }
-	    ExtModChan* chan = 0;
-	    if ((m_role == RoleChannel) && !m_chan && m_setdata && (*m == "call.execute")) {
-		// we delayed channel creation as there was nothing to ref() it
-		chan = new ExtModChan(this);
-		m_chan = chan;
-		m->setParam("id",chan->id());
+		// decode anyway to keep interned names in sync
+		Message tmp("");
+		if (!decodeFrame(reader,tmp))
+		    break;
+		Debug("ExtModReceiver",(m_dead ? DebugInfo : DebugWarn),
+		    "Unmatched%s message: %s [%p]",(m_dead ? " dead" : ""),id.c_str(),this);
+		return false;
 	    }
-	    if (m_setdata)
-		m->userData(m_chan);
-	    // now the newly created channel is referenced by the message
-	    if (chan)
-		chan->deref();
-	    id = m->id();
-	    if (id && !chan) {
-		// Copy the user data pointer from waiting message with same id
-		ObjList *p = &m_waiting;
-		for (; p; p=p->next()) {
-		    MsgHolder *h = static_cast<MsgHolder *>(p->get());
-		    if (h && (h->m_id == id)) {
-			RefObject* ud = h->m_msg.userData();
-			Debug("ExtModReceiver",DebugAll,"Copying data pointer %p from %p '%s' [%p]",
-			    ud,h->msg(),h->msg()->c_str(),this);
-			m->userData(ud);
-			break;
-		    }
+	case FRAME_MESSAGE:
+	    {
+		String id;
+		unsigned int tm = 0;
+		if (!(reader.getString(id) && reader.getVarint(tm)))
+		    break;
+		ExtMessage* m = new ExtMessage;
+		if (!(decodeFrame(reader,*m) && !m->null())) {
+		    m->destruct();
+		    break;
 		}
+		m->setId(id);
+		m->msgTime() = tm ? ((u_int64_t)1000000) * tm : Time::now();
+		DDebug("ExtModReceiver",DebugAll,"Created message %p '%s' [%p]",m,m->c_str(),this);
+		startMessage(m);
+		return false;
 	    }
-	    if (m_settime || !m->msgTime())
-		m->msgTime() = Time::now();
-	    m->startup(this);
-	    unlock();
-	    return false;
-	}
-	m->destruct();
+	default:
+	    Debug("ExtModReceiver",DebugWarn,"Received unknown frame type 0x%02x [%p]",data[0],this);
+	    return true;
     }
-    reportError(line);
-    return false;
+    // interned names may be out of sync now, there is no way to recover
+    Debug("ExtModReceiver",DebugWarn,"Received invalid frame type '%c' length %u [%p]",
+	data[0],len,this);
+    return true;
 }
 
 void ExtModReceiver::describe(String& rval) const
@@ -175,6 +175,8 @@ public:
     void msgPostExecute(const Message& msg, bool handled);
     inline JsParser& parser()
 	{ return m_assistCode; }
+    bool prepareRunner();
+    void clearPrepared();
 protected:
     virtual void statusParams(String& str);
     virtual bool commandExecute(String& retVal, const String& line);
@@ -185,10 +187,23 @@ private:
     JsParser m_assistCode;
     MessagePostHook* m_postHook;
     bool m_started;
+    ObjList m_prepared;
+    unsigned int m_preparedCount;
 };
 
 INIT_PLUGIN(JsModule);
 
+// Thread building routing contexts ahead of the channels that will use them
+class JsPrepareThread : public Thread
+{
+public:
+    inline JsPrepareThread()
+	: Thread("JsPrepare")
+	{ }
+    virtual void run();
+    virtual void cleanup();
+};
+
 class ScriptInfo : public ScriptRunData
 {
     YCLASS(ScriptInfo,ScriptRunData)
@@ -367,7 +382,7 @@ public:
     virtual bool msgRoute(Message& msg);
     virtual bool msgDisconnect(Message& msg, const String& reason);
     void msgPostExecute(const Message& msg, bool handled);
-    bool init();
+    bool init(bool prepared = false);
     bool evalAllocations(String& retVal, unsigned int top);
     inline State state() const
 	{ return m_state; }
@@ -1132,6 +1147,12 @@ public:
 	    params().addParam(new ExpFunction("scriptInfo"));
 	}
     static void initialize(ScriptContext* context, const char* name = 0);
+    inline void setName(const char* name) {
+	    m_id.printf("%s(%p)",name,this);
+	    m_schedName.clear();
+	    m_schedName << "js:" << name;
+	    params().setParam(new ExpOperation(name,"name"));
+	}
     inline void resetWorker()
 	{ m_worker = 0; }
     inline const String& id() const
@@ -1994,6 +2015,8 @@ static bool s_trackObj = false;
 static unsigned int s_trackCreation = 0;
 static bool s_autoExt = true;
 static unsigned int s_maxFile = 500000;
+static unsigned int s_prepareAssist = 0;
+static JsPrepareThread* s_prepareThread = 0;
 
 const TokenDict ScriptInfo::s_type[] = {
     {"static",  Static},
@@ -7513,14 +7536,27 @@ const char* JsAssist::stateName(State st)
     return lookup(st,s_states,"???");
 }
 
-bool JsAssist::init()
+bool JsAssist::init(bool prepared)
 {
     if (!m_runner)
 	return false;
-    contextInit(m_runner,id(),s_autoExt,this);
-    if (ScriptRun::Invalid == m_runner->reset(true))
-	return false;
     ScriptContext* ctx = m_runner->context();
+    if (prepared) {
+	// common objects and global functions were already set up, add our own
+	Lock mylock(ctx->mutex());
+	JsEngine* eng = JsEngine::get(ctx);
+	if (eng)
+	    eng->setName(id());
+	mylock.drop();
+	JsChannel::initialize(ctx,this);
+	if (s_autoExt)
+	    contextLoad(ctx,id());
+    }
+    else {
+	contextInit(m_runner,id(),s_autoExt,this);
+	if (ScriptRun::Invalid == m_runner->reset(true))
+	    return false;
+    }
     ctx->trackObjs(s_trackCreation);
     ScriptContext* chan = YOBJECT(ScriptContext,ctx->getField(m_runner->stack(),YSTRING("Channel"),m_runner));
     if (chan) {
@@ -8189,7 +8225,7 @@ static const char* s_cmdsLine = "  javascript {info|eval[=context] instructions.
 
 JsModule::JsModule()
     : ChanAssistList("javascript",true),
-      m_postHook(0), m_started(Engine::started())
+      m_postHook(0), m_started(Engine::started()), m_preparedCount(0)
 {
     Output("Loaded module Javascript");
 }
@@ -8198,6 +8234,67 @@ JsModule::~JsModule()
 {
     Output("Unloading module Javascript");
     clearPostHook();
+    clearPrepared();
+}
+
+// Build one routing context ahead of time, return false if there is nothing to do
+bool JsModule::prepareRunner()
+{
+    Lock lck(JsGlobal::s_mutex);
+    if (m_preparedCount >= s_prepareAssist)
+	return false;
+    ScriptRun* runner = m_assistCode.createRunner(0,NATIVE_TITLE);
+    lck.drop();
+    if (!runner)
+	return false;
+    contextInit(runner,0,false);
+    if (ScriptRun::Invalid != runner->reset(true)) {
+	lck.acquire(JsGlobal::s_mutex);
+	// the routing script may have been reloaded meanwhile
+	if ((runner->code() == m_assistCode.code()) && (m_preparedCount < s_prepareAssist)) {
+	    m_prepared.append(runner);
+	    m_preparedCount++;
+	    return true;
+	}
+	lck.drop();
+    }
+    ScriptContext* ctx = runner->context();
+    if (ctx) {
+	Lock mylock(ctx->mutex());
+	ctx->params().clearParams();
+    }
+    TelEngine::destruct(runner);
+    return true;
+}
+
+// Drop all prepared routing contexts, must be called with JsGlobal::s_mutex held
+void JsModule::clearPrepared()
+{
+    while (ScriptRun* runner = static_cast<ScriptRun*>(m_prepared.remove(false))) {
+	ScriptContext* ctx = runner->context();
+	if (ctx) {
+	    Lock mylock(ctx->mutex());
+	    ctx->params().clearParams();
+	}
+	TelEngine::destruct(runner);
+    }
+    m_preparedCount = 0;
+}
+
+
+void JsPrepareThread::run()
+{
+    while (s_prepareAssist && !Engine::exiting()) {
+	if (!__plugin.prepareRunner())
+	    Thread::idle();
+    }
+}
+
+void JsPrepareThread::cleanup()
+{
+    Lock lck(JsGlobal::s_mutex);
+    if (s_prepareThread == this)
+	s_prepareThread = 0;
 }
 
 void JsModule::clearPostHook()
@@ -8225,6 +8322,8 @@ void JsModule::statusParams(String& str)
     Lock lck(JsGlobal::s_mutex);
     str << "globals=" << JsGlobal::globals().count()
 	<< ",handlers=" << JsGlobal::handlers().count();
+    if (s_prepareAssist)
+	str << ",prepared=" << m_preparedCount;
     lck.acquire(this);
     str << ",routing=" << calls().count();
 }
@@ -8602,13 +8701,18 @@ ChanAssist* JsModule::create(Message& msg, const String& id)
     if ((msg == YSTRING("chan.startup")) && (msg[YSTRING("direction")] == YSTRING("outgoing")))
 	return 0;
     Lock lck(JsGlobal::s_mutex);
-    ScriptRun* runner = m_assistCode.createRunner(0,NATIVE_TITLE);
+    ScriptRun* runner = static_cast<ScriptRun*>(m_prepared.remove(false));
+    bool prepared = (0 != runner);
+    if (prepared)
+	m_preparedCount--;
+    else
+	runner = m_assistCode.createRunner(0,NATIVE_TITLE);
     lck.drop();
     if (!runner)
 	return 0;
-    DDebug(this,DebugInfo,"Creating Javascript for '%s'",id.c_str());
+    DDebug(this,DebugInfo,"Creating Javascript for '%s'%s",id.c_str(),prepared ? " from prepared context" : "");
     JsAssist* ca = new JsAssist(this,id,runner);
-    if (ca->init())
+    if (ca->init(prepared))
 	return ca;
     TelEngine::destruct(ca);
     return 0;
@@ -8616,8 +8720,13 @@ ChanAssist* JsModule::create(Message& msg, const String& id)
 
 bool JsModule::unload()
 {
+    s_prepareAssist = 0;
+    while (s_prepareThread)
+	Thread::idle();
     clearPostHook();
     uninstallRelays();
+    Lock lck(JsGlobal::s_mutex);
+    clearPrepared();
     return true;
 }
 
@@ -8671,6 +8780,19 @@ void JsModule::initialize()
 	    Debug(this,DebugInfo,"Parsed routing script: %s",tmp.c_str());
 	else if (tmp)
 	    Debug(this,DebugWarn,"Failed to parse script: %s",tmp.c_str());
+	clearPrepared();
+    }
+    s_prepareAssist = cfg.getIntValue("general","prepare_routing",0,0,1000);
+    if (m_preparedCount > s_prepareAssist)
+	clearPrepared();
+    if (s_prepareAssist && m_assistCode.code() && !s_prepareThread) {
+	JsPrepareThread* th = new JsPrepareThread;
+	if (th->startup())
+	    s_prepareThread = th;
+	else {
+	    Debug(this,DebugWarn,"Failed to start routing context preparing thread");
+	    delete th;
+	}
     }
     JsGlobal::markUnused();
     lck.drop();
@@ -109,10 +109,15 @@ public:
 
     bool writeData(XmlFragment* frag);
 private:
+    bool negotiate(const char* buffer, int len);
+    bool processFrames();
+    bool writeBuffer(const void* buffer, int len, void* obj);
     Socket* m_socket;
     String m_address;
     TcapXApplication* m_app;
     MyDomParser m_parser;
+    bool m_negotiated;
+    DataBlock m_frames;
 };
 
 class XMLConnListener : public Thread
@@ -262,6 +267,8 @@ public:
 	{ return m_printMsg; }
     inline bool addEncoding()
 	{ return m_addEnc; }
+    inline bool allowBinary()
+	{ return m_allowBinary; }
     inline unsigned int applicationCount()
     {
 	Lock l(m_appsMtx);
@@ -276,6 +283,7 @@ protected:
     UserType m_type;
     bool m_printMsg;
     bool m_addEnc;
+    bool m_allowBinary;
     SCCPManagement::LocalBroadcast m_mngtStatus;
 };
 
@@ -335,6 +343,11 @@ public:
 	DataMissing,
 	UnexpectedDataValue,
     };
+    enum Protocol {
+	XmlProtocol,
+	BinaryProtocol,
+	RawProtocol,
+    };
     TcapXApplication(const char* name, Socket* skt, TcapXUser* user);
     ~TcapXApplication();
     bool hasCapability(const char* oper);
@@ -363,6 +376,9 @@ public:
 	{ return m_type; }
     inline bool addEncoding()
 	{ return (m_user ? m_user->addEncoding() : false); }
+    inline Protocol protocol()
+	{ return m_protocol; }
+    bool setProtocol(Protocol proto);
 
 private:
     IDMap m_ids;
@@ -379,6 +395,7 @@ private:
     TcapToXml m_tcap2Xml;
     XmlToTcap m_xml2Tcap;
     TcapXUser::UserType m_type;
+    Protocol m_protocol;
 };
 
 class TcapXModule : public Module
@@ -430,6 +447,7 @@ const String s_namespace = "http://yate.null.ro/xml/tcap/v1";
 static const String s_msgTag = "m";
 static const String s_capabTag = "c";
 static const String s_component = "component";
+static const String s_payloadTag = "payload";
 static const String s_typeStr = "type";
 static const String s_tagAttr = "tag";
 static const String s_encAttr = "enc";
@@ -6833,6 +6851,19 @@ static const TokenDict s_appStates[] = {
     {0, 0},
 };
 
+static const TokenDict s_protocols[] = {
+    {"xml",     TcapXApplication::XmlProtocol},
+    {"binary",  TcapXApplication::BinaryProtocol},
+    {"raw",     TcapXApplication::RawProtocol},
+    {0, 0},
+};
+
+// Prefaces sent by an application as first octets to select the binary protocols
+static const char s_binaryPreface[] = "TCXB";
+static const char s_rawPreface[] = "TCXR";
+// Maximum accepted length of a binary frame
+static const unsigned int s_maxFrame = 65536;
+
 static const TokenDict s_userTypes[] = {
     {"MAP",     TcapXUser::MAP},
     {"CAMEL",   TcapXUser::CAMEL},
@@ -7087,13 +7118,138 @@ void MyDomParser::verifyRoot()
     }
 }
 
+/**
+ * Binary protocol
+ * A frame is made of a 4 octets big endian length followed by the message element.
+ * An element is encoded as its tag, attribute count, attribute name and value pairs,
+ *  children count and children, each child preceded by a kind octet (element or text).
+ * Counts and string lengths are variable length, 7 bits per octet, low order first
+ */
+#define BIN_CHILD_ELEMENT 1
+#define BIN_CHILD_TEXT    2
+#define BIN_MAX_DEPTH     64
+
+static void binPutLength(DataBlock& buf, unsigned int len)
+{
+    while (len >= 0x80) {
+	buf.append1((uint8_t)(len | 0x80));
+	len >>= 7;
+    }
+    buf.append1((uint8_t)len);
+}
+
+static void binPutString(DataBlock& buf, const String& str)
+{
+    binPutLength(buf,str.length());
+    if (str.length())
+	buf.append(str.c_str(),str.length(),false);
+}
+
+static void binPutElement(DataBlock& buf, XmlElement* elem)
+{
+    binPutString(buf,elem->getTag());
+    const NamedList& attrs = elem->attributes();
+    binPutLength(buf,attrs.count());
+    for (ObjList* o = attrs.paramList()->skipNull(); o; o = o->skipNext()) {
+	NamedString* ns = static_cast<NamedString*>(o->get());
+	binPutString(buf,ns->name());
+	binPutString(buf,*ns);
+    }
+    unsigned int count = 0;
+    for (ObjList* o = elem->getChildren().skipNull(); o; o = o->skipNext()) {
+	XmlChild* c = static_cast<XmlChild*>(o->get());
+	if (c->xmlElement() || c->xmlText())
+	    count++;
+    }
+    binPutLength(buf,count);
+    for (ObjList* o = elem->getChildren().skipNull(); o; o = o->skipNext()) {
+	XmlChild* c = static_cast<XmlChild*>(o->get());
+	if (c->xmlElement()) {
+	    buf.append1(BIN_CHILD_ELEMENT);
+	    binPutElement(buf,c->xmlElement());
+	}
+	else if (c->xmlText()) {
+	    buf.append1(BIN_CHILD_TEXT);
+	    binPutString(buf,c->xmlText()->getText());
+	}
+    }
+}
+
+static bool binGetLength(const unsigned char*& buf, unsigned int& len, unsigned int& val)
+{
+    val = 0;
+    for (unsigned int shift = 0; len && shift < 32; shift += 7) {
+	unsigned char c = *buf++;
+	len--;
+	val |= (unsigned int)(c & 0x7f) << shift;
+	if (!(c & 0x80))
+	    return true;
+    }
+    return false;
+}
+
+static bool binGetString(const unsigned char*& buf, unsigned int& len, String& str)
+{
+    unsigned int n = 0;
+    if (!(binGetLength(buf,len,n) && n <= len))
+	return false;
+    str.assign((const char*)buf,n);
+    buf += n;
+    len -= n;
+    return true;
+}
+
+static XmlElement* binGetElement(const unsigned char*& buf, unsigned int& len, unsigned int depth = 0)
+{
+    String tag;
+    unsigned int count = 0;
+    if (depth > BIN_MAX_DEPTH || !binGetString(buf,len,tag) || tag.null() || !binGetLength(buf,len,count))
+	return 0;
+    XmlElement* elem = new XmlElement(tag);
+    String name;
+    String value;
+    for (; count; count--) {
+	if (!(binGetString(buf,len,name) && binGetString(buf,len,value))) {
+	    TelEngine::destruct(elem);
+	    return 0;
+	}
+	elem->setAttribute(name,value);
+    }
+    if (!binGetLength(buf,len,count)) {
+	TelEngine::destruct(elem);
+	return 0;
+    }
+    for (; count; count--) {
+	XmlChild* child = 0;
+	if (len) {
+	    len--;
+	    switch (*buf++) {
+		case BIN_CHILD_ELEMENT:
+		    child = binGetElement(buf,len,depth + 1);
+		    break;
+		case BIN_CHILD_TEXT:
+		    if (binGetString(buf,len,value))
+			child = new XmlText(value);
+		    break;
+	    }
+	}
+	if (!child) {
+	    TelEngine::destruct(elem);
+	    return 0;
+	}
+	elem->addChild(child);
+    }
+    return elem;
+}
+
 /**
  * XMLConnection
  */
 XMLConnection::XMLConnection(Socket* skt, TcapXApplication* app)
     : Thread("XMLConnection"),
       m_socket(skt), m_app(app),
-      m_parser(app,"MyDomParser",false)
+      m_parser(app,"MyDomParser",false),
+      m_negotiated(false), m_frames(1024)
 {
     Debug(&__plugin,DebugAll,"XMLConnection created with socket=[%p] for application=%s[%p] [%p]",skt,app->toString().c_str(),app,this);
     m_app->ref();
@@ -7161,6 +7317,17 @@ void XMLConnection::run()
 	buffer[readSize] = 0;
 	XDebug(&__plugin,DebugAll,"READ %d : %s",readSize,buffer);
 
+	if (!m_negotiated) {
+	    if (!negotiate(buffer,readSize))
+		break;
+	    continue;
+	}
+	if (m_app->protocol() != TcapXApplication::XmlProtocol) {
+	    m_frames.append(buffer,readSize,false);
+	    if (!processFrames())
+		break;
+	    continue;
+	}
 	if (!m_parser.parse(buffer)) {
 	    if (m_parser.error() != XmlSaxParser::Incomplete) {
 		Debug(&__plugin,DebugWarn,"Parser error %s in read data [%p] unparsed type %d, buffer = %s, pushed = %s",
@@ -7171,6 +7338,67 @@ void XMLConnection::run()
     }
 }
 
+// Select the protocol from the first octets sent by the application
+bool XMLConnection::negotiate(const char* buffer, int len)
+{
+    m_frames.append(buffer,len,false);
+    const char* data = (const char*)m_frames.data();
+    unsigned int n = m_frames.length();
+    if (n < 4 && (!::strncmp(data,s_binaryPreface,n) || !::strncmp(data,s_rawPreface,n)))
+	return true;
+    m_negotiated = true;
+    TcapXApplication::Protocol proto = TcapXApplication::XmlProtocol;
+    if (n >= 4 && !::strncmp(data,s_binaryPreface,4))
+	proto = TcapXApplication::BinaryProtocol;
+    else if (n >= 4 && !::strncmp(data,s_rawPreface,4))
+	proto = TcapXApplication::RawProtocol;
+    if (proto != TcapXApplication::XmlProtocol) {
+	if (!m_app->setProtocol(proto))
+	    return false;
+	m_frames.cut(-4);
+	return processFrames();
+    }
+    String xml(data,n);
+    m_frames.clear();
+    if (!m_parser.parse(xml) && m_parser.error() != XmlSaxParser::Incomplete) {
+	Debug(&__plugin,DebugWarn,"Parser error %s in read data [%p] unparsed type %d, buffer = %s, pushed = %s",
+	    m_parser.getError(),this,m_parser.unparsed(),m_parser.getBuffer().c_str(),xml.c_str());
+	return false;
+    }
+    return true;
+}
+
+// Handle all complete binary frames received so far
+bool XMLConnection::processFrames()
+{
+    while (m_frames.length() >= 4) {
+	const unsigned char* data = (const unsigned char*)m_frames.data();
+	unsigned int len = ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) |
+	    ((unsigned int)data[2] << 8) | data[3];
+	if (len > s_maxFrame) {
+	    Debug(&__plugin,DebugWarn,"XMLConnection[%p] received frame of %u octets, maximum is %u",
+		this,len,s_maxFrame);
+	    return false;
+	}
+	if (m_frames.length() < len + 4)
+	    break;
+	data += 4;
+	unsigned int left = len;
+	XmlElement* elem = binGetElement(data,left);
+	if (!elem || left) {
+	    TelEngine::destruct(elem);
+	    Debug(&__plugin,DebugWarn,"XMLConnection[%p] received invalid frame of %u octets",this,len);
+	    return false;
+	}
+	XmlDocument doc;
+	doc.addChild(new XmlDeclaration);
+	doc.addChild(elem);
+	m_app->receivedXML(&doc);
+	m_frames.cut(-(int)(len + 4));
+    }
+    return true;
+}
+
 void XMLConnection::cleanup()
 {
     DDebug(&__plugin,DebugAll,"XMLConnection::cleanup() [%p]",this);
@@ -7182,11 +7410,33 @@ bool XMLConnection::writeData(XmlFragment* elem)
     if (!elem)
 	return false;
 
+    if (m_app->protocol() != TcapXApplication::XmlProtocol) {
+	XmlElement* root = 0;
+	for (ObjList* o = elem->getChildren().skipNull(); o && !root; o = o->skipNext())
+	    root = static_cast<XmlChild*>(o->get())->xmlElement();
+	if (!root)
+	    return false;
+	DataBlock frame(512);
+	frame.append4(0);
+	binPutElement(frame,root);
+	unsigned int len = frame.length() - 4;
+	unsigned char* data = (unsigned char*)frame.data();
+	data[0] = (unsigned char)(len >> 24);
+	data[1] = (unsigned char)(len >> 16);
+	data[2] = (unsigned char)(len >> 8);
+	data[3] = (unsigned char)len;
+	XDebug(&__plugin,DebugAll,"WRITE frame of %u octets",len);
+	return writeBuffer(frame.data(),frame.length(),elem);
+    }
     String xml;
     elem->toString(xml,true);
     XDebug(&__plugin,DebugAll,"WRITE : %s",xml.c_str());
-    int len = xml.length();
-    const char* buffer = xml.c_str();
+    return writeBuffer(xml.c_str(),xml.length(),elem);
+}
+
+bool XMLConnection::writeBuffer(const void* data, int len, void* elem)
+{
+    const char* buffer = (const char*)data;
     while (m_socket && (len > 0)) {
 	bool writeOk = false,error = false;
 	if (!m_socket->select(0,&writeOk,&error,idleUsec()) || error) {
@@ -7648,7 +7898,10 @@ void TcapToXml::addComponentsToXml(XmlElement* el, NamedList& params, const AppC
 	NamedString* payloadHex = params.getParam(root);
 	if (TelEngine::null(payloadHex))
 	    continue;
-	addParametersToXml(comp,*payloadHex,op,searchArgs);
+	if (m_app->protocol() == TcapXApplication::RawProtocol)
+	    comp->addChild(new XmlElement(s_payloadTag,*payloadHex));
+	else
+	    addParametersToXml(comp,*payloadHex,op,searchArgs);
     }
 }
 
@@ -7957,6 +8210,15 @@ bool XmlToTcap::handleComponent(NamedList& tcapParams, XmlElement* elem, const A
 	}
     }
 
+    // raw protocol applications send the encoded parameters
+    if (m_app->protocol() == TcapXApplication::RawProtocol) {
+	XmlElement* raw = elem->findFirstChild(&s_payloadTag);
+	if (raw) {
+	    tcapParams.setParam(prefix,raw->getText());
+	    return true;
+	}
+    }
+
     DataBlock payload;
     bool searchArgs = (type == SS7TCAP::TC_Invoke || type == SS7TCAP::TC_U_Error ? true : false);
 
@@ -8154,7 +8416,8 @@ TcapXApplication::TcapXApplication(const char* name, Socket* skt, TcapXUser* use
       m_sentTcap(0), m_receivedTcap(0),
       m_state(Waiting),
       m_tcap2Xml(this),
-      m_xml2Tcap(this)
+      m_xml2Tcap(this),
+      m_protocol(XmlProtocol)
 {
     if (skt) {
 	m_io = new XMLConnection(skt,this);
@@ -8264,6 +8527,18 @@ void TcapXApplication::setIO(XMLConnection* io)
 	m_user->removeApp(this);
 }
 
+bool TcapXApplication::setProtocol(Protocol proto)
+{
+    if (proto != XmlProtocol && !(m_user && m_user->allowBinary())) {
+	Debug(&__plugin,DebugInfo,"TcapXApplication=%s - %s protocol not allowed, closing the connection [%p]",
+	    m_name.c_str(),lookup(proto,s_protocols),this);
+	return false;
+    }
+    Debug(&__plugin,DebugAll,"TcapXApplication=%s - using %s protocol [%p]",m_name.c_str(),lookup(proto,s_protocols),this);
+    m_protocol = proto;
+    return true;
+}
+
 bool TcapXApplication::supportCapability(const String& capab)
 {
     if (!findDefCapability(m_type,capab))
@@ -8685,6 +8960,7 @@ void TcapXApplication::status(NamedList& status)
     status.setParam("sentXML",String(m_sentXml));
     status.setParam("receivedTcap",String(m_receivedTcap));
     status.setParam("sentTcap",String(m_sentTcap));
+    status.setParam("protocol",lookup(m_protocol,s_protocols));
 }
 
 const AppCtxt* TcapXApplication::findCtxt(const String& appID, const String& remoteID)
@@ -8712,7 +8988,7 @@ TcapXUser::TcapXUser(const char* name)
       Mutex(true,name),
       m_appsMtx(true,"TCAPXApps"),
       m_listener(0), m_type(MAP),
-      m_printMsg(false), m_addEnc(false),
+      m_printMsg(false), m_addEnc(false), m_allowBinary(true),
       m_mngtStatus(SCCPManagement::UserOutOfService)
 {
     Debug(&__plugin,DebugAll,"TcapXUser '%s' created [%p]",toString().c_str(),this);
@@ -8766,6 +9042,7 @@ bool TcapXUser::initialize(NamedList& sect)
     m_type = (UserType)lookup(sect.getValue(s_typeStr,"MAP"),s_userTypes,m_type);
     m_printMsg = sect.getBoolValue(YSTRING("print-messages"),false);
     m_addEnc = sect.getBoolValue(YSTRING("add-encoding"),false);
+    m_allowBinary = sect.getBoolValue(YSTRING("binary"),true);
     if (!tcap() && !findTCAP(sect.getValue("tcap",0)))
 	return false;
     notifyManagementState(true);
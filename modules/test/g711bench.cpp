@@ -0,0 +1,95 @@
+/**
+ * g711bench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * G.711 and linear PCM conversion microbenchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2023 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatengine.h>
+
+#include <string.h>
+
+using namespace TelEngine;
+
+class G711Bench : public Plugin
+{
+public:
+    G711Bench();
+    virtual void initialize();
+    void bench(const char* sFormat, const char* dFormat, unsigned int frames, unsigned int samples);
+};
+
+G711Bench::G711Bench()
+    : Plugin("g711bench")
+{
+    Output("Hello, I am module G711Bench");
+}
+
+void G711Bench::bench(const char* sFormat, const char* dFormat, unsigned int frames, unsigned int samples)
+{
+    String sFmt(sFormat);
+    String dFmt(dFormat);
+    unsigned int sl = DataBlock::sampleSize(sFmt);
+    unsigned int dl = DataBlock::sampleSize(dFmt);
+    DataBlock src(0,samples * sl);
+    unsigned char* s = (unsigned char*)src.data();
+    for (unsigned int i = 0; i < src.length(); i++)
+	s[i] = (unsigned char)Random::random();
+    DataBlock dest(0,samples * dl);
+
+    // convert into a new block for each frame
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < frames; i++) {
+	DataBlock tmp;
+	tmp.convert(src,sFmt,dFmt);
+    }
+    u_int64_t tBlock = Time::now() - t;
+
+    // convert into a caller provided buffer
+    t = Time::now();
+    for (unsigned int i = 0; i < frames; i++)
+	DataBlock::convert(dest.data(),src.data(),samples,sFmt,dFmt);
+    u_int64_t tBuffer = Time::now() - t;
+
+    // check the result against the block conversion
+    DataBlock check;
+    check.convert(src,sFmt,dFmt);
+    bool ok = (check.length() == dest.length()) &&
+	!::memcmp(check.data(),dest.data(),dest.length());
+    double total = (double)frames * samples;
+    Debug(this,ok ? DebugInfo : DebugWarn,
+	"%s -> %s: %u frames of %u samples, block %.2f ns/sample, buffer %.2f ns/sample%s",
+	sFormat,dFormat,frames,samples,tBlock * 1000.0 / total,tBuffer * 1000.0 / total,
+	ok ? "" : " MISMATCH");
+}
+
+void G711Bench::initialize()
+{
+    Output("Initializing module G711Bench");
+    const Configuration& cfg = Engine::config();
+    unsigned int frames = cfg.getIntValue("g711bench","frames",100000,1);
+    unsigned int samples = cfg.getIntValue("g711bench","samples",160,1,65536);
+    static const char* s_formats[] = { "slin", "alaw", "mulaw" };
+    for (int i = 0; i < 3; i++)
+	for (int j = 0; j < 3; j++)
+	    if (i != j)
+		bench(s_formats[i],s_formats[j],frames,samples);
+}
+
+INIT_PLUGIN(G711Bench);
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -135,6 +135,7 @@ protected:
     virtual bool noChan() const
 	{ return false; }
     virtual void cleanup();
+    virtual u_int64_t frame(u_int64_t when);
     void advanceTone(const Tone*& tone);
     static const ToneDesc* getBlock(String& tone, const ToneDesc* table);
     static const ToneDesc* findToneDesc(String& tone, const String& prefix);
@@ -143,10 +144,19 @@ protected:
     int m_repeat;
     bool m_firstPass;
 private:
+    void begin();
+    void fill();
+    void send();
+    void finish();
     DataBlock m_data;
     unsigned m_brate;
     unsigned m_total;
     u_int64_t m_time;
+    u_int64_t m_tpos;
+    const Tone* m_cur;
+    int m_samp;
+    int m_dpos;
+    int m_nsam;
 };
 
 class TempSource : public ToneSource
@@ -657,7 +667,8 @@ bool ToneData::decode(const String& desc, int& samples, const short*& data, bool
 
 ToneSource::ToneSource(const ToneDesc* tone)
     : m_tone(0), m_repeat(tone == 0), m_firstPass(true),
-      m_data(0,320), m_brate(16000), m_total(0), m_time(0)
+      m_data(0,320), m_brate(16000), m_total(0), m_time(0),
+      m_tpos(0), m_cur(0), m_samp(0), m_dpos(1), m_nsam(0)
 {
     if (tone) {
 	m_tone = tone->tones();
@@ -849,51 +860,91 @@ ToneSource* ToneSource::getTone(String& tone, const String& prefix)
 void ToneSource::run()
 {
     Debug(&__plugin,DebugAll,"ToneSource::run() [%p]",this);
-    u_int64_t tpos = Time::now();
-    m_time = tpos;
-    int samp = 0; // sample number
-    int dpos = 1; // position in data
-    const Tone* tone = m_tone;
-    int nsam = tone->nsamples;
-    if (nsam < 0)
-	nsam = -nsam;
+    begin();
     while (m_tone && looping(noChan())) {
 	Thread::check();
-	short *d = (short *) m_data.data();
-	for (unsigned int i = m_data.length()/2; i--; samp++,dpos++) {
-	    if (samp >= nsam) {
-		// go to the start of the next tone
-		samp = 0;
-		const Tone *otone = tone;
-		advanceTone(tone);
-		nsam = tone ? tone->nsamples : 32000;
-		if (nsam < 0) {
-		    nsam = -nsam;
-		    // reset repeat point here
-		    m_tone = tone;
-		}
-		if (tone != otone)
-		    dpos = 1;
-	    }
-	    if (tone && tone->data) {
-		if (dpos > tone->data[0])
-		    dpos = 1;
-		*d++ = tone->data[dpos];
-	    }
-	    else
-		*d++ = 0;
-	}
-	int64_t dly = tpos - Time::now();
+	fill();
+	int64_t dly = m_tpos - Time::now();
 	if (dly > 0) {
 	    XDebug(&__plugin,DebugAll,"ToneSource sleeping for " FMT64 " usec",dly);
 	    Thread::usleep((unsigned long)dly);
 	}
 	if (!looping(noChan()))
 	    break;
-	Forward(m_data,m_total/2);
-	m_total += m_data.length();
-	tpos += (m_data.length()*(u_int64_t)1000000/m_brate);
+	send();
+    }
+    finish();
+}
+
+// Run one frame on the shared media clock
+u_int64_t ToneSource::frame(u_int64_t when)
+{
+    if (!when) {
+	Debug(&__plugin,DebugAll,"ToneSource::frame() starting on clock [%p]",this);
+	begin();
+	return m_tpos;
+    }
+    if (m_tone && looping(noChan())) {
+	fill();
+	send();
+	return m_tpos;
     }
+    finish();
+    return 0;
+}
+
+// Reset the generator to the start of the tone
+void ToneSource::begin()
+{
+    m_tpos = Time::now();
+    m_time = m_tpos;
+    m_samp = 0;
+    m_dpos = 1;
+    m_cur = m_tone;
+    m_nsam = m_cur ? m_cur->nsamples : 0;
+    if (m_nsam < 0)
+	m_nsam = -m_nsam;
+}
+
+// Generate the samples of the next frame
+void ToneSource::fill()
+{
+    short *d = (short *) m_data.data();
+    for (unsigned int i = m_data.length()/2; i--; m_samp++,m_dpos++) {
+	if (m_samp >= m_nsam) {
+	    // go to the start of the next tone
+	    m_samp = 0;
+	    const Tone *otone = m_cur;
+	    advanceTone(m_cur);
+	    m_nsam = m_cur ? m_cur->nsamples : 32000;
+	    if (m_nsam < 0) {
+		m_nsam = -m_nsam;
+		// reset repeat point here
+		m_tone = m_cur;
+	    }
+	    if (m_cur != otone)
+		m_dpos = 1;
+	}
+	if (m_cur && m_cur->data) {
+	    if (m_dpos > m_cur->data[0])
+		m_dpos = 1;
+	    *d++ = m_cur->data[m_dpos];
+	}
+	else
+	    *d++ = 0;
+    }
+}
+
+// Forward the generated frame and advance the time of the next one
+void ToneSource::send()
+{
+    Forward(m_data,m_total/2);
+    m_total += m_data.length();
+    m_tpos += (m_data.length()*(u_int64_t)1000000/m_brate);
+}
+
+void ToneSource::finish()
+{
     Debug(&__plugin,DebugAll,"ToneSource [%p] end, total=%u (%u b/s)",
 	this,m_total,byteRate(m_time,m_total));
     m_time = 0;
@@ -58,6 +58,48 @@ private:
     bool m_nodata;
 };
 
+// A prompt file loaded in memory and shared by all sources playing it
+class WavePrompt : public RefObject
+{
+public:
+    inline WavePrompt(const String& file, unsigned int mtime, unsigned int len)
+	: m_file(file), m_mtime(mtime), m_data(0,len)
+	{ }
+    virtual const String& toString() const
+	{ return m_file; }
+    inline unsigned int mtime() const
+	{ return m_mtime; }
+    inline const DataBlock& data() const
+	{ return m_data; }
+    bool load(File& file);
+private:
+    String m_file;
+    unsigned int m_mtime;
+    DataBlock m_data;
+};
+
+// Read only stream over a cached prompt
+class PromptStream : public Stream
+{
+public:
+    inline PromptStream(WavePrompt* prompt)
+	: m_prompt(prompt), m_offset(0)
+	{ }
+    virtual bool terminate()
+	{ return true; }
+    virtual bool valid() const
+	{ return true; }
+    virtual int writeData(const void* buffer, int len)
+	{ return -1; }
+    virtual int readData(void* buffer, int len);
+    virtual int64_t length()
+	{ return m_prompt->data().length(); }
+    virtual int64_t seek(SeekPos pos, int64_t offset = 0);
+private:
+    RefPointer<WavePrompt> m_prompt;
+    unsigned int m_offset;
+};
+
 class WaveConsumer : public DataConsumer
 {
 public:
@@ -137,6 +179,18 @@ int s_writing = 0;
 bool s_dataPadding = true;
 bool s_pubReadable = false;
 
+// Prompt cache, least recently used first
+Mutex s_cacheMutex(false,"WaveFile::cache");
+ObjList s_cache;
+unsigned int s_cacheSize = 0;
+unsigned int s_cacheMax = 0;
+unsigned int s_cacheFileMax = 1048576;
+unsigned int s_cacheHits = 0;
+unsigned int s_cacheMisses = 0;
+unsigned int s_cacheEvicted = 0;
+// Files too large to cache, by modification time
+NamedList s_uncached("");
+
 INIT_PLUGIN(WaveFileDriver);
 
 
@@ -186,6 +240,131 @@ static const char* ilbcFormat(Stream& stream)
 }
 
 
+bool WavePrompt::load(File& file)
+{
+    unsigned char* d = (unsigned char*)m_data.data();
+    unsigned int pos = 0;
+    while (pos < m_data.length()) {
+	int r = file.readData(d + pos,m_data.length() - pos);
+	if (r <= 0)
+	    return false;
+	pos += r;
+    }
+    return true;
+}
+
+
+int PromptStream::readData(void* buffer, int len)
+{
+    if ((len <= 0) || !buffer)
+	return -1;
+    const DataBlock& data = m_prompt->data();
+    if (len + m_offset > data.length())
+	len = data.length() - m_offset;
+    if (len <= 0)
+	return 0;
+    ::memcpy(buffer,data.data(m_offset,len),len);
+    m_offset += len;
+    return len;
+}
+
+int64_t PromptStream::seek(SeekPos pos, int64_t offset)
+{
+    switch (pos) {
+	case SeekBegin:
+	    break;
+	case SeekEnd:
+	    offset += length();
+	    break;
+	case SeekCurrent:
+	    offset += m_offset;
+	    break;
+    }
+    if ((offset < 0) || (offset > length()))
+	return -1;
+    m_offset = (unsigned int)offset;
+    return offset;
+}
+
+
+// Drop least recently used prompts until the cache fits in its size limit
+static void trimCache(const WavePrompt* keep = 0)
+{
+    while (s_cacheSize > s_cacheMax) {
+	WavePrompt* p = static_cast<WavePrompt*>(s_cache.get());
+	if (!p || (p == keep))
+	    break;
+	DDebug(&__plugin,DebugAll,"Evicting cached prompt '%s'",p->toString().c_str());
+	s_cacheSize -= p->data().length();
+	s_cacheEvicted++;
+	s_cache.remove(p);
+    }
+}
+
+// Retrieve a stream over the cached content of a file, load it on a miss
+static Stream* cachedPrompt(const String& file)
+{
+    if (!s_cacheMax)
+	return 0;
+    unsigned int mtime = 0;
+    if (!File::getFileTime(file,mtime))
+	return 0;
+    Lock lck(s_cacheMutex);
+    const NamedString* skip = s_uncached.getParam(file);
+    if (skip && (skip->toInt64(-1) == mtime))
+	return 0;
+    ObjList* o = s_cache.find(file);
+    if (o) {
+	WavePrompt* p = static_cast<WavePrompt*>(o->get());
+	if (p->mtime() == mtime) {
+	    s_cacheHits++;
+	    // move it to the most recently used end
+	    o->remove(false);
+	    s_cache.append(p);
+	    return new PromptStream(p);
+	}
+	Debug(&__plugin,DebugInfo,"Cached prompt '%s' changed on disk",file.c_str());
+	s_cacheSize -= p->data().length();
+	o->remove();
+    }
+    lck.drop();
+    File f;
+    if (!f.openPath(file,false,true,false,false,true))
+	return 0;
+    int64_t len = f.length();
+    if (len <= 0)
+	return 0;
+    lck.acquire(s_cacheMutex);
+    // don't evict other prompts for a file that can't fit, don't retry it until changed
+    if ((len > s_cacheFileMax) || (len > s_cacheMax)) {
+	DDebug(&__plugin,DebugAll,"Not caching prompt '%s' (%u bytes)",file.c_str(),(unsigned int)len);
+	if (s_uncached.count() >= 1024)
+	    s_uncached.clearParams();
+	s_uncached.setParam(file,String(mtime));
+	return 0;
+    }
+    s_cacheMisses++;
+    lck.drop();
+    WavePrompt* p = new WavePrompt(file,mtime,(unsigned int)len);
+    if (!p->load(f)) {
+	TelEngine::destruct(p);
+	return 0;
+    }
+    DDebug(&__plugin,DebugAll,"Caching prompt '%s' (%u bytes)",file.c_str(),(unsigned int)len);
+    lck.acquire(s_cacheMutex);
+    // another source may have loaded the same file meanwhile
+    o = s_cache.find(file);
+    if (o) {
+	s_cacheSize -= static_cast<WavePrompt*>(o->get())->data().length();
+	o->remove();
+    }
+    s_cache.append(p);
+    s_cacheSize += p->data().length();
+    trimCache(p);
+    return new PromptStream(p);
+}
+
+
 WaveSource* WaveSource::create(const String& file, CallEndpoint* chan, bool autoclose, bool autorepeat, const NamedString* param)
 {
     WaveSource* tmp = new WaveSource(file,chan,autoclose);
@@ -220,15 +399,18 @@ void WaveSource::init(const String& file, bool autorepeat)
 	    start("Wave Source");
 	    return;
 	}
-	m_stream = new File;
-	if (!static_cast<File*>(m_stream)->openPath(file,false,true,false,false,true)) {
-	    Debug(DebugWarn,"Opening '%s': error %d: %s",
-		file.c_str(), m_stream->error(), ::strerror(m_stream->error()));
-	    delete m_stream;
-	    m_stream = 0;
-	    m_format.clear();
-	    notify(this,"error");
-	    return;
+	m_stream = cachedPrompt(file);
+	if (!m_stream) {
+	    m_stream = new File;
+	    if (!static_cast<File*>(m_stream)->openPath(file,false,true,false,false,true)) {
+		Debug(DebugWarn,"Opening '%s': error %d: %s",
+		    file.c_str(), m_stream->error(), ::strerror(m_stream->error()));
+		delete m_stream;
+		m_stream = 0;
+		m_format.clear();
+		notify(this,"error");
+		return;
+	    }
 	}
     }
     if (file.endsWith(".gsm"))
@@ -1233,6 +1415,12 @@ void WaveFileDriver::statusParams(String& str)
 {
     str.append("play=",",") << s_reading;
     str << ",record=" << s_writing;
+    if (s_cacheMax) {
+	Lock lck(s_cacheMutex);
+	str << ",prompts=" << s_cache.count() << ",cachesize=" << s_cacheSize;
+	str << ",cachehits=" << s_cacheHits << ",cachemisses=" << s_cacheMisses;
+	str << ",cacheevicted=" << s_cacheEvicted;
+    }
     Driver::statusParams(str);
 }
 
@@ -1248,6 +1436,13 @@ void WaveFileDriver::initialize()
     setup();
     s_dataPadding = Engine::config().getBoolValue("hacks","datapadding",true);
     s_pubReadable = Engine::config().getBoolValue("hacks","wavepubread",false);
+    Configuration cfg(Engine::configFile("wavefile"));
+    Lock lck(s_cacheMutex);
+    s_cacheMax = 1024 * cfg.getIntValue("general","cache_size",0,0,1048576);
+    s_cacheFileMax = 1024 * cfg.getIntValue("general","cache_filesize",1024,1,1048576);
+    s_uncached.clearParams();
+    trimCache();
+    lck.drop();
     if (!m_handler) {
 	m_handler = new AttachHandler;
 	Engine::install(m_handler);
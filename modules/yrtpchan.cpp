@@ -1919,6 +1919,8 @@ void YRTPPlugin::initialize()
     s_monitor = cfg.getBoolValue("general","monitoring",false);
     s_sleep = cfg.getIntValue("general","defsleep",5);
     RTPGroup::setMinSleep(cfg.getIntValue("general","minsleep"));
+    if (!RTPGroup::setEventDriven(cfg.getBoolValue("general","eventloop")))
+	Debug(this,DebugWarn,"Event driven RTP groups are not supported on this platform");
     s_priority = Thread::priority(cfg.getValue("general","thread"));
     s_affinity = cfg.getValue("general","affinity");
     s_rtpWarnSeq = cfg.getBoolValue("general","rtp_warn_seq",true);
@@ -25,6 +25,14 @@
 
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#define YSIP_EPOLL
+#endif
+
 
 using namespace TelEngine;
 namespace { // anonymous
@@ -35,6 +43,8 @@ class YateSIPTransport;                  // SIP transport: keeps a socket, read/
 class YateSIPUDPTransport;               // UDP transport
 class YateSIPTCPTransport;               // TCP/TLS transport
 class YateSIPTransportWorker;            // A transport worker
+class YateSIPTCPPoller;                  // Event loop serving incoming TCP/TLS transports
+class YateSIPTCPPollEntry;               // A transport watched by an event loop
 class YateSIPTCPListener;                // A TCP listener
 class YateUDPParty;                      // A SIP UDP party
 class YateTCPParty;                      // A SIP TCP/TLS party
@@ -59,6 +69,11 @@ class SIPDriver;
 #define TCP_IDLE_DEF 120
 #define TCP_IDLE_MAX 600
 
+// Maximum number of event loop threads serving incoming TCP/TLS transports
+#define TCP_POOL_MAX 64
+// Maximum number of socket events retrieved in one loop
+#define TCP_POLL_EVENTS 64
+
 // Maximum allowed value for bind retry interval in milliseconds
 // 1 minute
 #define BIND_RETRY_MAX 60000
@@ -417,6 +432,7 @@ class YateSIPTransport : public Mutex, public RefObject, public ProtocolHolder
     friend class SIPDriver;
     friend class YateSIPEndPoint;
     friend class YateSIPTransportWorker;
+    friend class YateSIPTCPPoller;
 public:
     enum Status {
 	Idle = 0,
@@ -513,6 +529,8 @@ protected:
     String m_rtpLocalAddr;               // RTP local address
     String m_rtpNatAddr;                 // NAT IP to override RTP local address
     YateSIPTransportWorker* m_worker;    // Transport worker
+    YateSIPTCPPoller* m_poller;          // Event loop serving the transport instead of a worker
+    YateSIPTCPPollEntry* m_pollEntry;    // Event loop entry, protected by the event loop
     bool m_initialized;                  // Flag reset when initializing by the module and set in init()
     String m_protoAddr;                  // Proto + addr: used for debug (send/recv msg)
     String m_role;
@@ -553,6 +571,7 @@ class YateSIPTCPTransport : public YateSIPTransport
 {
     YCLASS(YateSIPTCPTransport,YateSIPTransport);
     friend class YateTCPParty;
+    friend class YateSIPTCPPoller;
 public:
     // Build an outgoing transport
     YateSIPTCPTransport(bool tls, const String& laddr, const String& raddr, int rport);
@@ -622,6 +641,8 @@ protected:
     u_int64_t m_idleTimeout;             // Idle timeout: check state or send keep alive
     bool m_flowTimer;                    // Flow timer flag (RFC5626)
     bool m_keepAlivePending;             // Pending keep alive response
+    bool m_sendBlocked;                  // Last send stopped before emptying the queue
+    bool m_sendMore;                     // Last send stopped with writable socket and queued messages
     SIPMessage* m_msg;                   // Partially received SIP message (expecting body)
     DataBlock m_sipBuffer;               // Accumulated read data
     unsigned int m_sipBufOffs;           // Offset in sip buffer for partial sip message
@@ -647,6 +668,77 @@ private:
     YateSIPTransport* m_transport;
 };
 
+#ifdef YSIP_EPOLL
+// A transport watched by an event loop
+// The entry is kept alive after detach until the next loop as pending
+//  socket events may still point to it
+class YateSIPTCPPollEntry : public GenObject
+{
+public:
+    inline YateSIPTCPPollEntry(YateSIPTCPTransport* trans, int handle)
+	: m_transport(trans), m_handle(handle), m_ready(false), m_out(false)
+	{}
+    virtual const String& toString() const
+	{ return m_id; }
+    YateSIPTCPTransport* m_transport;    // Watched transport, 0 if detached
+    String m_id;                         // Transport id
+    int m_handle;                        // Socket handle
+    bool m_ready;                        // Entry is in the ready list
+    bool m_out;                          // Watching for socket writable
+};
+
+// Event loop serving many incoming TCP/TLS transports from a single thread
+// Lock order: transport before loop, the loop never locks a transport while locked
+class YateSIPTCPPoller : public Mutex, public GenObject
+{
+public:
+    YateSIPTCPPoller(unsigned int index);
+    ~YateSIPTCPPoller();
+    inline unsigned int count() const
+	{ return m_count; }
+    inline bool running() const
+	{ return m_running; }
+    // Start watching a transport. Take ownership of the incoming transport reference
+    bool attach(YateSIPTCPTransport* trans);
+    // Stop watching a transport. Return true if it was attached
+    // The caller must release the incoming transport reference
+    bool detach(YateSIPTCPTransport* trans);
+    // Schedule a transport for processing
+    void signal(YateSIPTCPTransport* trans, bool wake = true);
+    // Loop thread entry point
+    void run();
+    // Retrieve the least loaded event loop, create one if the pool is not full
+    static YateSIPTCPPoller* get(unsigned int pool);
+private:
+    // Queue an entry for processing. Poller must be locked
+    void setReady(YateSIPTCPPollEntry* entry);
+    // Process a transport, apply the result
+    void process(YateSIPTCPTransport* trans);
+    void wake();
+    String m_name;
+    int m_epoll;                         // Event poll handle
+    int m_wake;                          // Event handle used to interrupt a wait
+    HashList m_entries;                  // Watched transports
+    ObjList m_ready;                     // Entries waiting to be processed (not owned)
+    ObjList m_dead;                      // Detached entries waiting to be deleted
+    unsigned int m_count;                // Number of watched transports
+    bool m_running;                      // Loop thread is running
+};
+
+// Event loop thread
+class YateSIPTCPPollThread : public Thread
+{
+public:
+    inline YateSIPTCPPollThread(YateSIPTCPPoller* poller)
+	: Thread("YSIP Poller"), m_poller(poller)
+	{}
+    virtual void run()
+	{ m_poller->run(); }
+private:
+    YateSIPTCPPoller* m_poller;
+};
+#endif
+
 class YateSIPTCPListener : public Thread, public GenObject, public ProtocolHolder, public YateSIPListener
 {
     friend class SIPDriver;
@@ -749,11 +841,6 @@ public:
     bool hasActiveTransaction(YateSIPTransport* trans);
     // Check if the engine has pending transactions
     bool hasInitialTransaction();
-    // Clear transactions
-    inline void clearTransactions() {
-	    Lock lck(this);
-	    m_transList.clear();
-	}
     inline bool update() const
 	{ return m_update; }
     inline bool prack() const
@@ -1062,6 +1149,7 @@ public:
     virtual bool msgUpdate(Message& msg);
     virtual bool msgControl(Message& msg);
     virtual void checkTimers(Message& msg, const Time& tmr);
+    virtual u_int64_t timerDue() const;
     virtual bool callPrerouted(Message& msg, bool handled);
     virtual bool callRouted(Message& msg);
     virtual void callAccept(Message& msg);
@@ -1397,6 +1485,7 @@ static bool s_reinviteWait = false;      // Wait for initial transaction termina
 static bool s_provNonReliable = true;    // Accept non reliable provisional messages after a reliable one was received
 static bool s_sipt_isup = false;         // Control the application/isup body processing
 static bool s_printMsg = true;           // Print sent/received SIP messages to output
+static bool s_lazyHeaders = false;       // Build received header lines only when used
 static ObjList* s_authCopyHeader = 0;    // Copy headers in user.auth
 
 static bool s_ipv6 = false;              // IPv6 support enabled
@@ -1408,6 +1497,7 @@ static unsigned int s_tcpIdle = TCP_IDLE_DEF; // TCP transport idle interval
 static unsigned int s_tcpKeepalive = TCP_IDLE_DEF; // TCP transport keepalive interval
 static unsigned int s_tcpKeepaliveFirst = 0; // TCP transport first keepalive interval
 static unsigned int s_tcpMaxpkt = 1500;  // Maximum packet to accept on TCP connections
+static unsigned int s_tcpPool = 0;       // Event loop threads serving incoming TCP/TLS, 0 to use a thread per transport
 static String s_tcpOutRtpip;             // RTP ip for outgoing tcp/tls transports (protected by plugin mutex)
 static bool s_lineKeepTcpOffline = true; // Lines: keep TCP transports when offline
 static String s_sslCertFile;             // File containing the SSL client certificate to present if requested by the server
@@ -1913,7 +2003,7 @@ static bool matchAny(const String& name, const char** strs)
 static void copySipHeaders(NamedList& msg, const SIPMessage& sip, bool filter = true, bool auth = false,
     bool all = false)
 {
-    const ObjList* l = sip.header.skipNull();
+    const ObjList* l = sip.headerList().skipNull();
     for (; l; l = l->skipNext()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
 	String name(t->name());
@@ -2153,10 +2243,8 @@ static bool sdpAccept(const SIPMessage* sip, bool def)
     static const Regexp r("\\(^\\|,\\) *application/sdp *\\($\\|[,;]\\)",false,true);
 
     if (sip) {
-	for (ObjList* o = sip->header.skipNull(); o; o = o->skipNext()) {
-	    const MimeHeaderLine* hl = static_cast<const MimeHeaderLine*>(o->get());
-	    if (hl->name() |= "Accept")
-		continue;
+	const MimeHeaderLine* hl = 0;
+	while ((hl = sip->getNextHeader("Accept",hl))) {
 	    if (r.matches(*hl))
 		return true;
 	    // Header found but not matching: reset def val
@@ -3288,7 +3376,7 @@ YateSIPTransport::YateSIPTransport(int proto, const String& id, Socket* sock, in
     ProtocolHolder(proto),
     m_id(id), m_status(stat), m_statusChgTime(Time::secNow()),
     m_sock(sock), m_maxpkt(1500),
-    m_worker(0), m_initialized(false),
+    m_worker(0), m_poller(0), m_pollEntry(0), m_initialized(false),
     m_ignoreVia(s_ignoreVia), m_capture(0)
 {
 }
@@ -3421,6 +3509,11 @@ void YateSIPTransport::terminate(const char* reason)
 {
     XDebug(&plugin,DebugInfo,"YateSIPTransport::terminate(%s) [%p]",reason,this);
     changeStatus(Terminating);
+#ifdef YSIP_EPOLL
+    // Release the incoming reference owned by the event loop
+    if (m_poller && m_poller->detach(tcpTransport()))
+	deref();
+#endif
     if (m_worker) {
 	bool wait = false;
 	lock();
@@ -3479,8 +3572,20 @@ void YateSIPTransport::destroyed()
 bool YateSIPTransport::startWorker(Thread::Priority prio)
 {
     Lock lck(this);
-    if (m_worker)
+    if (m_worker || m_poller)
 	return true;
+#ifdef YSIP_EPOLL
+    YateSIPTCPTransport* tcp = tcpTransport();
+    if (tcp && !tcp->outgoing() && s_tcpPool) {
+	lck.drop();
+	YateSIPTCPPoller* poller = YateSIPTCPPoller::get(s_tcpPool);
+	if (poller && poller->attach(tcp))
+	    return true;
+	lck.acquire(this);
+	if (m_worker)
+	    return true;
+    }
+#endif
     m_worker = new YateSIPTransportWorker(this,prio);
     if (m_worker->startup())
 	return true;
@@ -3796,7 +3901,7 @@ int YateSIPUDPTransport::process()
 	Alarm(&plugin,"performance",DebugNote,"Flood drop cleared, resumed normal message processing");
     }
 
-    SIPMessage* msg = SIPMessage::fromParsing(0,b,res);
+    SIPMessage* msg = SIPMessage::fromParsing(0,b,res,0,s_lazyHeaders);
     if (msg) {
 	msg->msgPrint = print;
 	receiveMsg(msg);
@@ -3812,7 +3917,7 @@ YateSIPTCPTransport::YateSIPTCPTransport(bool tls, const String& laddr, const St
     m_outgoing(true), m_party(0), m_sent(-1),
     m_firstKeepalive(0), m_firstKeepaliveSent(false),
     m_idleInterval(TCP_IDLE_DEF), m_idleTimeout(0),
-    m_flowTimer(false), m_keepAlivePending(false),
+    m_flowTimer(false), m_keepAlivePending(false), m_sendBlocked(false), m_sendMore(false),
     m_msg(0), m_sipBufOffs(0), m_contentLen(0),
     m_remoteAddr(raddr), m_remotePort(rport), m_localAddr(laddr),
     m_connectRetry(s_tcpConnectRetry), m_nextConnect(0)
@@ -3833,7 +3938,7 @@ YateSIPTCPTransport::YateSIPTCPTransport(Socket* sock, bool tls)
     m_outgoing(false), m_party(0), m_sent(-1),
     m_firstKeepalive(0), m_firstKeepaliveSent(false),
     m_idleInterval(TCP_IDLE_DEF), m_idleTimeout(0),
-    m_flowTimer(false), m_keepAlivePending(false),
+    m_flowTimer(false), m_keepAlivePending(false), m_sendBlocked(false), m_sendMore(false),
     m_msg(0), m_sipBufOffs(0), m_contentLen(0),
     m_remotePort(0), m_connectRetry(0), m_nextConnect(0)
 {
@@ -3917,6 +4022,10 @@ bool YateSIPTCPTransport::send(SIPEvent* event)
     getMsgLine(tmp,msg);
     Debug(&plugin,DebugAll,"Transport(%s) enqueued (%p,%s) [%p]",
 	m_id.c_str(),msg,tmp.c_str(),this);
+#endif
+#ifdef YSIP_EPOLL
+    if (m_poller)
+	m_poller->signal(this);
 #endif
     return true;
 }
@@ -4014,7 +4123,7 @@ int YateSIPTCPTransport::process()
 	}
 	setIdleTimeout(time);
     }
-    return read ? 0 : Thread::idleUsec();
+    return (read || m_sendMore) ? 0 : Thread::idleUsec();
 }
 
 void YateSIPTCPTransport::destroyed()
@@ -4206,6 +4315,8 @@ int YateSIPTCPTransport::connect(u_int64_t connToutUs)
 bool YateSIPTCPTransport::sendPending(const Time& time, bool& sent)
 {
     sent = false;
+    m_sendBlocked = false;
+    m_sendMore = false;
     if (!m_sock)
 	return false;
     int attempts = 3;
@@ -4238,6 +4349,7 @@ bool YateSIPTCPTransport::sendPending(const Time& time, bool& sent)
 	    len -= m_sent;
 	    int wr = m_sock->writeData(b + m_sent,len);
 	    printWriteError(wr,len);
+	    m_sendBlocked = (wr < len);
 	    if (wr > 0) {
 		m_sent += wr;
 		// Outgoing: reset keep alive timer
@@ -4257,6 +4369,9 @@ bool YateSIPTCPTransport::sendPending(const Time& time, bool& sent)
 	    capture(buf.data(),buf.length(),false);
 	    o->remove();
 	    m_sent = -1;
+	    // Don't starve reading, send the rest of the queue in next process
+	    if (!attempts)
+		m_sendMore = (0 != m_queue.skipNull());
 	    continue;
 	}
 	break;
@@ -4340,7 +4455,7 @@ bool YateSIPTCPTransport::readData(const Time& time, bool& read)
 		break;
 	    }
 	    // Parse the message headers
-	    m_msg = SIPMessage::fromParsing(0,data,m_sipBufOffs,&m_contentLen);
+	    m_msg = SIPMessage::fromParsing(0,data,m_sipBufOffs,&m_contentLen,s_lazyHeaders);
 	    if (!m_msg) {
 		m_reason = "Received invalid message";
 		String tmp(data,m_sipBufOffs);
@@ -4543,6 +4658,265 @@ void YateSIPTransportWorker::cleanupTransport(bool final, bool terminate)
     trans = 0;
 }
 
+#ifdef YSIP_EPOLL
+static ObjList s_tcpPollers;              // Event loops serving incoming TCP/TLS transports
+static Mutex s_tcpPollersMutex(false,"SIPTCPPollers");
+
+YateSIPTCPPoller::YateSIPTCPPoller(unsigned int index)
+    : Mutex(false,"SIPTCPPoller"),
+    m_name("tcppoll/"), m_epoll(-1), m_wake(-1), m_entries(127), m_count(0), m_running(false)
+{
+    m_name << index;
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    m_wake = ::eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll >= 0 && m_wake >= 0) {
+	struct epoll_event ev;
+	::memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = 0;
+	if (!::epoll_ctl(m_epoll,EPOLL_CTL_ADD,m_wake,&ev)) {
+	    m_running = true;
+	    YateSIPTCPPollThread* th = new YateSIPTCPPollThread(this);
+	    if (!th->startup()) {
+		delete th;
+		m_running = false;
+	    }
+	}
+    }
+    if (m_running)
+	Debug(&plugin,DebugAll,"TCP event loop %s started [%p]",m_name.c_str(),this);
+    else
+	Debug(&plugin,DebugWarn,"TCP event loop %s failed to start: %d '%s' [%p]",
+	    m_name.c_str(),errno,::strerror(errno),this);
+}
+
+YateSIPTCPPoller::~YateSIPTCPPoller()
+{
+    m_ready.clear();
+    m_dead.clear();
+    m_entries.clear();
+    if (m_wake >= 0)
+	::close(m_wake);
+    if (m_epoll >= 0)
+	::close(m_epoll);
+}
+
+// Start watching a transport. Take ownership of the incoming transport reference
+bool YateSIPTCPPoller::attach(YateSIPTCPTransport* trans)
+{
+    if (!trans)
+	return false;
+    Lock lck(this);
+    if (!(m_running && trans->m_sock && trans->m_sock->valid()))
+	return false;
+    YateSIPTCPPollEntry* entry = new YateSIPTCPPollEntry(trans,trans->m_sock->handle());
+    entry->m_id = trans->toString();
+    struct epoll_event ev;
+    ::memset(&ev,0,sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = entry;
+    if (::epoll_ctl(m_epoll,EPOLL_CTL_ADD,entry->m_handle,&ev)) {
+	Debug(&plugin,DebugWarn,"TCP event loop %s failed to watch transport (%s): %d '%s' [%p]",
+	    m_name.c_str(),entry->m_id.c_str(),errno,::strerror(errno),this);
+	delete entry;
+	return false;
+    }
+    m_entries.append(entry);
+    m_count++;
+    trans->m_poller = this;
+    trans->m_pollEntry = entry;
+    DDebug(&plugin,DebugAll,"TCP event loop %s watching transport (%s) count=%u [%p]",
+	m_name.c_str(),entry->m_id.c_str(),m_count,this);
+    // Process it as soon as possible: TLS sockets may already hold data
+    setReady(entry);
+    lck.drop();
+    wake();
+    return true;
+}
+
+// Stop watching a transport
+bool YateSIPTCPPoller::detach(YateSIPTCPTransport* trans)
+{
+    if (!trans)
+	return false;
+    Lock tlck(trans);
+    Lock lck(this);
+    YateSIPTCPPollEntry* entry = trans->m_pollEntry;
+    if (!entry)
+	return false;
+    trans->m_pollEntry = 0;
+    entry->m_transport = 0;
+    // A closed socket is already out of the set and its handle may be reused
+    if (trans->m_sock && trans->m_sock->handle() == entry->m_handle)
+	::epoll_ctl(m_epoll,EPOLL_CTL_DEL,entry->m_handle,0);
+    m_entries.remove(entry,false,true);
+    if (entry->m_ready)
+	m_ready.remove(entry,false);
+    m_dead.append(entry);
+    m_count--;
+    DDebug(&plugin,DebugAll,"TCP event loop %s released transport (%s) count=%u [%p]",
+	m_name.c_str(),entry->m_id.c_str(),m_count,this);
+    return true;
+}
+
+// Schedule a transport for processing
+void YateSIPTCPPoller::signal(YateSIPTCPTransport* trans, bool wake)
+{
+    Lock lck(this);
+    YateSIPTCPPollEntry* entry = trans->m_pollEntry;
+    if (!entry || entry->m_ready)
+	return;
+    setReady(entry);
+    lck.drop();
+    if (wake)
+	this->wake();
+}
+
+void YateSIPTCPPoller::run()
+{
+    DDebug(&plugin,DebugAll,"TCP event loop %s running [%p]",m_name.c_str(),this);
+    struct epoll_event events[TCP_POLL_EVENTS];
+    u_int64_t sweep = Time::now() + 1000000;
+    while (!Thread::check(false)) {
+	// Events fetched in the previous loop may still point to detached entries
+	lock();
+	m_dead.clear();
+	int tout = m_ready.skipNull() ? 0 : (s_engineHalt ? 2 : 100);
+	unlock();
+	int n = ::epoll_wait(m_epoll,events,TCP_POLL_EVENTS,tout);
+	if (n < 0) {
+	    if (errno != EINTR) {
+		Debug(&plugin,DebugWarn,"TCP event loop %s wait failed: %d '%s' [%p]",
+		    m_name.c_str(),errno,::strerror(errno),this);
+		Thread::idle();
+	    }
+	    n = 0;
+	}
+	Time now;
+	ObjList work;
+	lock();
+	for (int i = 0; i < n; i++) {
+	    YateSIPTCPPollEntry* entry = static_cast<YateSIPTCPPollEntry*>(events[i].data.ptr);
+	    if (!entry) {
+		u_int64_t val = 0;
+		while (::read(m_wake,&val,sizeof(val)) > 0)
+		    ;
+	    }
+	    else if (entry->m_transport && !entry->m_ready)
+		setReady(entry);
+	}
+	// Check idle transports, process all of them when halting
+	if (s_engineHalt || now >= sweep) {
+	    for (unsigned int i = 0; i < m_entries.length(); i++) {
+		ObjList* l = m_entries.getList(i);
+		for (ObjList* o = l ? l->skipNull() : 0; o; o = o->skipNext()) {
+		    YateSIPTCPPollEntry* entry = static_cast<YateSIPTCPPollEntry*>(o->get());
+		    if (!entry->m_ready &&
+			(s_engineHalt || entry->m_transport->m_idleTimeout <= now))
+			setReady(entry);
+		}
+	    }
+	    sweep = now + 1000000;
+	}
+	// Keep the transports alive while calling their methods
+	while (YateSIPTCPPollEntry* entry = static_cast<YateSIPTCPPollEntry*>(m_ready.remove(false))) {
+	    entry->m_ready = false;
+	    if (entry->m_transport && entry->m_transport->ref())
+		work.append(entry->m_transport)->setDelete(false);
+	}
+	unlock();
+	while (YateSIPTCPTransport* trans = static_cast<YateSIPTCPTransport*>(work.remove(false))) {
+	    process(trans);
+	    trans->deref();
+	}
+    }
+    // Stopped: release all transports
+    ObjList work;
+    lock();
+    m_running = false;
+    for (unsigned int i = 0; i < m_entries.length(); i++) {
+	ObjList* l = m_entries.getList(i);
+	for (ObjList* o = l ? l->skipNull() : 0; o; o = o->skipNext()) {
+	    YateSIPTCPPollEntry* entry = static_cast<YateSIPTCPPollEntry*>(o->get());
+	    if (entry->m_transport->ref())
+		work.append(entry->m_transport)->setDelete(false);
+	}
+    }
+    unlock();
+    while (YateSIPTCPTransport* trans = static_cast<YateSIPTCPTransport*>(work.remove(false))) {
+	trans->terminate();
+	trans->deref();
+    }
+    DDebug(&plugin,DebugAll,"TCP event loop %s terminated [%p]",m_name.c_str(),this);
+}
+
+// Retrieve the least loaded event loop, create one if the pool is not full
+YateSIPTCPPoller* YateSIPTCPPoller::get(unsigned int pool)
+{
+    Lock lck(s_tcpPollersMutex);
+    YateSIPTCPPoller* best = 0;
+    unsigned int n = 0;
+    for (ObjList* o = s_tcpPollers.skipNull(); o && n < pool; o = o->skipNext()) {
+	YateSIPTCPPoller* p = static_cast<YateSIPTCPPoller*>(o->get());
+	if (!p->running())
+	    continue;
+	n++;
+	if (!best || p->count() < best->count())
+	    best = p;
+    }
+    if (n < pool && (!best || best->count()) && !Engine::exiting()) {
+	YateSIPTCPPoller* p = new YateSIPTCPPoller(s_tcpPollers.count() + 1);
+	// Keep failed loops too: running transports may still refer to them
+	s_tcpPollers.append(p);
+	if (p->running())
+	    best = p;
+    }
+    return best;
+}
+
+// Queue an entry for processing. Poller must be locked
+void YateSIPTCPPoller::setReady(YateSIPTCPPollEntry* entry)
+{
+    entry->m_ready = true;
+    m_ready.append(entry)->setDelete(false);
+}
+
+// Process a transport, apply the result
+void YateSIPTCPPoller::process(YateSIPTCPTransport* trans)
+{
+    int res = trans->process();
+    if (res < 0) {
+	trans->terminate();
+	return;
+    }
+    // Watch for writable socket only while sending is blocked
+    bool out = trans->m_sendBlocked;
+    Lock lck(this);
+    YateSIPTCPPollEntry* entry = trans->m_pollEntry;
+    if (!entry)
+	return;
+    // More data may be waiting to be processed (buffered TLS) or sent
+    if (!res && !entry->m_ready)
+	setReady(entry);
+    if (entry->m_out == out)
+	return;
+    struct epoll_event ev;
+    ::memset(&ev,0,sizeof(ev));
+    ev.events = out ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.ptr = entry;
+    if (!::epoll_ctl(m_epoll,EPOLL_CTL_MOD,entry->m_handle,&ev))
+	entry->m_out = out;
+}
+
+// Interrupt a wait
+void YateSIPTCPPoller::wake()
+{
+    u_int64_t val = 1;
+    if (::write(m_wake,&val,sizeof(val)) != sizeof(val))
+	DDebug(&plugin,DebugMild,"TCP event loop %s failed to wake up [%p]",m_name.c_str(),this);
+}
+#endif
+
 
 YateSIPTCPListener::YateSIPTCPListener(int proto, const String& name, const NamedList& params)
     : Thread("YSIP Listener",Thread::priority(params.getValue("thread"))),
@@ -5270,7 +5644,7 @@ bool YateSIPEngine::checkUser(String& username, const String& realm, const Strin
 	    m.addParam("device",*hl);
 	m.addParam("trace_id",message->traceId());
 	s_globalMutex.lock();
-	for (const ObjList* l = message->header.skipNull(); l; l = l->skipNext()) {
+	for (const ObjList* l = message->headerList().skipNull(); l; l = l->skipNext()) {
 	    hl = static_cast<const MimeHeaderLine*>(l->get());
 	    String name(hl->name());
 	    name.toLower();
@@ -8297,6 +8671,7 @@ void YateSIPConnection::doPrack(SIPTransaction* t)
     SIPMessage* msg = static_cast<SIPMessage*>(m_prackQueue.remove(false));
     if (msg) {
 	m_prackTimer = Time::now() + PRACK_TIMER;
+	updateTimer();
 	m_prackCount = PRACK_TRIES;
 	msg->addHeader("Require","100rel");
 	msg->addHeader("RSeq",String(++m_lastRseq));
@@ -8872,6 +9247,7 @@ void YateSIPConnection::sendProvisional(SIPMessage* msg)
 		return;
 	    }
 	    m_prackTimer = Time::now() + PRACK_TIMER;
+	    updateTimer();
 	    m_prackCount = PRACK_TRIES;
 	    msg->addHeader("Require","100rel");
 	    msg->addHeader("RSeq",String(++m_lastRseq));
@@ -8910,6 +9286,15 @@ void YateSIPConnection::checkTimers(Message& msg, const Time& tmr)
     }
 }
 
+u_int64_t YateSIPConnection::timerDue() const
+{
+    u_int64_t due = Channel::timerDue();
+    // all bits set mark a failed PRACK, not a running timer
+    if (m_prackTimer && (m_prackTimer != (uint64_t)-1) && (!due || (m_prackTimer < due)))
+	due = m_prackTimer;
+    return due;
+}
+
 bool YateSIPConnection::callPrerouted(Message& msg, bool handled)
 {
     bool ok = Channel::callPrerouted(msg,handled);
@@ -10256,6 +10641,7 @@ void SIPDriver::initialize()
 	s_ipv6 = false;
     }
     s_printMsg = s_cfg.getBoolValue("general","printmsg",true);
+    s_lazyHeaders = s_cfg.getBoolValue("general","lazy_headers",false);
     s_tcpMaxpkt = getMaxpkt(s_cfg.getIntValue("general","tcp_maxpkt",4096),4096);
     s_lineKeepTcpOffline = s_cfg.getBoolValue("general","line_keeptcpoffline",!Engine::clientMode());
     s_defEncoding = s_cfg.getIntValue("general","body_encoding",SipHandler::s_bodyEnc,SipHandler::BodyBase64);
@@ -10333,6 +10719,12 @@ void SIPDriver::initialize()
     s_tcpIdle = tcpIdleInterval(s_cfg.getIntValue("general","tcp_idle",TCP_IDLE_DEF));
     s_tcpKeepalive = s_cfg.getIntValue("general","tcp_keepalive",s_tcpIdle);
     s_tcpKeepaliveFirst = s_cfg.getIntValue("general","tcp_keepalive_first",0,0);
+#ifdef YSIP_EPOLL
+    s_tcpPool = s_cfg.getIntValue("general","tcp_pool",0,0,TCP_POOL_MAX);
+#else
+    if (s_cfg.getIntValue("general","tcp_pool",0) > 0)
+	Debug(this,DebugConf,"TCP transport event loops not supported on this platform");
+#endif
     // SIP capture parameters
     s_captureFilter = s_cfg.getBoolValue("general","capture_filter",s_captureFilter);
     s_captureAgent = s_cfg.getValue("general","capture_agent","sip");
@@ -10504,8 +10896,14 @@ void SIPDriver::msgStatus(Message& msg)
 void SIPDriver::statusParams(String& str)
 {
     Driver::statusParams(str);
-    if (m_endpoint && m_endpoint->engine())
+    if (m_endpoint && m_endpoint->engine()) {
 	str.append("transactions=",",") << m_endpoint->engine()->transactionCount();
+	u_int64_t woken = 0;
+	unsigned int last = 0;
+	unsigned int max = 0;
+	m_endpoint->engine()->getTimerStats(woken,last,max);
+	str << ",timerwakeups=" << woken << ",lastwakeups=" << last << ",maxwakeups=" << max;
+    }
 }
 
 // Build and dispatch a socket.ssl message
@@ -5778,6 +5778,44 @@ public:
     bool convert(const DataBlock& src, const String& sFormat,
 	const String& dFormat, unsigned maxlen = 0);
 
+    /**
+     * Convert audio samples between slin, alaw and mulaw into a caller
+     *  provided buffer without allocating any memory
+     * @param dest Destination buffer, must have room for all converted samples
+     * @param src Source samples
+     * @param samples Number of samples to convert
+     * @param sFormat Name of the source format
+     * @param dFormat Name of the destination format
+     * @return True if converted successfully, false if conversion is not supported
+     */
+    static bool convert(void* dest, const void* src, unsigned int samples,
+	const String& sFormat, const String& dFormat);
+
+    /**
+     * Retrieve the size of one sample of a format handled by convert()
+     * @param format Name of the format
+     * @return Sample size in octets, zero if the format is not handled
+     */
+    static unsigned int sampleSize(const String& format);
+
+    /**
+     * Enable or disable the per thread pool of data buffers.
+     * When enabled buffers of common media frame sizes are kept in a per
+     *  thread cache when released and reused by the next allocation
+     * @param enable True to enable the pool, false to stop caching buffers
+     * @param maxCached Maximum number of buffers of each size cached by a thread
+     */
+    static void setPool(bool enable, unsigned int maxCached = 64);
+
+    /**
+     * Retrieve the statistics of the data buffers pool
+     * @param hits Filled with the number of allocations served from the pool
+     * @param misses Filled with the number of pool allocations that called malloc()
+     * @param cached Filled with the number of buffers currently in the pool
+     * @return True if the pool is enabled
+     */
+    static bool poolStats(u_int64_t& hits, u_int64_t& misses, unsigned int& cached);
+
     /**
      * Change data data in current block from a hexadecimal string representation. Append or insert.
      * Each octet must be represented in the input string with 2 hexadecimal characters.
@@ -6455,9 +6493,13 @@ public:
 };
 
 class NamedIterator;
+class NamedListIndex;
 
 /**
- * This class holds a named list of named strings
+ * This class holds a named list of named strings.
+ * Lists with many parameters build a name index on demand to speed up
+ *  lookups. Parameters should not be renamed while in the list unless the
+ *  list was accessed through the non-const paramList() which drops the index.
  * @short A named string container class
  */
 class YATE_API NamedList : public String
@@ -6484,6 +6526,11 @@ public:
      */
     NamedList(const char* name, const NamedList& original, const String& prefix);
 
+    /**
+     * Destructor
+     */
+    virtual ~NamedList();
+
     /**
      * Assignment operator
      * @param value New name and parameters to assign
@@ -6516,7 +6563,7 @@ public:
      * Clear all parameters
      */
     inline void clearParams()
-	{ m_params.clear(); }
+	{ clearIndex(); m_params.clear(); }
 
     /**
      * Add a named string to the parameter list.
@@ -6957,11 +7004,11 @@ public:
     static const NamedList& empty();
 
     /**
-     * Get the parameters list
+     * Get the parameters list, retires the name index as the list may be modified
      * @return Pointer to the parameters list
      */
     inline ObjList* paramList()
-	{ return &m_params; }
+	{ retireIndex(); return &m_params; }
 
     /**
      * Get the parameters list
@@ -6972,7 +7019,16 @@ public:
 
 private:
     NamedList(); // no default constructor please
+    inline void clearIndex()
+	{ if (m_index) dropIndex(); }
+    void dropIndex();
+    void retireIndex();
+    NamedListIndex* liveIndex();
+    void buildIndex() const;
+    void indexParam(NamedString* param);
+    NamedString* setParamCreate(const String& name);
     ObjList m_params;
+    mutable NamedListIndex* m_index;
 };
 
 /**
@@ -371,6 +371,7 @@ private:
 class MessageDispatcher;
 class MessageRelay;
 class Engine;
+class DispatcherQueue;
 
 /**
  * This class holds the messages that are moved around in the engine.
@@ -841,6 +842,9 @@ class YATE_API MessagePostHook : public RefObject, public MessageNotifier
  * The dispatcher class is a hub that holds a list of handlers to be called
  *  for the messages that pass trough the hub. It can also handle a queue of
  *  messages that are typically dispatched by a separate thread.
+ * The waiting queue can be split in several independently locked queues,
+ *  each dispatching thread prefers its own queue but takes messages from
+ *  the others when its own is empty.
  * @short A message dispatching hub
  */
 class YATE_API MessageDispatcher : public GenObject
@@ -871,6 +875,9 @@ public:
      * The handlers are installed in ascending order of their priorities.
      * There is NO GUARANTEE on the order of handlers with equal priorities
      *  although for avoiding uncertainity such handlers are sorted by address.
+     * Handlers are also indexed by message name, broadcast (unnamed) handlers
+     *  are kept in a separate list that is merged with the named ones when
+     *  dispatching.
      * @param handler A pointer to the handler to install
      * @return True on success, false on failure
      */
@@ -904,15 +911,36 @@ public:
     bool enqueue(Message* msg);
 
     /**
-     * Dispatch all messages from the waiting queue
+     * Dispatch all messages from the waiting queues
+     * @param queue Index of the preferred queue, other queues are emptied after it
      */
-    void dequeue();
+    void dequeue(unsigned int queue = 0);
 
     /**
-     * Dispatch one message from the waiting queue
-     * @return True if success, false if the queue is empty
+     * Dispatch one message from the waiting queues
+     * @param queue Index of the preferred queue, other queues are checked if it's empty
+     * @return True if success, false if all the queues are empty
      */
-    bool dequeueOne();
+    bool dequeueOne(unsigned int queue = 0);
+
+    /**
+     * Set the number of waiting queues and the message parameters used to keep
+     *  related messages in the same queue.
+     * Messages already waiting are moved to the new queues.
+     * This method should be called before starting any dispatching thread
+     * @param count Number of waiting queues, minimum 1
+     * @param affinity Comma separated list of parameter names, the first one
+     *  present in a message selects the queue. Messages without any of them
+     *  are spread between queues
+     */
+    void setQueues(unsigned int count, const String& affinity = String::empty());
+
+    /**
+     * Get the number of waiting queues
+     * @return Count of message queues
+     */
+    inline unsigned int queueCount() const
+	{ return m_queueCount; }
 
     /**
      * Set a limit to generate warning when a message took too long to dispatch
@@ -941,11 +969,10 @@ public:
     void clear();
 
     /**
-     * Check if there is at least one message in the queue
-     * @return True if the queue holds at least one message
+     * Check if there is at least one message in the queues
+     * @return True if the queues hold at least one message
      */
-    inline bool hasMessages() const
-	{ return m_messages.get() || m_messages.next(); }
+    bool hasMessages() const;
 
     /**
      * Check if there is at least one handler installed
@@ -983,15 +1010,13 @@ public:
      * Get the total number of enqueued messages
      * @return Count of enqueued messages
      */
-    u_int64_t enqueueCount() const
-	{ return m_enqueueCount; }
+    u_int64_t enqueueCount() const;
 
     /**
      * Get the total number of dequeued messages
      * @return Count of dequeued messages
      */
-    u_int64_t dequeueCount() const
-	{ return m_dequeueCount; }
+    u_int64_t dequeueCount() const;
 
     /**
      * Get the total number of dispatched messages
@@ -1012,8 +1037,7 @@ public:
      * @param usec True to return microseconds instead of milliseconds
      * @return Average age of dequeued messages
      */
-    u_int64_t messageAge(bool usec = false) const
-	{ return usec ? m_msgAvgAge : ((m_msgAvgAge + 500) / 1000); }
+    u_int64_t messageAge(bool usec = false) const;
 
     /**
      * Retrieve the handlers list lock object
@@ -1059,21 +1083,20 @@ protected:
 
 private:
     ObjList m_handlers;
-    ObjList m_messages;
+    HashList m_handlersByName;
+    ObjList m_handlersAny;
     ObjList m_hooks;
+    DispatcherQueue* m_queues;
+    unsigned int m_queueCount;
+    ObjList* m_queueAffinity;
     RWLock m_handlersLock;
-    RWLock m_messagesLock;
     RWLock m_hooksLock;
-    ObjList* m_msgAppend;
     ObjList* m_hookAppend;
     String m_trackParam;
     unsigned int m_changes;
     u_int64_t m_warnTime;
-    u_int64_t m_enqueueCount;
-    u_int64_t m_dequeueCount;
     u_int64_t m_dispatchCount;
     u_int64_t m_queuedMax;
-    u_int64_t m_msgAvgAge;
     bool m_traceTime;
     bool m_traceHandlerTime;
     int m_hookCount;
@@ -1747,6 +1770,13 @@ public:
     inline unsigned int messageMaxRate() const
 	{ return m_maxMsgRate; }
 
+    /**
+     * Get the number of queues holding messages waiting to be dispatched
+     * @return Count of message queues
+     */
+    inline unsigned int messageQueues() const
+	{ return m_dispatcher.queueCount(); }
+
     /**
      * Get the average dequeued message age in milliseconds or microseconds
      * @param usec True to return microseconds instead of milliseconds
@@ -390,6 +390,7 @@ class DataSource;
 class DataTranslator;
 class TranslatorFactory;
 class ThreadedSourcePrivate;
+class ThreadedSourceClock;
 
 /**
  * A data consumer
@@ -581,6 +582,7 @@ private:
 class YATE_API ThreadedSource : public DataSource
 {
     friend class ThreadedSourcePrivate;
+    friend class ThreadedSourceClock;
 public:
     /**
      * The destruction notification, checks that the thread is gone
@@ -588,7 +590,8 @@ public:
     virtual void destroyed();
 
     /**
-     * Starts the worker thread
+     * Starts the worker thread. If the shared media clock is enabled and
+     *  the source implements frame() it is scheduled on the clock instead
      * @param name Static name of this thread
      * @param prio Thread's priority
      * @return True if started, false if an error occured
@@ -602,7 +605,7 @@ public:
 
     /**
      * Return a pointer to the worker thread
-     * @return Pointer to running worker thread or NULL
+     * @return Pointer to running worker thread, NULL if not running or running on the media clock
      */
     Thread* thread() const;
 
@@ -612,13 +615,25 @@ public:
      */
     bool running() const;
 
+    /**
+     * Set the number of threads of the shared media clock
+     * @param count Number of clock threads, zero to run each source in its own thread
+     */
+    static void setClock(unsigned int count);
+
+    /**
+     * Retrieve the number of sources currently running on the shared media clock
+     * @return Number of clocked sources
+     */
+    static unsigned int clocked();
+
 protected:
     /**
      * Threaded Source constructor
      * @param format Name of the data format, default "slin" (Signed Linear)
      */
     inline explicit ThreadedSource(const char* format = "slin")
-	: DataSource(format), m_thread(0)
+	: DataSource(format), m_thread(0), m_clock(0)
 	{ }
 
     /**
@@ -626,6 +641,16 @@ protected:
      */
     virtual void run() = 0;
 
+    /**
+     * Produce one frame of data when running on the shared media clock.
+     * It is called with a zero time before the source is scheduled so it
+     *  can initialize, the default implementation refuses the clock
+     * @param when Time in microseconds when this frame was due, zero on start
+     * @return Time in microseconds when the next frame is due, zero to stop
+     *  running (or to run in a thread of its own when called on start)
+     */
+    virtual u_int64_t frame(u_int64_t when);
+
     /**
      * The cleanup after thread method, deletes the source if already
      *  dereferenced and set for asynchronous deletion
@@ -641,6 +666,7 @@ protected:
 
 private:
     ThreadedSourcePrivate* m_thread;
+    ThreadedSourceClock* m_clock;
 };
 
 /**
@@ -1668,6 +1694,8 @@ private:
     u_int64_t m_timeout;
     u_int64_t m_maxcall;
     u_int64_t m_maxPDD;          // Timeout while waiting for some progress on outgoing calls
+    u_int64_t m_timerDue;        // Time the channel is scheduled in the driver's timer wheel
+    int m_timerSlot;             // Timer wheel slot, -1 if not scheduled, -2 if not listed
     u_int64_t m_dtmfTime;
     unsigned int m_toutAns;
     unsigned int m_dtmfSeq;
@@ -1821,12 +1849,27 @@ public:
     virtual bool msgControl(Message& msg);
 
     /**
-     * Timer check method, by default handles channel timeouts
+     * Timer check method, by default handles channel timeouts.
+     * It is called from the driver's timer only after the time returned by
+     *  timerDue() has passed
      * @param msg Timer message
      * @param tmr Current time against which timers are compared
      */
     virtual void checkTimers(Message& msg, const Time& tmr);
 
+    /**
+     * Retrieve the earliest time checkTimers() needs to be called.
+     * Derived classes with timers of their own must override this method and
+     *  call updateTimer() each time their timers change
+     * @return Time of the next timer check, zero if no timer is running
+     */
+    virtual u_int64_t timerDue() const;
+
+    /**
+     * Reschedule the channel in the driver's timer wheel after a timer change
+     */
+    void updateTimer();
+
     /**
      * Notification on progress of prerouting incoming call
      * @param msg Notification call.preroute message just after being dispatched
@@ -1954,7 +1997,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void timeout(u_int64_t tout)
-	{ m_timeout = tout; }
+	{ m_timeout = tout; updateTimer(); }
 
     /**
      * Get the time this channel will time out on outgoing calls
@@ -1968,7 +2011,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxcall(u_int64_t tout)
-	{ m_maxcall = tout; }
+	{ m_maxcall = tout; updateTimer(); }
 
     /**
      * Set the time this channel will time out on outgoing calls
@@ -1999,7 +2042,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxPDD(u_int64_t tout)
-	{ m_maxPDD = tout; }
+	{ m_maxPDD = tout; updateTimer(); }
 
     /**
      * Set the time this channel will time out while waiting for some progress
@@ -2239,12 +2282,15 @@ class YATE_API Driver : public Module
 {
     friend class Router;
     friend class Channel;
+    friend class Module;
+    friend class ChanDispatcher;
 
 private:
     bool m_init;
     bool m_varchan;
     String m_prefix;
     ObjList m_chans;
+    HashList m_chanHash;
     int m_routing;
     int m_routed;
     int m_total;
@@ -2254,7 +2300,13 @@ private:
     int m_maxchans;
     int m_chanCount;
     bool m_dtmfDups;
+    bool m_direct;
+    int m_directIds;
+    ObjList* m_timerWheel;
+    u_int32_t m_timerSec;
     volatile bool m_doExpire;
+    void timerSchedule(Channel* chan, u_int64_t due);
+    void timerExpire(ObjList& expired, const Time& tmr);
 
 public:
     /**
@@ -2292,6 +2344,14 @@ public:
      */
     virtual Channel* find(const String& id) const;
 
+    /**
+     * Find a channel of any driver by id
+     * @param id Unique identifier of the channel to find
+     * @param chan Pointer to fill with a reference to the channel
+     * @return True if the channel was found and referenced
+     */
+    static bool findChannel(const String& id, RefPointer<Channel>& chan);
+
     /**
      * Check if the driver is actively used.
      * @return True if the driver is in use, false if should be ok to restart
@@ -2380,6 +2440,11 @@ protected:
      */
     Driver(const char* name, const char* type = 0);
 
+    /**
+     * Destructor
+     */
+    virtual ~Driver();
+
     /**
      * This method is called to initialize the loaded module
      */